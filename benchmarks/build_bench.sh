@@ -0,0 +1,22 @@
+#!/bin/bash
+
+# Microbenchmarks for the shared helpers in ../drm_common
+CFLAGS="-O2 -I../drm_common"
+
+status=0
+
+gcc pixel_convert_bench.c ../drm_common/pixel_convert.c ../drm_common/frame_stats.c -o pixel_convert_bench $CFLAGS -lm || status=1
+gcc wc_blit_bench.c ../drm_common/wc_blit.c ../drm_common/frame_stats.c -o wc_blit_bench $CFLAGS -lm || status=1
+gcc worker_pool_bench.c ../drm_common/worker_pool.c ../drm_common/wc_blit.c ../drm_common/pixel_convert.c ../drm_common/frame_stats.c \
+    -o worker_pool_bench $CFLAGS -lm -lpthread || status=1
+gcc sprite_bench.c ../drm_common/sprite.c ../drm_common/plane_alloc.c ../drm_common/drm_props.c ../drm_common/drm_blob.c \
+    ../drm_common/fb_pool.c ../drm_common/swapchain.c ../drm_common/wc_blit.c ../drm_common/frame_stats.c ../drm_common/drm_device.c \
+    ../drm_common/topology.c ../drm_common/topology_cache.c ../drm_common/drm_formats.c \
+    -o sprite_bench $CFLAGS -I/usr/include/libdrm -ldrm -lm || status=1
+
+# Check if the compilation and linking were successful
+if [ $status -eq 0 ]; then
+    echo "Compilation and linking successful!"
+else
+    echo "Compilation or linking failed."
+fi
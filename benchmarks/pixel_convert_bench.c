@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "frame_stats.h"
+#include "pixel_convert.h"
+
+// Microbenchmark for the RGBA -> XRGB8888 conversion kernels.
+// Usage: pixel_convert_bench [iterations]
+// Every kernel is checked against the scalar result, then timed on a 1080p
+// and a 4K frame with a padded destination pitch (like a dumb buffer).
+
+struct bench_size {
+    const char *name;
+    int width;
+    int height;
+};
+
+static const struct bench_size sizes[] = {
+    { "1080p", 1920, 1080 },
+    { "4K",    3840, 2160 },
+};
+
+static int bench_size(const struct bench_size *size, int iterations) {
+    uint32_t src_pitch = size->width * 4;
+    uint32_t dst_pitch = src_pitch + 64;
+    size_t src_size = (size_t)src_pitch * size->height;
+    size_t dst_size = (size_t)dst_pitch * size->height;
+
+    uint8_t *src = aligned_alloc(64, src_size);
+    uint8_t *ref = aligned_alloc(64, dst_size);
+    uint8_t *dst = aligned_alloc(64, dst_size);
+    if (!src || !ref || !dst) {
+        fprintf(stderr, "Out of memory\n");
+        free(src);
+        free(ref);
+        free(dst);
+        return -1;
+    }
+
+    for (size_t i = 0; i < src_size; i++)
+        src[i] = (uint8_t)(i * 7 + (i >> 8));
+    convert_rgba_to_xrgb8888_impl(PIXEL_CONVERT_SCALAR, ref, dst_pitch, src, src_pitch, size->width, size->height);
+
+    // Only width * 4 bytes per row are payload; report the rate on those
+    double frame_bytes = (double)src_pitch * size->height;
+    double scalar_gbps = 0.0;
+    int status = 0;
+
+    for (int impl = 0; impl < PIXEL_CONVERT_IMPL_COUNT; impl++) {
+        if (!pixel_convert_supported(impl))
+            continue;
+
+        memset(dst, 0, dst_size);
+        convert_rgba_to_xrgb8888_impl(impl, dst, dst_pitch, src, src_pitch, size->width, size->height);
+        for (int y = 0; y < size->height; y++) {
+            if (memcmp(dst + (size_t)y * dst_pitch, ref + (size_t)y * dst_pitch, src_pitch) != 0) {
+                fprintf(stderr, "%s: %s output differs from scalar at row %d\n",
+                        size->name, pixel_convert_impl_name(impl), y);
+                status = -1;
+                break;
+            }
+        }
+
+        double start = now_ms();
+        for (int i = 0; i < iterations; i++)
+            convert_rgba_to_xrgb8888_impl(impl, dst, dst_pitch, src, src_pitch, size->width, size->height);
+        double elapsed_ms = now_ms() - start;
+
+        double gbps = frame_bytes * iterations / (elapsed_ms / 1000.0) / 1e9;
+        if (impl == PIXEL_CONVERT_SCALAR)
+            scalar_gbps = gbps;
+        printf("[BENCH]    : %-5s %-6s %7.3f ms/frame %6.2f GB/s (x%.2f vs scalar)\n",
+               size->name, pixel_convert_impl_name(impl), elapsed_ms / iterations, gbps,
+               scalar_gbps > 0.0 ? gbps / scalar_gbps : 1.0);
+    }
+
+    free(src);
+    free(ref);
+    free(dst);
+    return status;
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 200;
+    int status = 0;
+
+    if (iterations <= 0) {
+        fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+        return -1;
+    }
+
+    printf("[BENCH]    : best kernel on this CPU: %s\n", pixel_convert_impl_name(pixel_convert_best()));
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        if (bench_size(&sizes[i], iterations) != 0)
+            status = -1;
+    }
+    return status;
+}
@@ -0,0 +1,223 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+#include <drm_fourcc.h>
+
+#include "drm_blob.h"
+#include "drm_device.h"
+#include "drm_props.h"
+#include "fb_pool.h"
+#include "frame_stats.h"
+#include "plane_alloc.h"
+#include "sprite.h"
+#include "swapchain.h"
+#include "topology_cache.h"
+#include "wc_blit.h"
+
+// The same bouncing 256x256 square shown two ways:
+//   sprite - on an overlay plane, each vblank a commit of CRTC_X / CRTC_Y only
+//   redraw - in the primary plane, each vblank the frame is redrawn into the
+//            back buffer (background + square) and flipped
+// Both are paced by vblank, so commits/s should match; the difference is
+// the CPU time and the bytes written per frame.
+// Usage: sprite_bench [frames]   (needs a DRM device and a free VT)
+
+#define SPRITE_SIZE 256
+#define BACKGROUND  0xFF202040
+#define SPRITE      0xFFFFC000
+
+static double cpu_time_ms(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec * 1000.0 + usage.ru_utime.tv_usec / 1000.0 +
+           usage.ru_stime.tv_sec * 1000.0 + usage.ru_stime.tv_usec / 1000.0;
+}
+
+static void report(const char *name, int frames, double wall_ms, double cpu_ms, double bytes_per_frame) {
+    printf("[BENCH]    : %-7s %6.1f commits/s, CPU %.3f ms/frame (%.1f%% of one core), %.2f MB written/frame\n",
+           name, frames / (wall_ms / 1000.0), cpu_ms / frames, 100.0 * cpu_ms / wall_ms, bytes_per_frame / 1e6);
+}
+
+static int run_sprite(int drm_fd, const drmModeModeInfo *mode, const struct drm_object_props *plane_props, int frames) {
+    struct sprite_engine engine;
+    drmEventContext events = {
+        .version = 3,
+        .page_flip_handler2 = sprite_flip_handler,
+    };
+    struct sprite sprite = {
+        .plane = plane_props,
+        .w = SPRITE_SIZE, .h = SPRITE_SIZE,
+        .fb_w = SPRITE_SIZE, .fb_h = SPRITE_SIZE,
+        .vx = 7, .vy = 5,
+    };
+
+    sprite_engine_init(&engine, drm_fd, &events, mode->hdisplay, mode->vdisplay);
+    sprite_engine_add(&engine, &sprite);
+
+    double start = now_ms();
+    double start_cpu = cpu_time_ms();
+    for (int i = 0; i < frames; i++) {
+        sprite_engine_step(&engine);
+        if (sprite_engine_commit(&engine) != 0 || sprite_engine_wait(&engine, 1000) != 0)
+            return -1;
+    }
+    report("sprite", frames, now_ms() - start, cpu_time_ms() - start_cpu, 0.0);
+    sprite_engine_print_stats(&engine);
+    return 0;
+}
+
+static int run_redraw(int drm_fd, const drmModeModeInfo *mode, const struct drm_object_props *primary_props,
+                      struct swapchain *sc, int frames) {
+    int width = mode->hdisplay;
+    int height = mode->vdisplay;
+
+    // Same motion as the sprite run; the engine only does the arithmetic
+    struct sprite_engine motion;
+    struct sprite sprite = {
+        .w = SPRITE_SIZE, .h = SPRITE_SIZE,
+        .fb_w = SPRITE_SIZE, .fb_h = SPRITE_SIZE,
+        .vx = 7, .vy = 5,
+    };
+    sprite_engine_init(&motion, drm_fd, NULL, width, height);
+    struct sprite *s = sprite_engine_add(&motion, &sprite);
+
+    double start = now_ms();
+    double start_cpu = cpu_time_ms();
+    for (int i = 0; i < frames; i++) {
+        sprite_engine_step(&motion);
+
+        struct swap_buffer *buf = swapchain_acquire(sc);
+        if (!buf) {
+            if (swapchain_wait_flip(sc, 1000) != 0)
+                return -1;
+            buf = swapchain_acquire(sc);
+        }
+        wc_fill(buf->map, buf->map_pitch, width, height, BACKGROUND);
+        wc_fill_rect(buf->map, buf->map_pitch, s->x, s->y, SPRITE_SIZE, SPRITE_SIZE, SPRITE);
+
+        drmModeAtomicReq *req = drmModeAtomicAlloc();
+        drm_props_add(req, primary_props, DRM_PROP_PLANE_FB_ID, buf->fb_id);
+        int ret = drmModeAtomicCommit(drm_fd, req, DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT, sc);
+        drmModeAtomicFree(req);
+        if (ret < 0) {
+            perror("drmModeAtomicCommit (redraw) failed");
+            return -1;
+        }
+        swapchain_queue(sc, buf);
+        if (swapchain_wait_flip(sc, 1000) != 0)
+            return -1;
+    }
+    report("redraw", frames, now_ms() - start, cpu_time_ms() - start_cpu,
+           (double)width * height * 4 + SPRITE_SIZE * SPRITE_SIZE * 4);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int frames = argc > 1 ? atoi(argv[1]) : 600;
+    if (frames <= 0)
+        frames = 600;
+
+    struct drm_device_info dev;
+    int drm_fd = drm_device_open(&dev);
+    if (drm_fd < 0)
+        return 1;
+
+    static struct kms_topology topo;
+    const struct kms_output *out = NULL;
+    struct drm_blob_cache blobs;
+    struct fb_pool fbs;
+    struct plane_alloc planes;
+    struct swapchain sc;
+    int status = 1;
+
+    drm_blob_cache_init(&blobs, drm_fd);
+    fb_pool_init(&fbs, drm_fd, &fb_pool_dumb_backend, NULL, 2);
+    swapchain_init(&sc, drm_fd, 2);
+
+    // First output of the solved topology: a CRTC its encoders can drive
+    if (topology_solve_cached(drm_fd, NULL, &topo) <= 0 ||
+        plane_alloc_init(&planes, drm_fd, topo.outputs[0].crtc_id, topo.outputs[0].crtc_index) != 0) {
+        fprintf(stderr, "No usable output\n");
+        goto out;
+    }
+    out = &topo.outputs[0];
+
+    int width = out->mode.hdisplay;
+    int height = out->mode.vdisplay;
+    for (int i = 0; i < 2; i++) {
+        struct fb_pool_entry *fb = fb_pool_acquire(&fbs, width, height, DRM_FORMAT_XRGB8888, DRM_FORMAT_MOD_INVALID);
+        if (!fb)
+            goto out;
+        sc.buffers[i].fb_id = fb->fb_id;
+        sc.buffers[i].map = fb->map;
+        sc.buffers[i].map_pitch = fb->map_pitch;
+        sc.buffers[i].owner = fb;
+        wc_fill(fb->map, fb->map_pitch, width, height, BACKGROUND);
+    }
+    struct fb_pool_entry *square = fb_pool_acquire(&fbs, SPRITE_SIZE, SPRITE_SIZE, DRM_FORMAT_XRGB8888,
+                                                   DRM_FORMAT_MOD_INVALID);
+    if (!square)
+        goto out;
+    wc_fill(square->map, square->map_pitch, SPRITE_SIZE, SPRITE_SIZE, SPRITE);
+
+    // Modeset with the background on the primary and the square on a plane
+    struct plane_layer layers[] = {
+        { .fb_id = sc.buffers[0].fb_id, .fourcc = DRM_FORMAT_XRGB8888, .modifier = DRM_FORMAT_MOD_INVALID,
+          .src_w = width, .src_h = height, .w = width, .h = height, .zorder = 0 },
+        { .fb_id = square->fb_id, .fourcc = DRM_FORMAT_XRGB8888, .modifier = DRM_FORMAT_MOD_INVALID,
+          .src_w = SPRITE_SIZE, .src_h = SPRITE_SIZE, .w = SPRITE_SIZE, .h = SPRITE_SIZE, .zorder = 1 },
+    };
+    uint32_t blob_id = drm_mode_blob_get(&blobs, &out->mode);
+    drmModeAtomicReq *modeset = drmModeAtomicAlloc();
+    drm_props_add(modeset, &out->conn_props, DRM_PROP_CONNECTOR_CRTC_ID, out->crtc_id);
+    drm_props_add(modeset, &out->crtc_props, DRM_PROP_CRTC_MODE_ID, blob_id);
+    drm_props_add(modeset, &out->crtc_props, DRM_PROP_CRTC_ACTIVE, 1);
+
+    if (plane_alloc_assign(&planes, layers, 2, modeset, DRM_MODE_ATOMIC_ALLOW_MODESET) == 0) {
+        fprintf(stderr, "No plane configuration accepted by the kernel\n");
+        drmModeAtomicFree(modeset);
+        goto out;
+    }
+    plane_alloc_print(&planes, layers, 2);
+    plane_alloc_add(&planes, modeset, layers, 2);
+    int ret = drmModeAtomicCommit(drm_fd, modeset, DRM_MODE_ATOMIC_ALLOW_MODESET, NULL);
+    drmModeAtomicFree(modeset);
+    if (ret < 0) {
+        perror("drmModeAtomicCommit (modeset) failed");
+        goto out;
+    }
+    // Probed with the modeset as base; later commits are flip-only
+    plane_alloc_reset_memo(&planes);
+    swapchain_present_now(&sc, &sc.buffers[0]);
+
+    status = 0;
+    if (layers[1].plane < 0)
+        printf("[BENCH]    : no plane for the sprite, skipping the sprite run\n");
+    else if (run_sprite(drm_fd, &out->mode, &planes.planes[layers[1].plane].props, frames) != 0)
+        status = 1;
+
+    // Square off its plane; from now on it is drawn into the primary
+    if (layers[1].plane >= 0) {
+        layers[1].plane = -1;
+        drmModeAtomicReq *req = drmModeAtomicAlloc();
+        plane_alloc_add(&planes, req, layers, 2);
+        drmModeAtomicCommit(drm_fd, req, 0, NULL);
+        drmModeAtomicFree(req);
+    }
+    if (run_redraw(drm_fd, &out->mode, &planes.planes[0].props, &sc, frames) != 0)
+        status = 1;
+
+out:
+    if (swapchain_flip_pending(&sc))
+        swapchain_wait_flip(&sc, 1000);
+    fb_pool_destroy(&fbs);
+    drm_blob_cache_destroy(&blobs);
+    close(drm_fd);
+    return status;
+}
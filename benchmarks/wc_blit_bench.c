@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "frame_stats.h"
+#include "wc_blit.h"
+
+// Throughput of the wc_blit primitives against the code they replace: the
+// old per-example fill_color() loop and a memcpy per row.
+// Usage: wc_blit_bench [iterations]
+// Buffers are ordinary cached memory here. On a real dumb-buffer mapping
+// (write-combined) the gap between plain and streaming stores is larger,
+// so treat these numbers as a lower bound.
+
+#define FB_WIDTH    3840
+#define FB_HEIGHT   2160
+#define SPRITE_SIZE 256
+
+// The loop every example used to carry
+static void fill_color(uint8_t *data, int size, uint32_t color) {
+    for (int i = 0; i < size; i += 4)
+        *(uint32_t *)(data + i) = color;
+}
+
+static void report(const char *name, double elapsed_ms, int iterations, double bytes, double baseline_gbps,
+                   double *gbps_out) {
+    double gbps = bytes * iterations / (elapsed_ms / 1000.0) / 1e9;
+    printf("[BENCH]    : %-22s %8.3f ms/op %6.2f GB/s", name, elapsed_ms / iterations, gbps);
+    if (baseline_gbps > 0.0)
+        printf(" (x%.2f)", gbps / baseline_gbps);
+    printf("\n");
+    if (gbps_out)
+        *gbps_out = gbps;
+}
+
+static int check_rect(const uint8_t *fb, uint32_t pitch, int x, int y, int w, int h, uint32_t color) {
+    for (int row = y; row < y + h; row++) {
+        const uint32_t *p = (const uint32_t *)(fb + (size_t)row * pitch) + x;
+        for (int col = 0; col < w; col++) {
+            if (p[col] != color)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 50;
+    if (iterations <= 0) {
+        fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+        return -1;
+    }
+
+    // Padded pitch like a dumb buffer; an odd x offset exercises head/tail
+    uint32_t pitch = FB_WIDTH * 4 + 256;
+    size_t fb_size = (size_t)pitch * FB_HEIGHT;
+    uint8_t *fb = aligned_alloc(4096, fb_size);
+    uint8_t *src = aligned_alloc(4096, fb_size);
+    if (!fb || !src) {
+        fprintf(stderr, "Out of memory\n");
+        free(fb);
+        free(src);
+        return -1;
+    }
+    memset(src, 0x3c, fb_size);
+    memset(fb, 0, fb_size);
+
+    double frame_bytes = (double)FB_WIDTH * 4 * FB_HEIGHT;
+    double sprite_bytes = (double)SPRITE_SIZE * 4 * SPRITE_SIZE;
+    double baseline = 0.0;
+    double start;
+
+    // Correctness first: odd-aligned rectangle, nothing written outside it
+    wc_fill_rect(fb, pitch, 3, 5, 333, 17, 0xFF123456);
+    if (check_rect(fb, pitch, 3, 5, 333, 17, 0xFF123456) != 0 || check_rect(fb, pitch, 0, 5, 3, 17, 0) != 0 ||
+        check_rect(fb, pitch, 336, 5, 4, 17, 0) != 0) {
+        fprintf(stderr, "wc_fill_rect wrote the wrong pixels\n");
+        return -1;
+    }
+    wc_blit(fb, pitch, 7, 40, src, pitch, 101, 9);
+    if (check_rect(fb, pitch, 7, 40, 101, 9, 0x3c3c3c3c) != 0 || check_rect(fb, pitch, 108, 40, 3, 9, 0) != 0) {
+        fprintf(stderr, "wc_blit wrote the wrong pixels\n");
+        return -1;
+    }
+
+    printf("[BENCH]    : %dx%d frame, pitch %u, %d iterations\n", FB_WIDTH, FB_HEIGHT, pitch, iterations);
+
+    start = now_ms();
+    for (int i = 0; i < iterations; i++)
+        fill_color(fb, (int)fb_size, 0xFF0000FF);
+    report("fill: fill_color()", now_ms() - start, iterations, frame_bytes, 0.0, &baseline);
+
+    start = now_ms();
+    for (int i = 0; i < iterations; i++)
+        wc_fill(fb, pitch, FB_WIDTH, FB_HEIGHT, 0xFF0000FF);
+    report("fill: wc_fill()", now_ms() - start, iterations, frame_bytes, baseline, NULL);
+
+    start = now_ms();
+    for (int i = 0; i < iterations; i++) {
+        for (int y = 0; y < FB_HEIGHT; y++)
+            memcpy(fb + (size_t)y * pitch, src + (size_t)y * pitch, FB_WIDTH * 4);
+    }
+    report("copy: memcpy per row", now_ms() - start, iterations, frame_bytes, 0.0, &baseline);
+
+    start = now_ms();
+    for (int i = 0; i < iterations; i++)
+        wc_copy(fb, pitch, src, pitch, FB_WIDTH * 4, FB_HEIGHT);
+    report("copy: wc_copy()", now_ms() - start, iterations, frame_bytes, baseline, NULL);
+
+    // Many small blits at unaligned positions, as a sprite or cursor update would do
+    int blits = iterations * 64;
+    start = now_ms();
+    for (int i = 0; i < blits; i++) {
+        int x = (i * 37) % (FB_WIDTH - SPRITE_SIZE);
+        int y = (i * 53) % (FB_HEIGHT - SPRITE_SIZE);
+        for (int row = 0; row < SPRITE_SIZE; row++)
+            memcpy(fb + (size_t)(y + row) * pitch + (size_t)x * 4, src + (size_t)row * pitch, SPRITE_SIZE * 4);
+    }
+    report("blit 256x256: memcpy", now_ms() - start, blits, sprite_bytes, 0.0, &baseline);
+
+    start = now_ms();
+    for (int i = 0; i < blits; i++) {
+        int x = (i * 37) % (FB_WIDTH - SPRITE_SIZE);
+        int y = (i * 53) % (FB_HEIGHT - SPRITE_SIZE);
+        wc_blit(fb, pitch, x, y, src, pitch, SPRITE_SIZE, SPRITE_SIZE);
+    }
+    report("blit 256x256: wc_blit", now_ms() - start, blits, sprite_bytes, baseline, NULL);
+
+    free(fb);
+    free(src);
+    return 0;
+}
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "frame_stats.h"
+#include "worker_pool.h"
+
+// Scaling benchmark for the band-parallel fill / copy / RGBA -> XRGB8888
+// conversion. Usage: worker_pool_bench [iterations] [max_threads] [numa_node]
+// Runs every operation with 1..max_threads threads on a 1080p and a 4K frame
+// with a padded destination pitch and prints GB/s and speed-up over 1 thread.
+
+enum bench_op {
+    BENCH_FILL,
+    BENCH_COPY,
+    BENCH_CONVERT,
+    BENCH_OP_COUNT
+};
+
+static const char *const op_names[BENCH_OP_COUNT] = { "fill", "copy", "convert" };
+
+struct bench_size {
+    const char *name;
+    int width;
+    int height;
+};
+
+static const struct bench_size sizes[] = {
+    { "1080p", 1920, 1080 },
+    { "4K",    3840, 2160 },
+};
+
+static void run_op(struct worker_pool *pool, enum bench_op op, uint8_t *dst, uint32_t dst_pitch,
+                   const uint8_t *src, uint32_t src_pitch, int width, int height) {
+    switch (op) {
+    case BENCH_FILL:
+        parallel_fill_xrgb8888(pool, dst, dst_pitch, width, height, 0xFF0000FF);
+        break;
+    case BENCH_COPY:
+        parallel_copy(pool, dst, dst_pitch, src, src_pitch, width * 4, height);
+        break;
+    default:
+        parallel_convert_rgba_to_xrgb8888(pool, dst, dst_pitch, src, src_pitch, width, height);
+        break;
+    }
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 100;
+    int max_threads = argc > 2 ? atoi(argv[2]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int numa_node = argc > 3 ? atoi(argv[3]) : -1;
+
+    if (iterations <= 0 || max_threads <= 0) {
+        fprintf(stderr, "Usage: %s [iterations] [max_threads] [numa_node]\n", argv[0]);
+        return -1;
+    }
+    if (max_threads > WORKER_POOL_MAX_THREADS)
+        max_threads = WORKER_POOL_MAX_THREADS;
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        const struct bench_size *size = &sizes[s];
+        uint32_t src_pitch = size->width * 4;
+        uint32_t dst_pitch = src_pitch + 64;
+        uint8_t *src = aligned_alloc(64, (size_t)src_pitch * size->height);
+        uint8_t *dst = aligned_alloc(64, (size_t)dst_pitch * size->height);
+        if (!src || !dst) {
+            fprintf(stderr, "Out of memory\n");
+            free(src);
+            free(dst);
+            return -1;
+        }
+        memset(src, 0x5a, (size_t)src_pitch * size->height);
+        memset(dst, 0, (size_t)dst_pitch * size->height);
+
+        double frame_bytes = (double)src_pitch * size->height;
+        double single_gbps[BENCH_OP_COUNT] = { 0.0 };
+
+        for (int threads = 1; threads <= max_threads; threads++) {
+            struct worker_pool pool;
+            if (worker_pool_init(&pool, threads, numa_node) != 0) {
+                free(src);
+                free(dst);
+                return -1;
+            }
+
+            for (int op = 0; op < BENCH_OP_COUNT; op++) {
+                // One untimed pass to fault in the pages and wake the workers
+                run_op(&pool, op, dst, dst_pitch, src, src_pitch, size->width, size->height);
+
+                double start = now_ms();
+                for (int i = 0; i < iterations; i++)
+                    run_op(&pool, op, dst, dst_pitch, src, src_pitch, size->width, size->height);
+                double elapsed_ms = now_ms() - start;
+
+                double gbps = frame_bytes * iterations / (elapsed_ms / 1000.0) / 1e9;
+                if (threads == 1)
+                    single_gbps[op] = gbps;
+                printf("[BENCH]    : %-5s %-7s %2d threads %7.3f ms/frame %6.2f GB/s (x%.2f)\n",
+                       size->name, op_names[op], threads, elapsed_ms / iterations, gbps, gbps / single_gbps[op]);
+            }
+            worker_pool_destroy(&pool);
+        }
+
+        free(src);
+        free(dst);
+    }
+    return 0;
+}
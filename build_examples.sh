@@ -0,0 +1,24 @@
+#!/bin/bash
+
+# Shared DRM helpers used by the atomic examples
+COMMON_SRCS="drm_common/drm_props.c drm_common/drm_blob.c drm_common/drm_formats.c drm_common/dmabuf_import.c drm_common/plane_alloc.c drm_common/sprite.c drm_common/cursor.c drm_common/frame_stats.c drm_common/wc_blit.c drm_common/fb_pool.c drm_common/topology.c drm_common/topology_cache.c drm_common/drm_device.c drm_common/takeover.c"
+CFLAGS="-I/usr/include/libdrm -Idrm_common"
+
+status=0
+
+# Query tools (only the device selection is shared)
+gcc modelists.c drm_common/drm_device.c -o modelists $CFLAGS -ldrm || status=1
+gcc planetype.c drm_common/drm_device.c -o planetype $CFLAGS -ldrm || status=1
+
+# Atomic modesetting examples
+gcc drm_mode_plane.c $COMMON_SRCS -o drm_mode_plane $CFLAGS -ldrm -lm || status=1
+gcc drm_mode_multiplane.c $COMMON_SRCS -o drm_mode_multiplane $CFLAGS -ldrm -lm || status=1
+gcc drm_mode_multidisplay.c $COMMON_SRCS drm_common/swapchain.c drm_common/frame_group.c drm_common/hotplug.c -o drm_mode_multidisplay $CFLAGS -ldrm -lm -lpthread || status=1
+gcc gbm_drm_example.c $COMMON_SRCS -o gbm_drm_example $CFLAGS -ldrm -lgbm -lm || status=1
+
+# Check if the compilation and linking were successful
+if [ $status -eq 0 ]; then
+    echo "Compilation and linking successful!"
+else
+    echo "Compilation or linking failed."
+fi
@@ -0,0 +1,336 @@
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <drm_fourcc.h>
+
+#include "cursor.h"
+#include "hash.h"
+#include "wc_blit.h"
+
+// Image rows and hotspot
+static uint64_t image_hash(const uint32_t *argb, uint32_t width, uint32_t height, uint32_t pitch,
+                           int32_t hot_x, int32_t hot_y) {
+    int32_t header[4] = { (int32_t)width, (int32_t)height, hot_x, hot_y };
+    uint64_t hash = fnv1a_bytes(FNV1A_OFFSET, header, sizeof(header));
+
+    for (uint32_t row = 0; row < height; row++)
+        hash = fnv1a_bytes(hash, (const uint8_t *)argb + (size_t)row * pitch, width * 4);
+    return hash;
+}
+
+// Top-left corner of the plane for the current pointer position. Cursor
+// planes may hang off the CRTC edges; overlays on some hardware reject
+// that, so the fallback keeps the whole image on the CRTC.
+static void plane_position(const struct cursor *cursor, int32_t *px, int32_t *py) {
+    int32_t x = cursor->x - cursor->hot_x;
+    int32_t y = cursor->y - cursor->hot_y;
+
+    if (cursor->plane->type != DRM_PLANE_TYPE_CURSOR) {
+        int32_t max_x = (int32_t)cursor->crtc_w - (int32_t)cursor->width;
+        int32_t max_y = (int32_t)cursor->crtc_h - (int32_t)cursor->height;
+        x = x < 0 ? 0 : x > max_x ? max_x : x;
+        y = y < 0 ? 0 : y > max_y ? max_y : y;
+    }
+    *px = x;
+    *py = y;
+}
+
+static int add_plane(drmModeAtomicReq *req, const struct cursor *cursor, const struct drm_object_props *props,
+                     uint32_t fb_id, int32_t x, int32_t y) {
+    if (drm_props_add(req, props, DRM_PROP_PLANE_FB_ID, fb_id) < 0 ||
+        drm_props_add(req, props, DRM_PROP_PLANE_CRTC_ID, cursor->crtc_id) < 0 ||
+        drm_props_add(req, props, DRM_PROP_PLANE_SRC_X, 0) < 0 ||
+        drm_props_add(req, props, DRM_PROP_PLANE_SRC_Y, 0) < 0 ||
+        drm_props_add(req, props, DRM_PROP_PLANE_SRC_W, (uint64_t)cursor->width << 16) < 0 ||
+        drm_props_add(req, props, DRM_PROP_PLANE_SRC_H, (uint64_t)cursor->height << 16) < 0 ||
+        drm_props_add(req, props, DRM_PROP_PLANE_CRTC_X, (uint64_t)(int64_t)x) < 0 ||
+        drm_props_add(req, props, DRM_PROP_PLANE_CRTC_Y, (uint64_t)(int64_t)y) < 0 ||
+        drm_props_add(req, props, DRM_PROP_PLANE_CRTC_W, cursor->width) < 0 ||
+        drm_props_add(req, props, DRM_PROP_PLANE_CRTC_H, cursor->height) < 0)
+        return -1;
+
+    // Above every layer plane_alloc stacked, whatever plane it is
+    if (props->ids[DRM_PROP_PLANE_ZPOS] && !drm_prop_immutable(props, DRM_PROP_PLANE_ZPOS))
+        drm_props_add(req, props, DRM_PROP_PLANE_ZPOS, props->max[DRM_PROP_PLANE_ZPOS]);
+    return 0;
+}
+
+// Would the kernel show the cursor on this plane?
+static int plane_takes_cursor(const struct cursor *cursor, const struct hw_plane *plane) {
+    drmModeAtomicReq *req = drmModeAtomicAlloc();
+    if (!req) {
+        fprintf(stderr, "Failed to allocate atomic request\n");
+        return 0;
+    }
+    int ret = add_plane(req, cursor, &plane->props, cursor->buffers[0]->fb_id, 0, 0);
+    if (ret == 0)
+        ret = drmModeAtomicCommit(cursor->drm_fd, req, DRM_MODE_ATOMIC_TEST_ONLY, NULL);
+    drmModeAtomicFree(req);
+    return ret == 0;
+}
+
+int cursor_init(struct cursor *cursor, const struct plane_alloc *planes, const struct plane_layer *layers,
+                int count, struct fb_pool *fbs, drmEventContext *evctx, uint32_t crtc_w, uint32_t crtc_h) {
+    int used[PLANE_ALLOC_MAX_PLANES] = {0};
+    uint64_t cap;
+
+    memset(cursor, 0, sizeof(*cursor));
+    cursor->drm_fd = planes->drm_fd;
+    cursor->evctx = evctx;
+    cursor->crtc_id = planes->crtc_id;
+    cursor->crtc_w = crtc_w;
+    cursor->crtc_h = crtc_h;
+    cursor->fbs = fbs;
+    cursor->front = -1;
+
+    // Many drivers only scan out cursor FBs of exactly this size
+    cursor->width = drmGetCap(cursor->drm_fd, DRM_CAP_CURSOR_WIDTH, &cap) == 0 && cap ? (uint32_t)cap
+                                                                                     : CURSOR_DEFAULT_SIZE;
+    cursor->height = drmGetCap(cursor->drm_fd, DRM_CAP_CURSOR_HEIGHT, &cap) == 0 && cap ? (uint32_t)cap
+                                                                                      : CURSOR_DEFAULT_SIZE;
+
+    for (int i = 0; i < 2; i++) {
+        cursor->buffers[i] = fb_pool_acquire(fbs, cursor->width, cursor->height, DRM_FORMAT_ARGB8888,
+                                             DRM_FORMAT_MOD_INVALID);
+        if (!cursor->buffers[i]) {
+            cursor_destroy(cursor);
+            return -1;
+        }
+        wc_fill(cursor->buffers[i]->map, cursor->buffers[i]->map_pitch, cursor->width, cursor->height, 0);
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (layers[i].plane >= 0)
+            used[layers[i].plane] = 1;
+    }
+
+    // Cursor planes first, then overlays from the top of the stack down
+    for (int pass = 0; pass < 2 && !cursor->plane; pass++) {
+        for (int p = planes->count - 1; p > 0; p--) {
+            const struct hw_plane *plane = &planes->planes[p];
+            if (used[p] || (plane->initial_crtc && plane->initial_crtc != planes->crtc_id))
+                continue;
+            if (plane->type != (pass == 0 ? DRM_PLANE_TYPE_CURSOR : DRM_PLANE_TYPE_OVERLAY))
+                continue;
+            if (!hw_plane_has_format(plane, DRM_FORMAT_ARGB8888))
+                continue;
+            if (plane_takes_cursor(cursor, plane)) {
+                cursor->plane = plane;
+                break;
+            }
+        }
+    }
+
+    if (!cursor->plane) {
+        fprintf(stderr, "No plane takes a %ux%u ARGB8888 cursor\n", cursor->width, cursor->height);
+        cursor_destroy(cursor);
+        return -1;
+    }
+    printf("[CURSOR]   : plane %u (%s), %ux%u\n", cursor->plane->id,
+           cursor->plane->type == DRM_PLANE_TYPE_CURSOR ? "cursor" : "overlay fallback", cursor->width,
+           cursor->height);
+    return 0;
+}
+
+void cursor_flip_handler(int fd, unsigned int sequence, unsigned int tv_sec, unsigned int tv_usec,
+                         unsigned int crtc_id, void *user_data) {
+    struct cursor *cursor = user_data;
+
+    (void)fd;
+    (void)sequence;
+    (void)tv_sec;
+    (void)tv_usec;
+    (void)crtc_id;
+
+    cursor->flip_pending = 0;
+}
+
+static int commit(struct cursor *cursor, drmModeAtomicReq *req) {
+    int ret = drmModeAtomicCommit(cursor->drm_fd, req, DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT,
+                                  cursor);
+    drmModeAtomicFree(req);
+    if (ret < 0) {
+        perror("drmModeAtomicCommit (cursor) failed");
+        return -1;
+    }
+    cursor->flip_pending = 1;
+    cursor->commits++;
+    return 0;
+}
+
+// CRTC_X / CRTC_Y only, and only the one that changed
+static int commit_position(struct cursor *cursor) {
+    int32_t x, y;
+    plane_position(cursor, &x, &y);
+    cursor->dirty = 0;
+    if (x == cursor->shown_x && y == cursor->shown_y)
+        return 0;
+
+    drmModeAtomicReq *req = drmModeAtomicAlloc();
+    if (!req) {
+        fprintf(stderr, "Failed to allocate atomic request\n");
+        return -1;
+    }
+    if (x != cursor->shown_x)
+        drm_props_add(req, &cursor->plane->props, DRM_PROP_PLANE_CRTC_X, (uint64_t)(int64_t)x);
+    if (y != cursor->shown_y)
+        drm_props_add(req, &cursor->plane->props, DRM_PROP_PLANE_CRTC_Y, (uint64_t)(int64_t)y);
+    if (commit(cursor, req) != 0)
+        return -1;
+
+    cursor->shown_x = x;
+    cursor->shown_y = y;
+    return 0;
+}
+
+int cursor_set_image(struct cursor *cursor, const uint32_t *argb, uint32_t width, uint32_t height,
+                     uint32_t pitch, int32_t hot_x, int32_t hot_y) {
+    if (!cursor->plane)
+        return -1;
+    if (width > cursor->width || height > cursor->height) {
+        fprintf(stderr, "Cursor image %ux%u larger than the %ux%u cursor\n", width, height, cursor->width,
+                cursor->height);
+        return -1;
+    }
+
+    uint64_t hash = image_hash(argb, width, height, pitch, hot_x, hot_y);
+    if (cursor->front >= 0 && hash == cursor->image_hash) {
+        cursor->unchanged++;
+        return 0;
+    }
+
+    // Until the commit in flight completes the back buffer may still be on screen
+    if (cursor_wait(cursor, 1000) != 0)
+        return -1;
+
+    int back = cursor->front < 0 ? 0 : 1 - cursor->front;
+    struct fb_pool_entry *buf = cursor->buffers[back];
+    wc_fill(buf->map, buf->map_pitch, cursor->width, cursor->height, 0);
+    wc_blit(buf->map, buf->map_pitch, 0, 0, (const uint8_t *)argb, pitch, width, height);
+
+    cursor->hot_x = hot_x;
+    cursor->hot_y = hot_y;
+    int32_t x, y;
+    plane_position(cursor, &x, &y);
+
+    drmModeAtomicReq *req = drmModeAtomicAlloc();
+    if (!req) {
+        fprintf(stderr, "Failed to allocate atomic request\n");
+        return -1;
+    }
+    if (cursor->front < 0) {
+        add_plane(req, cursor, &cursor->plane->props, buf->fb_id, x, y);
+    } else {
+        drm_props_add(req, &cursor->plane->props, DRM_PROP_PLANE_FB_ID, buf->fb_id);
+        if (x != cursor->shown_x)
+            drm_props_add(req, &cursor->plane->props, DRM_PROP_PLANE_CRTC_X, (uint64_t)(int64_t)x);
+        if (y != cursor->shown_y)
+            drm_props_add(req, &cursor->plane->props, DRM_PROP_PLANE_CRTC_Y, (uint64_t)(int64_t)y);
+    }
+    if (commit(cursor, req) != 0)
+        return -1;
+
+    cursor->front = back;
+    cursor->image_hash = hash;
+    cursor->shown_x = x;
+    cursor->shown_y = y;
+    cursor->images++;
+    return 0;
+}
+
+int cursor_move(struct cursor *cursor, int32_t x, int32_t y) {
+    if (!cursor->plane)
+        return -1;
+
+    cursor->moves++;
+    cursor->x = x;
+    cursor->y = y;
+
+    // Nothing on screen yet: the first image commit takes the position
+    if (cursor->front < 0)
+        return 0;
+
+    // One commit in flight at a time; the latest position goes out next
+    if (cursor->flip_pending) {
+        if (cursor->dirty)
+            cursor->coalesced++;
+        cursor->dirty = 1;
+        return 0;
+    }
+    return commit_position(cursor);
+}
+
+// Returns 1 if events were handled, 0 on timeout, -1 on error. Events of
+// other commits on the fd go to the caller's handler along with ours.
+static int handle_events(struct cursor *cursor, int timeout_ms) {
+    struct pollfd pfd = { .fd = cursor->drm_fd, .events = POLLIN };
+
+    int ret = poll(&pfd, 1, timeout_ms);
+    if (ret < 0) {
+        if (errno == EINTR)
+            return 1;
+        perror("poll on DRM fd failed");
+        return -1;
+    }
+    if (ret == 0)
+        return 0;
+    if (drmHandleEvent(cursor->drm_fd, cursor->evctx) != 0 && errno != EAGAIN) {
+        perror("drmHandleEvent failed");
+        return -1;
+    }
+    return 1;
+}
+
+int cursor_dispatch(struct cursor *cursor) {
+    if (cursor->flip_pending && handle_events(cursor, 0) < 0)
+        return -1;
+    if (!cursor->flip_pending && cursor->dirty)
+        return commit_position(cursor);
+    return 0;
+}
+
+int cursor_wait(struct cursor *cursor, int timeout_ms) {
+    while (cursor->flip_pending || cursor->dirty) {
+        if (!cursor->flip_pending) {
+            if (commit_position(cursor) != 0)
+                return -1;
+            continue;
+        }
+        int ret = handle_events(cursor, timeout_ms);
+        if (ret <= 0) {
+            if (ret == 0)
+                fprintf(stderr, "Timed out waiting for cursor commit\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void cursor_destroy(struct cursor *cursor) {
+    if (cursor->plane && cursor->front >= 0) {
+        cursor_wait(cursor, 1000);
+
+        drmModeAtomicReq *req = drmModeAtomicAlloc();
+        if (req) {
+            drm_props_add(req, &cursor->plane->props, DRM_PROP_PLANE_FB_ID, 0);
+            drm_props_add(req, &cursor->plane->props, DRM_PROP_PLANE_CRTC_ID, 0);
+            if (drmModeAtomicCommit(cursor->drm_fd, req, 0, NULL) < 0)
+                perror("drmModeAtomicCommit (cursor off) failed");
+            drmModeAtomicFree(req);
+        }
+    }
+
+    for (int i = 0; i < 2; i++) {
+        fb_pool_release(cursor->fbs, cursor->buffers[i]);
+        cursor->buffers[i] = NULL;
+    }
+    cursor->plane = NULL;
+    cursor->front = -1;
+}
+
+void cursor_print_stats(const struct cursor *cursor) {
+    printf("[CURSOR]   : %u moves, %u commits, %u moves coalesced, %u images swapped in, %u unchanged skipped\n",
+           cursor->moves, cursor->commits, cursor->coalesced, cursor->images, cursor->unchanged);
+}
@@ -0,0 +1,97 @@
+#ifndef CURSOR_H
+#define CURSOR_H
+
+#include <stdint.h>
+
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#include "fb_pool.h"
+#include "plane_alloc.h"
+
+#define CURSOR_DEFAULT_SIZE 64
+
+// A pointer on its own plane: the cursor plane if the CRTC has one, else
+// the topmost free overlay that takes ARGB8888. The image lives in two
+// small ARGB8888 buffers; a new image is written to the one not on screen
+// and swapped in with an FB_ID commit, and only when it really changed.
+// Moving is a CRTC_X / CRTC_Y commit. Moves made while a commit is in
+// flight are coalesced into one commit when it completes.
+struct cursor {
+    int drm_fd;
+    drmEventContext *evctx;     // the caller's, see cursor_init()
+    uint32_t crtc_id;
+    uint32_t crtc_w;
+    uint32_t crtc_h;
+    const struct hw_plane *plane;       // NULL if no plane took the cursor
+    struct fb_pool *fbs;
+    struct fb_pool_entry *buffers[2];
+    int front;                  // buffer on screen, -1 before the first image
+    uint32_t width;             // buffer size (DRM_CAP_CURSOR_WIDTH / HEIGHT)
+    uint32_t height;
+
+    int32_t x;                  // pointer position (the hotspot)
+    int32_t y;
+    int32_t hot_x;
+    int32_t hot_y;
+    uint64_t image_hash;        // pixels and hotspot of the image on screen
+
+    // What the display has now, so a move only sends what changed
+    int32_t shown_x;
+    int32_t shown_y;
+    int flip_pending;
+    int dirty;                  // position changed while a commit was in flight
+
+    // Counters
+    unsigned int moves;         // cursor_move() calls
+    unsigned int commits;
+    unsigned int coalesced;     // moves folded into a later commit
+    unsigned int images;        // images written and swapped in
+    unsigned int unchanged;     // cursor_set_image() calls skipped, same image
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Pick a plane for the cursor on planes' CRTC, skipping the planes layers
+// already use, and allocate the two buffers from fbs. Candidates are probed
+// with a TEST_ONLY commit. Returns 0, or -1 if no plane takes it (the
+// caller then has to draw the pointer into its own frames).
+// The DRM fd is shared, so the cursor reads flip events through evctx, the
+// caller's context: its page_flip_handler2 has to hand the events whose
+// user_data is the cursor to cursor_flip_handler().
+int cursor_init(struct cursor *cursor, const struct plane_alloc *planes, const struct plane_layer *layers,
+                int count, struct fb_pool *fbs, drmEventContext *evctx, uint32_t crtc_w, uint32_t crtc_h);
+
+// Show a width x height ARGB8888 image (pitch in bytes) with its hotspot.
+// Nothing is written or committed if it is the image already on screen.
+int cursor_set_image(struct cursor *cursor, const uint32_t *argb, uint32_t width, uint32_t height,
+                     uint32_t pitch, int32_t hot_x, int32_t hot_y);
+
+// Put the hotspot at (x, y). Commits right away, or when the commit in
+// flight completes (see cursor_dispatch()).
+int cursor_move(struct cursor *cursor, int32_t x, int32_t y);
+
+// Read pending DRM events through the caller's context without blocking
+// and commit a coalesced move
+int cursor_dispatch(struct cursor *cursor);
+
+// Block until no commit is in flight and no move is left to send
+int cursor_wait(struct cursor *cursor, int timeout_ms);
+
+// Page-flip handler for drmEventContext.page_flip_handler2; user_data is the
+// cursor
+void cursor_flip_handler(int fd, unsigned int sequence, unsigned int tv_sec, unsigned int tv_usec,
+                         unsigned int crtc_id, void *user_data);
+
+// Switch the plane off and give the buffers back to the pool
+void cursor_destroy(struct cursor *cursor);
+
+void cursor_print_stats(const struct cursor *cursor);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CURSOR_H
@@ -0,0 +1,231 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <linux/dma-buf.h>
+#include <linux/udmabuf.h>
+
+#include <drm_fourcc.h>
+
+#include "dmabuf_import.h"
+
+void dmabuf_cache_init(struct dmabuf_cache *cache, int drm_fd) {
+    memset(cache, 0, sizeof(*cache));
+    cache->drm_fd = drm_fd;
+}
+
+// Remove an FB that may still be on screen without switching its plane off
+static void drop_fb(struct dmabuf_cache *cache, uint32_t fb_id) {
+#ifdef DRM_IOCTL_MODE_CLOSEFB
+    struct drm_mode_closefb close_fb = {.fb_id = fb_id};
+    if (drmIoctl(cache->drm_fd, DRM_IOCTL_MODE_CLOSEFB, &close_fb) == 0)
+        return;
+#endif
+    if (cache->retired_count == DMABUF_IMPORT_MAX)
+        dmabuf_cache_flipped(cache);
+    cache->retired[cache->retired_count++] = fb_id;
+}
+
+static void release_import(struct dmabuf_cache *cache, struct dmabuf_import *entry) {
+    if (entry->fb_id)
+        drop_fb(cache, entry->fb_id);
+
+    struct drm_gem_close close_req = {.handle = entry->handle};
+    if (drmIoctl(cache->drm_fd, DRM_IOCTL_GEM_CLOSE, &close_req) < 0)
+        perror("DRM_IOCTL_GEM_CLOSE failed");
+    memset(entry, 0, sizeof(*entry));
+}
+
+static int add_fb(struct dmabuf_cache *cache, struct dmabuf_import *entry) {
+    uint32_t handles[4] = {entry->handle};
+    uint32_t strides[4] = {entry->stride};
+    uint32_t offsets[4] = {entry->offset};
+    int ret;
+
+    if (entry->modifier != DRM_FORMAT_MOD_INVALID) {
+        uint64_t modifiers[4] = {entry->modifier};
+        ret = drmModeAddFB2WithModifiers(cache->drm_fd, entry->width, entry->height, entry->fourcc, handles,
+                                         strides, offsets, modifiers, &entry->fb_id, DRM_MODE_FB_MODIFIERS);
+    } else {
+        ret = drmModeAddFB2(cache->drm_fd, entry->width, entry->height, entry->fourcc, handles, strides, offsets,
+                            &entry->fb_id, 0);
+    }
+    if (ret != 0) {
+        perror("drmModeAddFB2 (dma-buf import) failed");
+        entry->fb_id = 0;
+        return -1;
+    }
+    return 0;
+}
+
+uint32_t dmabuf_import_fb(struct dmabuf_cache *cache, int dmabuf_fd, uint32_t width, uint32_t height,
+                          uint32_t fourcc, uint32_t stride, uint32_t offset, uint64_t modifier) {
+    struct stat st;
+    if (fstat(dmabuf_fd, &st) < 0) {
+        perror("fstat on dma-buf failed");
+        return 0;
+    }
+
+    // One pass finds the import and the slot to reuse if there is none:
+    // a free slot, else the least recently used import
+    struct dmabuf_import *entry = NULL;
+    struct dmabuf_import *victim = NULL;
+    for (int i = 0; i < DMABUF_IMPORT_MAX; i++) {
+        struct dmabuf_import *e = &cache->entries[i];
+        if (e->handle && e->dev == st.st_dev && e->ino == st.st_ino) {
+            entry = e;
+            break;
+        }
+        if (!e->handle) {
+            if (!victim || victim->handle)
+                victim = e;
+        } else if (!victim || (victim->handle && e->last_use < victim->last_use)) {
+            victim = e;
+        }
+    }
+
+    cache->clock++;
+    if (entry && entry->width == width && entry->height == height && entry->fourcc == fourcc &&
+        entry->stride == stride && entry->offset == offset && entry->modifier == modifier) {
+        entry->last_use = cache->clock;
+        cache->hits++;
+        return entry->fb_id;
+    }
+
+    if (entry) {
+        // Same buffer, new layout: keep the handle, replace the FB
+        drop_fb(cache, entry->fb_id);
+        entry->fb_id = 0;
+    } else {
+        entry = victim;
+        if (entry->handle) {
+            release_import(cache, entry);
+            cache->evicted++;
+        }
+        if (drmPrimeFDToHandle(cache->drm_fd, dmabuf_fd, &entry->handle) != 0) {
+            perror("drmPrimeFDToHandle failed");
+            entry->handle = 0;
+            return 0;
+        }
+        entry->dev = st.st_dev;
+        entry->ino = st.st_ino;
+    }
+
+    entry->width = width;
+    entry->height = height;
+    entry->fourcc = fourcc;
+    entry->stride = stride;
+    entry->offset = offset;
+    entry->modifier = modifier;
+    if (add_fb(cache, entry) != 0) {
+        release_import(cache, entry);
+        return 0;
+    }
+    entry->last_use = cache->clock;
+    cache->imported++;
+
+    printf("[DMABUF]   : inode %lu -> FB %u (%ux%u, %.4s)\n", (unsigned long)st.st_ino, entry->fb_id, width, height,
+           (const char *)&fourcc);
+    return entry->fb_id;
+}
+
+void dmabuf_import_forget(struct dmabuf_cache *cache, int dmabuf_fd) {
+    struct stat st;
+    if (fstat(dmabuf_fd, &st) < 0)
+        return;
+
+    for (int i = 0; i < DMABUF_IMPORT_MAX; i++) {
+        struct dmabuf_import *entry = &cache->entries[i];
+        if (entry->handle && entry->dev == st.st_dev && entry->ino == st.st_ino) {
+            release_import(cache, entry);
+            return;
+        }
+    }
+}
+
+void dmabuf_cache_flipped(struct dmabuf_cache *cache) {
+    for (int i = 0; i < cache->retired_count; i++)
+        drmModeRmFB(cache->drm_fd, cache->retired[i]);
+    cache->retired_count = 0;
+}
+
+void dmabuf_cache_destroy(struct dmabuf_cache *cache) {
+    for (int i = 0; i < DMABUF_IMPORT_MAX; i++) {
+        if (cache->entries[i].handle)
+            release_import(cache, &cache->entries[i]);
+    }
+    dmabuf_cache_flipped(cache);
+}
+
+void dmabuf_cache_print_stats(const struct dmabuf_cache *cache) {
+    printf("[DMABUF]   : %u imported, %u cache hits (re-imports avoided), %u evicted\n",
+           cache->imported, cache->hits, cache->evicted);
+}
+
+int udmabuf_create(size_t size, void **map, size_t *map_size) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size = (size + page - 1) & ~(page - 1);
+
+    int memfd = memfd_create("udmabuf", MFD_ALLOW_SEALING | MFD_CLOEXEC);
+    if (memfd < 0) {
+        perror("memfd_create failed");
+        return -1;
+    }
+
+    // udmabuf requires the memfd to be sealed against shrinking
+    if (ftruncate(memfd, (off_t)size) < 0 || fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK) < 0) {
+        perror("Failed to size and seal memfd");
+        close(memfd);
+        return -1;
+    }
+
+    int dev = open("/dev/udmabuf", O_RDWR | O_CLOEXEC);
+    if (dev < 0) {
+        perror("Failed to open /dev/udmabuf");
+        close(memfd);
+        return -1;
+    }
+
+    struct udmabuf_create create = {
+        .memfd = (uint32_t)memfd,
+        .flags = UDMABUF_FLAGS_CLOEXEC,
+        .offset = 0,
+        .size = size,
+    };
+    int dmabuf_fd = ioctl(dev, UDMABUF_CREATE, &create);
+    close(dev);
+    if (dmabuf_fd < 0) {
+        perror("UDMABUF_CREATE failed");
+        close(memfd);
+        return -1;
+    }
+
+    // The dma-buf keeps the pages alive; the memfd is only needed for the mapping
+    void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    close(memfd);
+    if (data == MAP_FAILED) {
+        perror("Failed to map udmabuf memory");
+        close(dmabuf_fd);
+        return -1;
+    }
+
+    *map = data;
+    *map_size = size;
+    return dmabuf_fd;
+}
+
+int dmabuf_cpu_access(int dmabuf_fd, int begin) {
+    struct dma_buf_sync sync = {
+        .flags = (begin ? DMA_BUF_SYNC_START : DMA_BUF_SYNC_END) | DMA_BUF_SYNC_WRITE,
+    };
+    if (ioctl(dmabuf_fd, DMA_BUF_IOCTL_SYNC, &sync) < 0) {
+        perror("DMA_BUF_IOCTL_SYNC failed");
+        return -1;
+    }
+    return 0;
+}
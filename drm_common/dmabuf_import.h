@@ -0,0 +1,92 @@
+#ifndef DMABUF_IMPORT_H
+#define DMABUF_IMPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#define DMABUF_IMPORT_MAX 32
+
+// Zero-copy scanout of buffers from other producers (camera, decoder,
+// another process). A dma-buf is imported with drmPrimeFDToHandle and
+// wrapped in an FB once; the import is cached by the dma-buf's inode, so a
+// producer cycling through the same buffers never pays for a re-import.
+// The cached GEM handle keeps the buffer (and so its inode number) alive
+// until the entry is evicted.
+//
+// Only for buffers the process has no GEM handle of its own for: importing
+// e.g. an own gbm_bo returns that bo's handle, which eviction would close.
+//
+// A dropped FB (eviction, new layout) may still be on screen. It is closed
+// with DRM_IOCTL_MODE_CLOSEFB, which leaves planes showing it alone; on
+// kernels without it the RMFB, which would switch such a plane off, waits
+// for dmabuf_cache_flipped().
+struct dmabuf_import {
+    dev_t dev;                  // identity of the dma-buf (fstat)
+    ino_t ino;
+    uint32_t width;
+    uint32_t height;
+    uint32_t fourcc;
+    uint32_t stride;
+    uint32_t offset;
+    uint64_t modifier;
+    uint32_t handle;            // GEM handle, 0 if the slot is free
+    uint32_t fb_id;
+    uint64_t last_use;          // LRU stamp
+};
+
+struct dmabuf_cache {
+    int drm_fd;
+    struct dmabuf_import entries[DMABUF_IMPORT_MAX];
+    uint64_t clock;
+    uint32_t retired[DMABUF_IMPORT_MAX];        // dropped FBs waiting for the next flip
+    int retired_count;
+
+    // Counters
+    unsigned int imported;      // drmPrimeFDToHandle + AddFB2 round trips
+    unsigned int hits;          // lookups served from the cache
+    unsigned int evicted;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void dmabuf_cache_init(struct dmabuf_cache *cache, int drm_fd);
+
+// FB ID for a single-plane dma-buf with this layout, importing it on first
+// use. modifier is DRM_FORMAT_MOD_INVALID for an implicit layout.
+// Returns 0 on failure. The caller keeps ownership of dmabuf_fd.
+uint32_t dmabuf_import_fb(struct dmabuf_cache *cache, int dmabuf_fd, uint32_t width, uint32_t height,
+                          uint32_t fourcc, uint32_t stride, uint32_t offset, uint64_t modifier);
+
+// Drop the import of dmabuf_fd (e.g. the producer is freeing the buffer)
+void dmabuf_import_forget(struct dmabuf_cache *cache, int dmabuf_fd);
+
+// Call when a commit made after the last dmabuf_import_fb() has completed:
+// FBs dropped before it are off screen now and can be removed
+void dmabuf_cache_flipped(struct dmabuf_cache *cache);
+
+// Remove every FB and GEM handle
+void dmabuf_cache_destroy(struct dmabuf_cache *cache);
+
+void dmabuf_cache_print_stats(const struct dmabuf_cache *cache);
+
+// Local test producer: a dma-buf over a sealed memfd via /dev/udmabuf, so
+// the import path can be exercised without a camera or decoder. size is
+// rounded up to the page size; *map receives a CPU mapping of the memory.
+// Returns the dma-buf fd, or -1 (e.g. no udmabuf driver).
+int udmabuf_create(size_t size, void **map, size_t *map_size);
+
+// Bracket CPU writes to a udmabuf (or any dma-buf) mapping so caches are
+// flushed before the display reads it
+int dmabuf_cpu_access(int dmabuf_fd, int begin);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DMABUF_IMPORT_H
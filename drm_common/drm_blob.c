@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "drm_blob.h"
+
+void drm_blob_cache_init(struct drm_blob_cache *cache, int drm_fd) {
+    memset(cache, 0, sizeof(*cache));
+    cache->drm_fd = drm_fd;
+}
+
+uint32_t drm_mode_blob_get(struct drm_blob_cache *cache, const drmModeModeInfo *mode) {
+    struct drm_mode_blob_entry *free_entry = NULL;
+
+    for (int i = 0; i < DRM_BLOB_CACHE_SIZE; i++) {
+        struct drm_mode_blob_entry *entry = &cache->entries[i];
+        if (!entry->blob_id) {
+            if (!free_entry)
+                free_entry = entry;
+            continue;
+        }
+
+        if (memcmp(&entry->mode, mode, sizeof(*mode)) == 0) {
+            entry->refs++;
+            cache->reused++;
+            return entry->blob_id;
+        }
+    }
+
+    if (!free_entry) {
+        fprintf(stderr, "MODE_ID blob cache full (%d entries)\n", DRM_BLOB_CACHE_SIZE);
+        return 0;
+    }
+
+    uint32_t blob_id = 0;
+    if (drmModeCreatePropertyBlob(cache->drm_fd, mode, sizeof(*mode), &blob_id) != 0) {
+        perror("drmModeCreatePropertyBlob failed");
+        return 0;
+    }
+
+    free_entry->mode = *mode;
+    free_entry->blob_id = blob_id;
+    free_entry->refs = 1;
+    cache->created++;
+    return blob_id;
+}
+
+void drm_mode_blob_put(struct drm_blob_cache *cache, uint32_t blob_id) {
+    for (int i = 0; i < DRM_BLOB_CACHE_SIZE; i++) {
+        struct drm_mode_blob_entry *entry = &cache->entries[i];
+        if (entry->blob_id != blob_id)
+            continue;
+
+        if (--entry->refs == 0) {
+            // The kernel keeps its own reference while the blob is part of the
+            // committed CRTC state, so destroying our handle here is safe.
+            drmModeDestroyPropertyBlob(cache->drm_fd, entry->blob_id);
+            memset(entry, 0, sizeof(*entry));
+        }
+        return;
+    }
+}
+
+void drm_blob_cache_destroy(struct drm_blob_cache *cache) {
+    for (int i = 0; i < DRM_BLOB_CACHE_SIZE; i++) {
+        struct drm_mode_blob_entry *entry = &cache->entries[i];
+        if (entry->blob_id)
+            drmModeDestroyPropertyBlob(cache->drm_fd, entry->blob_id);
+        memset(entry, 0, sizeof(*entry));
+    }
+}
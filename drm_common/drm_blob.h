@@ -0,0 +1,46 @@
+#ifndef DRM_BLOB_H
+#define DRM_BLOB_H
+
+#include <stdint.h>
+
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#define DRM_BLOB_CACHE_SIZE 8
+
+// MODE_ID blob manager. A mode that is already resident is handed out again
+// instead of creating a new kernel blob; the blob is destroyed once its last
+// user releases it, so long-running programs do not leak kernel blob memory.
+struct drm_mode_blob_entry {
+    drmModeModeInfo mode;
+    uint32_t blob_id;
+    int refs;
+};
+
+struct drm_blob_cache {
+    int drm_fd;
+    struct drm_mode_blob_entry entries[DRM_BLOB_CACHE_SIZE];
+    int created;    // blobs created over the cache's lifetime
+    int reused;     // requests served without creating a blob
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void drm_blob_cache_init(struct drm_blob_cache *cache, int drm_fd);
+
+// Get a MODE_ID blob for mode (takes a reference). Returns 0 on failure.
+uint32_t drm_mode_blob_get(struct drm_blob_cache *cache, const drmModeModeInfo *mode);
+
+// Drop a reference taken by drm_mode_blob_get(); destroys the blob at zero.
+void drm_mode_blob_put(struct drm_blob_cache *cache, uint32_t blob_id);
+
+// Destroy every blob still held by the cache
+void drm_blob_cache_destroy(struct drm_blob_cache *cache);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DRM_BLOB_H
@@ -0,0 +1,238 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <xf86drmMode.h>
+
+#include "drm_device.h"
+#include "frame_stats.h"
+
+#define DRM_DEVICE_MAX 16
+
+#define DRM_DIR "/dev/dri/"
+
+// Only in XDG_RUNTIME_DIR: a predictable name in /tmp could be planted by
+// any local user and would be opened as the KMS device by root under sudo
+static int cache_path(char *path, size_t size) {
+    const char *dir = getenv("XDG_RUNTIME_DIR");
+    if (!dir || !*dir)
+        return -1;
+    int len = snprintf(path, size, "%s/drm-device", dir);
+    return len > 0 && (size_t)len < size ? 0 : -1;
+}
+
+// Connected connectors as last detected, no probe
+static int count_connected(int drm_fd, const drmModeRes *res) {
+    int connected = 0;
+    for (int i = 0; i < res->count_connectors; i++) {
+        drmModeConnector *conn = drmModeGetConnectorCurrent(drm_fd, res->connectors[i]);
+        connected += conn && conn->connection == DRM_MODE_CONNECTED;
+        drmModeFreeConnector(conn);
+    }
+    return connected;
+}
+
+// Open path if it is an atomic KMS device. Returns the fd with the client
+// caps set and *connected filled in, -1 otherwise.
+static int open_kms(const char *path, int *connected) {
+    int drm_fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (drm_fd < 0)
+        return -1;
+
+    if (drmSetClientCap(drm_fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1) != 0 ||
+        drmSetClientCap(drm_fd, DRM_CLIENT_CAP_ATOMIC, 1) != 0) {
+        close(drm_fd);
+        return -1;
+    }
+
+    drmModeRes *res = drmModeGetResources(drm_fd);
+    if (!res || res->count_crtcs == 0 || res->count_connectors == 0) {
+        drmModeFreeResources(res);
+        close(drm_fd);
+        return -1;
+    }
+    *connected = count_connected(drm_fd, res);
+    drmModeFreeResources(res);
+    return drm_fd;
+}
+
+// Render node of the device behind drm_fd, "" if it has none
+static void find_render_node(int drm_fd, char *render, size_t size) {
+    drmDevicePtr dev = NULL;
+
+    render[0] = '\0';
+    if (drmGetDevice2(drm_fd, 0, &dev) != 0)
+        return;
+    if (dev->available_nodes & (1 << DRM_NODE_RENDER))
+        snprintf(render, size, "%s", dev->nodes[DRM_NODE_RENDER]);
+    drmFreeDevice(&dev);
+}
+
+// "<primary> <render or -> <connected> <st_rdev>"
+static int save_choice(const struct drm_device_info *info, int drm_fd) {
+    char path[4096], tmp[4200];
+    struct stat st;
+
+    if (cache_path(path, sizeof(path)) != 0 || fstat(drm_fd, &st) != 0)
+        return -1;
+    snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+
+    // New 0600 file created exclusively, never through a symlink
+    int fd = mkstemp(tmp);
+    FILE *f = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (!f) {
+        if (fd >= 0) {
+            close(fd);
+            unlink(tmp);
+        }
+        return -1;
+    }
+    int ok = fprintf(f, "%s %s %d %llu\n", info->primary, info->render[0] ? info->render : "-",
+                     info->connected, (unsigned long long)st.st_rdev) > 0;
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+static int is_drm_node(const char *path) {
+    return strncmp(path, DRM_DIR, strlen(DRM_DIR)) == 0 && !strstr(path, "..");
+}
+
+// The saved choice, only if it is a regular file of ours that nobody else
+// can write
+static FILE *open_choice(const char *path) {
+    struct stat st;
+
+    int fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_uid != geteuid() ||
+        (st.st_mode & 0777) != 0600) {
+        close(fd);
+        return NULL;
+    }
+
+    FILE *f = fdopen(fd, "r");
+    if (!f)
+        close(fd);
+    return f;
+}
+
+// Reopen the saved choice. Card numbers follow probe order and can change
+// across boots, so the node must still be the same device number.
+static int open_cached(struct drm_device_info *info) {
+    char path[4096], render[DRM_DEVICE_PATH_MAX];
+    unsigned long long rdev;
+    int saved_connected;
+    struct stat st;
+
+    if (cache_path(path, sizeof(path)) != 0)
+        return -1;
+    FILE *f = open_choice(path);
+    if (!f)
+        return -1;
+    int fields = fscanf(f, "%63s %63s %d %llu", info->primary, render, &saved_connected, &rdev);
+    fclose(f);
+    if (fields != 4)
+        return -1;
+
+    // Nothing but DRM nodes is ever opened from here
+    if (!is_drm_node(info->primary) || (strcmp(render, "-") && !is_drm_node(render)))
+        return -1;
+
+    int drm_fd = open_kms(info->primary, &info->connected);
+    if (drm_fd < 0)
+        return -1;
+    // A display moved to another card since: rank the candidates again
+    if (fstat(drm_fd, &st) != 0 || st.st_rdev != (dev_t)rdev ||
+        (saved_connected > 0 && info->connected == 0)) {
+        close(drm_fd);
+        return -1;
+    }
+    snprintf(info->render, sizeof(info->render), "%s", strcmp(render, "-") ? render : "");
+    return drm_fd;
+}
+
+// Open every atomic KMS primary node and keep the one with the most
+// connected outputs
+static int open_best(struct drm_device_info *info, int *candidates) {
+    drmDevicePtr devices[DRM_DEVICE_MAX];
+    int best_fd = -1;
+
+    *candidates = 0;
+    int count = drmGetDevices2(0, devices, DRM_DEVICE_MAX);
+    if (count <= 0) {
+        fprintf(stderr, "No DRM devices found\n");
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        drmDevicePtr dev = devices[i];
+        int connected;
+
+        if (!(dev->available_nodes & (1 << DRM_NODE_PRIMARY)))
+            continue;
+        int drm_fd = open_kms(dev->nodes[DRM_NODE_PRIMARY], &connected);
+        if (drm_fd < 0)
+            continue;
+        (*candidates)++;
+
+        if (best_fd >= 0 && connected <= info->connected) {
+            close(drm_fd);
+            continue;
+        }
+        if (best_fd >= 0)
+            close(best_fd);
+        best_fd = drm_fd;
+        info->connected = connected;
+        snprintf(info->primary, sizeof(info->primary), "%s", dev->nodes[DRM_NODE_PRIMARY]);
+        snprintf(info->render, sizeof(info->render), "%s",
+                 dev->available_nodes & (1 << DRM_NODE_RENDER) ? dev->nodes[DRM_NODE_RENDER] : "");
+    }
+    drmFreeDevices(devices, count);
+    return best_fd;
+}
+
+int drm_device_open(struct drm_device_info *info) {
+    const char *env = getenv("DRM_DEVICE");
+    const char *source;
+    char scanned[32];
+    int candidates;
+
+    memset(info, 0, sizeof(*info));
+    double start = now_ms();
+
+    int drm_fd;
+    if (env && *env) {
+        drm_fd = open_kms(env, &info->connected);
+        if (drm_fd < 0) {
+            fprintf(stderr, "DRM_DEVICE=%s is not an atomic KMS device\n", env);
+            return -1;
+        }
+        snprintf(info->primary, sizeof(info->primary), "%s", env);
+        find_render_node(drm_fd, info->render, sizeof(info->render));
+        source = "from DRM_DEVICE";
+    } else if ((drm_fd = open_cached(info)) >= 0) {
+        source = "cached";
+    } else {
+        memset(info, 0, sizeof(*info));
+        drm_fd = open_best(info, &candidates);
+        if (drm_fd < 0) {
+            fprintf(stderr, "No atomic KMS device found\n");
+            return -1;
+        }
+        save_choice(info, drm_fd);
+        snprintf(scanned, sizeof(scanned), "best of %d", candidates);
+        source = scanned;
+    }
+
+    printf("[DEVICE]   : %s, render node %s, %d connected (%s, %.3f ms)\n", info->primary,
+           info->render[0] ? info->render : "none", info->connected, source, now_ms() - start);
+    return drm_fd;
+}
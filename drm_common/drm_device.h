@@ -0,0 +1,40 @@
+#ifndef DRM_DEVICE_H
+#define DRM_DEVICE_H
+
+#include <xf86drm.h>
+
+#define DRM_DEVICE_PATH_MAX 64
+
+// Which card to drive, instead of assuming /dev/dri/card1. Candidates are
+// the primary nodes drmGetDevices2() lists that accept the atomic client
+// cap and have CRTCs and connectors. The one with the most connected
+// outputs wins (status as last detected, nothing is probed); ties go to
+// the first one listed. GL should render on the winner's render node, so
+// frames never have to cross devices on their way to the screen.
+//
+// The choice is saved to $XDG_RUNTIME_DIR/drm-device, next to the topology
+// snapshots (nothing is saved without XDG_RUNTIME_DIR). A later launch
+// reopens that card directly and only checks it is still the same device
+// node, still atomic KMS, and still has a connected output if it had one;
+// the other candidates are not opened. The file is ignored unless it is
+// ours, mode 0600 and names nodes under /dev/dri. DRM_DEVICE=/dev/dri/cardN in the environment overrides both.
+struct drm_device_info {
+    char primary[DRM_DEVICE_PATH_MAX];  // /dev/dri/cardN
+    char render[DRM_DEVICE_PATH_MAX];   // /dev/dri/renderDN, "" if the device has none
+    int connected;                      // connected connectors when opened
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Open the KMS device to use (O_RDWR | O_NONBLOCK) with the universal
+// planes and atomic client caps already set, and describe it in info.
+// Returns the fd, -1 if no device qualifies.
+int drm_device_open(struct drm_device_info *info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DRM_DEVICE_H
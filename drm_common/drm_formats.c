@@ -0,0 +1,147 @@
+#include <stdio.h>
+
+#include <drm_fourcc.h>
+
+#include "drm_formats.h"
+
+// Alpha formats and the X format with the same memory layout: a buffer of
+// the first can be scanned out as the second, the alpha byte is ignored
+static const uint32_t alpha_twins[][2] = {
+    { DRM_FORMAT_ARGB8888, DRM_FORMAT_XRGB8888 },
+    { DRM_FORMAT_ABGR8888, DRM_FORMAT_XBGR8888 },
+    { DRM_FORMAT_RGBA8888, DRM_FORMAT_RGBX8888 },
+    { DRM_FORMAT_BGRA8888, DRM_FORMAT_BGRX8888 },
+    { DRM_FORMAT_ARGB2101010, DRM_FORMAT_XRGB2101010 },
+    { DRM_FORMAT_ABGR2101010, DRM_FORMAT_XBGR2101010 },
+};
+
+// CPU conversions this tree has, with the bytes they write per pixel
+static const struct {
+    uint32_t src;
+    uint32_t dst;
+    enum format_conversion conversion;
+    uint32_t bpp;
+} conversions[] = {
+    // GL_RGBA bytes (ABGR8888) -> XRGB8888, convert_rgba_to_xrgb8888()
+    { DRM_FORMAT_ABGR8888, DRM_FORMAT_XRGB8888, FORMAT_CONV_SWIZZLE, 4 },
+    { DRM_FORMAT_XBGR8888, DRM_FORMAT_XRGB8888, FORMAT_CONV_SWIZZLE, 4 },
+};
+
+static int has_format(const uint32_t *formats, int count, uint32_t fourcc) {
+    for (int i = 0; i < count; i++) {
+        if (formats[i] == fourcc)
+            return 1;
+    }
+    return 0;
+}
+
+// dst shows a buffer written as src without touching it
+static int same_layout(uint32_t src, uint32_t dst) {
+    if (src == dst)
+        return 1;
+    for (size_t i = 0; i < sizeof(alpha_twins) / sizeof(alpha_twins[0]); i++) {
+        if (alpha_twins[i][0] == src && alpha_twins[i][1] == dst)
+            return 1;
+    }
+    return 0;
+}
+
+int format_negotiate(uint32_t native, const uint32_t *plane_formats, int count, struct format_choice *choice) {
+    choice->native = native;
+    choice->converted_bpp = 0;
+    choice->conversion = FORMAT_CONV_NONE;
+
+    // Anything but an XRGB8888 layout needed a 4 byte/pixel pass before
+    choice->baseline_bpp = same_layout(native, DRM_FORMAT_XRGB8888) ? 0 : 4;
+
+    // Exact match first, then the X twin of an alpha format
+    if (has_format(plane_formats, count, native)) {
+        choice->fourcc = native;
+        return 0;
+    }
+    for (int i = 0; i < count; i++) {
+        if (same_layout(native, plane_formats[i])) {
+            choice->fourcc = plane_formats[i];
+            return 0;
+        }
+    }
+
+    int best = -1;
+    for (size_t i = 0; i < sizeof(conversions) / sizeof(conversions[0]); i++) {
+        if (conversions[i].src != native || !has_format(plane_formats, count, conversions[i].dst))
+            continue;
+        if (best < 0 || conversions[i].bpp < conversions[best].bpp)
+            best = (int)i;
+    }
+    if (best < 0) {
+        fprintf(stderr, "No scanout format for %.4s on this plane\n", (const char *)&native);
+        return -1;
+    }
+    choice->fourcc = conversions[best].dst;
+    choice->conversion = conversions[best].conversion;
+    choice->converted_bpp = conversions[best].bpp;
+    return 0;
+}
+
+uint64_t format_bytes_avoided(const struct format_choice *choice, uint32_t width, uint32_t height) {
+    if (choice->converted_bpp >= choice->baseline_bpp)
+        return 0;
+    return (uint64_t)(choice->baseline_bpp - choice->converted_bpp) * width * height;
+}
+
+const char *format_conversion_name(enum format_conversion conversion) {
+    switch (conversion) {
+    case FORMAT_CONV_NONE:
+        return "no conversion";
+    case FORMAT_CONV_SWIZZLE:
+        return "channel swizzle";
+    default:
+        return "unknown";
+    }
+}
+
+int plane_format_modifiers(int drm_fd, const struct drm_object_props *plane_props, uint32_t fourcc,
+                           uint64_t *modifiers, int max) {
+    if (!drm_prop_id(plane_props, DRM_PROP_PLANE_IN_FORMATS))
+        return 0;
+
+    uint32_t blob_id = (uint32_t)plane_props->values[DRM_PROP_PLANE_IN_FORMATS];
+    drmModePropertyBlobPtr blob = drmModeGetPropertyBlob(drm_fd, blob_id);
+    if (!blob) {
+        perror("drmModeGetPropertyBlob (IN_FORMATS) failed");
+        return -1;
+    }
+
+    // Layout: header, formats[count_formats], modifiers[count_modifiers]. Each
+    // modifier entry carries a 64-bit mask of the formats it applies to,
+    // starting at formats[offset].
+    const struct drm_format_modifier_blob *hdr = blob->data;
+    const uint8_t *base = blob->data;
+    if (blob->length < sizeof(*hdr) ||
+        hdr->formats_offset + (uint64_t)hdr->count_formats * sizeof(uint32_t) > blob->length ||
+        hdr->modifiers_offset + (uint64_t)hdr->count_modifiers * sizeof(struct drm_format_modifier) > blob->length) {
+        fprintf(stderr, "Plane %u: malformed IN_FORMATS blob\n", plane_props->obj_id);
+        drmModeFreePropertyBlob(blob);
+        return -1;
+    }
+
+    const uint32_t *formats = (const uint32_t *)(base + hdr->formats_offset);
+    const struct drm_format_modifier *mods = (const struct drm_format_modifier *)(base + hdr->modifiers_offset);
+
+    int count = 0;
+    for (uint32_t f = 0; f < hdr->count_formats; f++) {
+        if (formats[f] != fourcc)
+            continue;
+
+        for (uint32_t m = 0; m < hdr->count_modifiers && count < max; m++) {
+            if (f < mods[m].offset || f >= mods[m].offset + 64)
+                continue;
+            if (mods[m].formats & (1ULL << (f - mods[m].offset)))
+                modifiers[count++] = mods[m].modifier;
+        }
+        break;
+    }
+
+    drmModeFreePropertyBlob(blob);
+    return count;
+}
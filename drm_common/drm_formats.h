@@ -0,0 +1,54 @@
+#ifndef DRM_FORMATS_H
+#define DRM_FORMATS_H
+
+#include <stdint.h>
+
+#include "drm_props.h"
+
+#define DRM_FORMATS_MAX_MODIFIERS 64
+
+// What it takes to get a producer's pixels into a scanout format
+enum format_conversion {
+    FORMAT_CONV_NONE,           // same memory layout: scanned out as produced
+    FORMAT_CONV_SWIZZLE,        // channels reordered by a CPU pass (pixel_convert.c)
+};
+
+// Outcome of format_negotiate(). Conversion cost is counted in bytes a CPU
+// pass writes per pixel; baseline_bpp is what converting to XRGB8888, the
+// format every example used before, would write.
+struct format_choice {
+    uint32_t native;            // what the producer writes
+    uint32_t fourcc;            // scanout format picked
+    enum format_conversion conversion;
+    uint32_t converted_bpp;
+    uint32_t baseline_bpp;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Format modifiers (tiling / compression layouts) a plane can scan out for
+// fourcc, read from the plane's IN_FORMATS blob. Call once at startup.
+// Returns the number written to modifiers, 0 if the driver exposes no
+// IN_FORMATS (implicit modifiers only) or does not list fourcc, -1 on error.
+int plane_format_modifiers(int drm_fd, const struct drm_object_props *plane_props, uint32_t fourcc,
+                           uint64_t *modifiers, int max);
+
+// Pick the scanout format for a producer that writes native, out of the
+// formats a plane lists (drmModePlane::formats or the IN_FORMATS blob): the
+// same layout if the plane has it (an alpha format may be scanned out as
+// its X twin), otherwise the cheapest conversion this tree implements.
+// Returns 0, or -1 if there is no pairing.
+int format_negotiate(uint32_t native, const uint32_t *plane_formats, int count, struct format_choice *choice);
+
+// Bytes of conversion output per frame the choice saves over XRGB8888
+uint64_t format_bytes_avoided(const struct format_choice *choice, uint32_t width, uint32_t height);
+
+const char *format_conversion_name(enum format_conversion conversion);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DRM_FORMATS_H
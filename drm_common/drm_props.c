@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "drm_props.h"
+
+// Kernel name and owning object type of every registry entry
+static const struct {
+    uint32_t obj_type;
+    const char *name;
+} prop_table[DRM_PROP_COUNT] = {
+    [DRM_PROP_PLANE_TYPE]        = { DRM_MODE_OBJECT_PLANE,     "type" },
+    [DRM_PROP_PLANE_FB_ID]       = { DRM_MODE_OBJECT_PLANE,     "FB_ID" },
+    [DRM_PROP_PLANE_CRTC_ID]     = { DRM_MODE_OBJECT_PLANE,     "CRTC_ID" },
+    [DRM_PROP_PLANE_SRC_X]       = { DRM_MODE_OBJECT_PLANE,     "SRC_X" },
+    [DRM_PROP_PLANE_SRC_Y]       = { DRM_MODE_OBJECT_PLANE,     "SRC_Y" },
+    [DRM_PROP_PLANE_SRC_W]       = { DRM_MODE_OBJECT_PLANE,     "SRC_W" },
+    [DRM_PROP_PLANE_SRC_H]       = { DRM_MODE_OBJECT_PLANE,     "SRC_H" },
+    [DRM_PROP_PLANE_CRTC_X]      = { DRM_MODE_OBJECT_PLANE,     "CRTC_X" },
+    [DRM_PROP_PLANE_CRTC_Y]      = { DRM_MODE_OBJECT_PLANE,     "CRTC_Y" },
+    [DRM_PROP_PLANE_CRTC_W]      = { DRM_MODE_OBJECT_PLANE,     "CRTC_W" },
+    [DRM_PROP_PLANE_CRTC_H]      = { DRM_MODE_OBJECT_PLANE,     "CRTC_H" },
+    [DRM_PROP_PLANE_IN_FENCE_FD] = { DRM_MODE_OBJECT_PLANE,     "IN_FENCE_FD" },
+    [DRM_PROP_PLANE_IN_FORMATS]  = { DRM_MODE_OBJECT_PLANE,     "IN_FORMATS" },
+    [DRM_PROP_PLANE_ZPOS]        = { DRM_MODE_OBJECT_PLANE,     "zpos" },
+    [DRM_PROP_PLANE_ALPHA]       = { DRM_MODE_OBJECT_PLANE,     "alpha" },
+    [DRM_PROP_PLANE_BLEND_MODE]  = { DRM_MODE_OBJECT_PLANE,     "pixel blend mode" },
+    [DRM_PROP_CRTC_MODE_ID]      = { DRM_MODE_OBJECT_CRTC,      "MODE_ID" },
+    [DRM_PROP_CRTC_ACTIVE]       = { DRM_MODE_OBJECT_CRTC,      "ACTIVE" },
+    [DRM_PROP_CRTC_OUT_FENCE_PTR] = { DRM_MODE_OBJECT_CRTC,     "OUT_FENCE_PTR" },
+    [DRM_PROP_CONNECTOR_CRTC_ID] = { DRM_MODE_OBJECT_CONNECTOR, "CRTC_ID" },
+};
+
+const char *drm_prop_name(enum drm_prop prop) {
+    return prop_table[prop].name;
+}
+
+// Keep what the kernel will accept for the property
+static void record_limits(struct drm_object_props *props, int p, const drmModePropertyRes *prop) {
+    props->flags[p] = prop->flags;
+
+    int range = (prop->flags & DRM_MODE_PROP_RANGE) ||
+                (prop->flags & DRM_MODE_PROP_EXTENDED_TYPE) == DRM_MODE_PROP_SIGNED_RANGE;
+    if (range && prop->count_values == 2) {
+        props->min[p] = prop->values[0];
+        props->max[p] = prop->values[1];
+    } else if (prop->flags & DRM_MODE_PROP_ENUM) {
+        for (int e = 0; e < prop->count_enums; e++) {
+            if (prop->enums[e].value < 64)
+                props->enum_mask[p] |= 1ULL << prop->enums[e].value;
+        }
+    }
+}
+
+int drm_props_init(int drm_fd, uint32_t obj_id, uint32_t obj_type, struct drm_object_props *props) {
+    memset(props, 0, sizeof(*props));
+    props->obj_id = obj_id;
+    props->obj_type = obj_type;
+
+    drmModeObjectPropertiesPtr obj_props = drmModeObjectGetProperties(drm_fd, obj_id, obj_type);
+    if (!obj_props) {
+        fprintf(stderr, "Failed to get properties of object %u\n", obj_id);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < obj_props->count_props; i++) {
+        drmModePropertyPtr prop = drmModeGetProperty(drm_fd, obj_props->props[i]);
+        if (!prop)
+            continue;
+
+        for (int p = 0; p < DRM_PROP_COUNT; p++) {
+            if (prop_table[p].obj_type == obj_type && strcmp(prop->name, prop_table[p].name) == 0) {
+                props->ids[p] = prop->prop_id;
+                props->values[p] = obj_props->prop_values[i];
+                record_limits(props, p, prop);
+                break;
+            }
+        }
+
+        drmModeFreeProperty(prop);
+    }
+
+    drmModeFreeObjectProperties(obj_props);
+    return 0;
+}
+
+int drm_prop_accepts(const struct drm_object_props *props, enum drm_prop prop, uint64_t value) {
+    uint32_t flags = props->flags[prop];
+
+    if (!props->ids[prop])
+        return 0;
+    if (flags & DRM_MODE_PROP_IMMUTABLE)
+        return value == props->values[prop];
+    if ((flags & DRM_MODE_PROP_EXTENDED_TYPE) == DRM_MODE_PROP_SIGNED_RANGE)
+        return (int64_t)value >= (int64_t)props->min[prop] && (int64_t)value <= (int64_t)props->max[prop];
+    if (flags & DRM_MODE_PROP_RANGE)
+        return value >= props->min[prop] && value <= props->max[prop];
+    if (flags & DRM_MODE_PROP_ENUM)
+        return value < 64 && (props->enum_mask[prop] & (1ULL << value));
+    return 1;
+}
+
+int drm_props_add(drmModeAtomicReq *req, const struct drm_object_props *props, enum drm_prop prop, uint64_t value) {
+    uint32_t prop_id = props->ids[prop];
+    if (!prop_id) {
+        fprintf(stderr, "Object %u has no \"%s\" property\n", props->obj_id, prop_table[prop].name);
+        return -1;
+    }
+
+    return drmModeAtomicAddProperty(req, props->obj_id, prop_id, value);
+}
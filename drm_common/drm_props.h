@@ -0,0 +1,91 @@
+#ifndef DRM_PROPS_H
+#define DRM_PROPS_H
+
+#include <stdint.h>
+
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+// Every property we program through an atomic request. The prefix names the
+// object type the property belongs to; the lookup table in drm_props.c maps
+// each entry to its kernel name.
+enum drm_prop {
+    // Plane properties
+    DRM_PROP_PLANE_TYPE,
+    DRM_PROP_PLANE_FB_ID,
+    DRM_PROP_PLANE_CRTC_ID,
+    DRM_PROP_PLANE_SRC_X,
+    DRM_PROP_PLANE_SRC_Y,
+    DRM_PROP_PLANE_SRC_W,
+    DRM_PROP_PLANE_SRC_H,
+    DRM_PROP_PLANE_CRTC_X,
+    DRM_PROP_PLANE_CRTC_Y,
+    DRM_PROP_PLANE_CRTC_W,
+    DRM_PROP_PLANE_CRTC_H,
+    DRM_PROP_PLANE_IN_FENCE_FD,
+    DRM_PROP_PLANE_IN_FORMATS,
+    DRM_PROP_PLANE_ZPOS,
+    DRM_PROP_PLANE_ALPHA,
+    DRM_PROP_PLANE_BLEND_MODE,
+
+    // CRTC properties
+    DRM_PROP_CRTC_MODE_ID,
+    DRM_PROP_CRTC_ACTIVE,
+    DRM_PROP_CRTC_OUT_FENCE_PTR,
+
+    // Connector properties
+    DRM_PROP_CONNECTOR_CRTC_ID,
+
+    DRM_PROP_COUNT
+};
+
+// Property IDs of one KMS object, resolved once at startup.
+// ids[] is 0 for properties the object does not expose (or that belong to a
+// different object type); values[] holds the value seen at registration.
+// What the kernel accepts is recorded too: flags[] (DRM_MODE_PROP_IMMUTABLE,
+// ...), the bounds of range properties and, for enum properties, a mask of
+// the enum values offered (bit v for value v).
+struct drm_object_props {
+    uint32_t obj_id;
+    uint32_t obj_type;
+    uint32_t ids[DRM_PROP_COUNT];
+    uint64_t values[DRM_PROP_COUNT];
+    uint32_t flags[DRM_PROP_COUNT];
+    uint64_t min[DRM_PROP_COUNT];
+    uint64_t max[DRM_PROP_COUNT];
+    uint64_t enum_mask[DRM_PROP_COUNT];
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Query all properties of obj_id once and fill the registry entry.
+// Costs one properties ioctl plus one ioctl per property; call at startup only.
+int drm_props_init(int drm_fd, uint32_t obj_id, uint32_t obj_type, struct drm_object_props *props);
+
+// Kernel name of a registry entry (for log messages)
+const char *drm_prop_name(enum drm_prop prop);
+
+// Typed lookup: no ioctl, no string compare
+static inline uint32_t drm_prop_id(const struct drm_object_props *props, enum drm_prop prop) {
+    return props->ids[prop];
+}
+
+static inline int drm_prop_immutable(const struct drm_object_props *props, enum drm_prop prop) {
+    return (props->flags[prop] & DRM_MODE_PROP_IMMUTABLE) != 0;
+}
+
+// Would the kernel take prop = value: the object exposes it, it is not
+// immutable (unless value is the fixed one), and value is in range / offered
+int drm_prop_accepts(const struct drm_object_props *props, enum drm_prop prop, uint64_t value);
+
+// Append obj.prop = value to an atomic request using the cached ID.
+// Returns -1 if the object does not expose the property.
+int drm_props_add(drmModeAtomicReq *req, const struct drm_object_props *props, enum drm_prop prop, uint64_t value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DRM_PROPS_H
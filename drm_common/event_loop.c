@@ -0,0 +1,182 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+
+#include "event_loop.h"
+
+int event_loop_init(struct event_loop *loop) {
+    memset(loop, 0, sizeof(*loop));
+    for (int i = 0; i < EVENT_LOOP_MAX_SOURCES; i++)
+        loop->sources[i].fd = -1;
+    loop->running = 1;
+
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epoll_fd < 0) {
+        perror("epoll_create1 failed");
+        return -1;
+    }
+    return 0;
+}
+
+void event_loop_destroy(struct event_loop *loop) {
+    for (int i = 0; i < EVENT_LOOP_MAX_SOURCES; i++) {
+        if (loop->sources[i].fd >= 0)
+            event_loop_remove(loop, &loop->sources[i]);
+    }
+
+    if (loop->epoll_fd >= 0)
+        close(loop->epoll_fd);
+    loop->epoll_fd = -1;
+}
+
+static struct event_source *add_source(struct event_loop *loop, int fd, enum event_source_type type,
+                                       uint32_t events, event_loop_cb cb, void *data) {
+    struct event_source *source = NULL;
+    for (int i = 0; i < EVENT_LOOP_MAX_SOURCES; i++) {
+        if (loop->sources[i].fd < 0) {
+            source = &loop->sources[i];
+            break;
+        }
+    }
+    if (!source) {
+        fprintf(stderr, "Event loop full (%d sources)\n", EVENT_LOOP_MAX_SOURCES);
+        return NULL;
+    }
+
+    struct epoll_event ev = { .events = events, .data.ptr = source };
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        perror("epoll_ctl(ADD) failed");
+        return NULL;
+    }
+
+    source->fd = fd;
+    source->type = type;
+    source->cb = cb;
+    source->data = data;
+    return source;
+}
+
+struct event_source *event_loop_add_fd(struct event_loop *loop, int fd, uint32_t events,
+                                       event_loop_cb cb, void *data) {
+    return add_source(loop, fd, EVENT_SOURCE_FD, events, cb, data);
+}
+
+struct event_source *event_loop_add_timer(struct event_loop *loop, int interval_ms,
+                                          event_loop_cb cb, void *data) {
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0) {
+        perror("timerfd_create failed");
+        return NULL;
+    }
+
+    struct itimerspec spec = {
+        .it_interval = { interval_ms / 1000, (interval_ms % 1000) * 1000000L },
+        .it_value = { interval_ms / 1000, (interval_ms % 1000) * 1000000L },
+    };
+    if (timerfd_settime(fd, 0, &spec, NULL) < 0) {
+        perror("timerfd_settime failed");
+        close(fd);
+        return NULL;
+    }
+
+    struct event_source *source = add_source(loop, fd, EVENT_SOURCE_TIMER, EPOLLIN, cb, data);
+    if (!source)
+        close(fd);
+    return source;
+}
+
+struct event_source *event_loop_add_signals(struct event_loop *loop, const int *signals, int count,
+                                            event_loop_cb cb, void *data) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    for (int i = 0; i < count; i++)
+        sigaddset(&mask, signals[i]);
+
+    // Signals must be blocked or they are delivered the default way instead
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0) {
+        perror("sigprocmask failed");
+        return NULL;
+    }
+
+    int fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd < 0) {
+        perror("signalfd failed");
+        return NULL;
+    }
+
+    struct event_source *source = add_source(loop, fd, EVENT_SOURCE_SIGNAL, EPOLLIN, cb, data);
+    if (!source)
+        close(fd);
+    return source;
+}
+
+void event_loop_remove(struct event_loop *loop, struct event_source *source) {
+    if (source->fd < 0)
+        return;
+
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, source->fd, NULL);
+    if (source->type != EVENT_SOURCE_FD)
+        close(source->fd);
+
+    source->fd = -1;
+    source->cb = NULL;
+    source->data = NULL;
+}
+
+static void dispatch_source(struct event_source *source, uint32_t events) {
+    switch (source->type) {
+    case EVENT_SOURCE_TIMER: {
+        uint64_t expirations;
+        if (read(source->fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+            return;
+        break;
+    }
+    case EVENT_SOURCE_SIGNAL: {
+        struct signalfd_siginfo info;
+        if (read(source->fd, &info, sizeof(info)) != sizeof(info))
+            return;
+        events = info.ssi_signo;
+        break;
+    }
+    case EVENT_SOURCE_FD:
+        break;
+    }
+
+    source->cb(source->fd, events, source->data);
+}
+
+int event_loop_dispatch(struct event_loop *loop, int timeout_ms) {
+    struct epoll_event events[EVENT_LOOP_MAX_SOURCES];
+
+    int count = epoll_wait(loop->epoll_fd, events, EVENT_LOOP_MAX_SOURCES, timeout_ms);
+    if (count < 0) {
+        if (errno == EINTR)
+            return 0;
+        perror("epoll_wait failed");
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        struct event_source *source = events[i].data.ptr;
+        // A previous callback in this batch may have removed the source
+        if (source->fd >= 0 && source->cb)
+            dispatch_source(source, events[i].events);
+    }
+    return count;
+}
+
+int event_loop_run(struct event_loop *loop) {
+    while (loop->running) {
+        if (event_loop_dispatch(loop, -1) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+void event_loop_quit(struct event_loop *loop) {
+    loop->running = 0;
+}
@@ -0,0 +1,71 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <stdint.h>
+#include <sys/epoll.h>
+
+#define EVENT_LOOP_MAX_SOURCES 16
+
+// fd is the source's descriptor; events is the EPOLL* mask that fired.
+// For timers the expiration count has already been consumed, for signal
+// sources the signalfd_siginfo has been read and its signal number is passed
+// in events instead of the EPOLL mask.
+typedef void (*event_loop_cb)(int fd, uint32_t events, void *data);
+
+enum event_source_type {
+    EVENT_SOURCE_FD,
+    EVENT_SOURCE_TIMER,
+    EVENT_SOURCE_SIGNAL,
+};
+
+struct event_source {
+    int fd;
+    enum event_source_type type;
+    event_loop_cb cb;
+    void *data;
+};
+
+// Single-threaded epoll loop multiplexing the DRM fd, timers and signals.
+// The process sleeps in epoll_wait() until one of them has work for us.
+struct event_loop {
+    int epoll_fd;
+    int running;
+    struct event_source sources[EVENT_LOOP_MAX_SOURCES];
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int event_loop_init(struct event_loop *loop);
+void event_loop_destroy(struct event_loop *loop);
+
+// Watch an existing fd (not owned by the loop) for events (EPOLLIN, ...)
+struct event_source *event_loop_add_fd(struct event_loop *loop, int fd, uint32_t events,
+                                       event_loop_cb cb, void *data);
+
+// Periodic timer (timerfd, CLOCK_MONOTONIC); the loop owns the fd
+struct event_source *event_loop_add_timer(struct event_loop *loop, int interval_ms,
+                                          event_loop_cb cb, void *data);
+
+// Deliver the given signals through a signalfd instead of async handlers.
+// The signals are blocked for the calling thread; the loop owns the fd.
+struct event_source *event_loop_add_signals(struct event_loop *loop, const int *signals, int count,
+                                            event_loop_cb cb, void *data);
+
+void event_loop_remove(struct event_loop *loop, struct event_source *source);
+
+// Wait up to timeout_ms (-1 = forever) and dispatch what is ready.
+// Returns the number of sources dispatched, -1 on error.
+int event_loop_dispatch(struct event_loop *loop, int timeout_ms);
+
+// Dispatch until event_loop_quit() is called from a callback. A quit
+// before event_loop_run() (e.g. the first commit failed) returns at once.
+int event_loop_run(struct event_loop *loop);
+void event_loop_quit(struct event_loop *loop);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EVENT_LOOP_H
@@ -0,0 +1,249 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <drm_fourcc.h>
+
+#include "fb_pool.h"
+
+static int dumb_alloc(struct fb_pool *pool, struct fb_pool_entry *entry) {
+    switch (entry->key.fourcc) {
+    case DRM_FORMAT_XRGB8888:
+    case DRM_FORMAT_ARGB8888:
+    case DRM_FORMAT_XBGR8888:
+    case DRM_FORMAT_ABGR8888:
+        break;
+    default:
+        fprintf(stderr, "Dumb buffers: unsupported format %.4s\n", (const char *)&entry->key.fourcc);
+        return -1;
+    }
+    if (entry->key.modifier != DRM_FORMAT_MOD_INVALID && entry->key.modifier != DRM_FORMAT_MOD_LINEAR) {
+        fprintf(stderr, "Dumb buffers are always linear\n");
+        return -1;
+    }
+
+    struct drm_mode_create_dumb create = {
+        .width = entry->key.width,
+        .height = entry->key.height,
+        .bpp = 32,
+    };
+    if (drmIoctl(pool->drm_fd, DRM_IOCTL_MODE_CREATE_DUMB, &create) < 0) {
+        perror("DRM_IOCTL_MODE_CREATE_DUMB failed");
+        return -1;
+    }
+    entry->modifier = entry->key.modifier;
+    entry->num_planes = 1;
+    entry->handles[0] = create.handle;
+    entry->pitches[0] = create.pitch;
+    entry->size = create.size;
+
+    struct drm_mode_map_dumb map = {.handle = create.handle};
+    void *data = MAP_FAILED;
+    if (drmIoctl(pool->drm_fd, DRM_IOCTL_MODE_MAP_DUMB, &map) < 0)
+        perror("DRM_IOCTL_MODE_MAP_DUMB failed");
+    else
+        data = mmap(0, entry->size, PROT_READ | PROT_WRITE, MAP_SHARED, pool->drm_fd, map.offset);
+
+    if (data == MAP_FAILED) {
+        perror("Failed to map dumb buffer");
+        struct drm_mode_destroy_dumb destroy = {.handle = create.handle};
+        drmIoctl(pool->drm_fd, DRM_IOCTL_MODE_DESTROY_DUMB, &destroy);
+        return -1;
+    }
+    entry->map = data;
+    entry->map_pitch = entry->pitches[0];
+    return 0;
+}
+
+static void dumb_free(struct fb_pool *pool, struct fb_pool_entry *entry) {
+    if (entry->map)
+        munmap(entry->map, entry->size);
+
+    struct drm_mode_destroy_dumb destroy = {.handle = entry->handles[0]};
+    if (drmIoctl(pool->drm_fd, DRM_IOCTL_MODE_DESTROY_DUMB, &destroy) < 0)
+        perror("Failed to destroy dumb buffer");
+}
+
+const struct fb_pool_backend fb_pool_dumb_backend = {
+    .name = "dumb",
+    .alloc = dumb_alloc,
+    .free = dumb_free,
+};
+
+void fb_pool_init(struct fb_pool *pool, int drm_fd, const struct fb_pool_backend *backend,
+                  void *backend_data, int max_idle) {
+    memset(pool, 0, sizeof(*pool));
+    pool->drm_fd = drm_fd;
+    pool->backend = backend;
+    pool->backend_data = backend_data;
+    pool->max_idle = max_idle;
+}
+
+static int key_equal(const struct fb_key *a, const struct fb_key *b) {
+    return a->width == b->width && a->height == b->height && a->fourcc == b->fourcc && a->modifier == b->modifier;
+}
+
+// At most FB_POOL_MAX_KEYS buckets: the lookup is bounded and allocation free
+static struct fb_pool_bucket *find_bucket(struct fb_pool *pool, const struct fb_key *key) {
+    struct fb_pool_bucket *empty = NULL;
+
+    for (int i = 0; i < FB_POOL_MAX_KEYS; i++) {
+        struct fb_pool_bucket *bucket = &pool->buckets[i];
+        if (bucket->used && key_equal(&bucket->key, key))
+            return bucket;
+        if (!bucket->used && !empty)
+            empty = bucket;
+    }
+
+    if (!empty) {
+        fprintf(stderr, "Framebuffer pool: more than %d distinct buffer keys\n", FB_POOL_MAX_KEYS);
+        return NULL;
+    }
+    empty->used = 1;
+    empty->key = *key;
+    return empty;
+}
+
+static struct fb_pool_entry *create_entry(struct fb_pool *pool, struct fb_pool_bucket *bucket) {
+    struct fb_pool_entry *entry = calloc(1, sizeof(*entry));
+    if (!entry) {
+        fprintf(stderr, "Out of memory\n");
+        return NULL;
+    }
+    entry->key = bucket->key;
+    entry->bucket = bucket;
+
+    if (pool->backend->alloc(pool, entry) != 0) {
+        free(entry);
+        return NULL;
+    }
+
+    // Every plane of a buffer shares its modifier
+    uint64_t modifiers[FB_POOL_MAX_PLANES] = {0};
+    for (int p = 0; p < entry->num_planes; p++)
+        modifiers[p] = entry->modifier;
+
+    int ret;
+    if (entry->modifier != DRM_FORMAT_MOD_INVALID) {
+        ret = drmModeAddFB2WithModifiers(pool->drm_fd, entry->key.width, entry->key.height, entry->key.fourcc,
+                                         entry->handles, entry->pitches, entry->offsets, modifiers,
+                                         &entry->fb_id, DRM_MODE_FB_MODIFIERS);
+    } else {
+        ret = drmModeAddFB2(pool->drm_fd, entry->key.width, entry->key.height, entry->key.fourcc,
+                            entry->handles, entry->pitches, entry->offsets, &entry->fb_id, 0);
+    }
+    if (ret != 0) {
+        perror("drmModeAddFB2 failed");
+        pool->backend->free(pool, entry);
+        free(entry);
+        return NULL;
+    }
+
+    entry->next = pool->entries;
+    if (pool->entries)
+        pool->entries->prev = entry;
+    pool->entries = entry;
+    pool->allocated++;
+    pool->resident++;
+    pool->resident_bytes += entry->size;
+    if (pool->resident_bytes > pool->peak_resident_bytes)
+        pool->peak_resident_bytes = pool->resident_bytes;
+
+    printf("[FB]       : ID = %d (%ux%u, %s, modifier 0x%016" PRIx64 ", %d plane%s)\n", entry->fb_id,
+           entry->key.width, entry->key.height, pool->backend->name, entry->modifier, entry->num_planes,
+           entry->num_planes == 1 ? "" : "s");
+    return entry;
+}
+
+static void destroy_entry(struct fb_pool *pool, struct fb_pool_entry *entry) {
+    if (entry->prev)
+        entry->prev->next = entry->next;
+    else
+        pool->entries = entry->next;
+    if (entry->next)
+        entry->next->prev = entry->prev;
+
+    drmModeRmFB(pool->drm_fd, entry->fb_id);
+    pool->backend->free(pool, entry);
+
+    pool->freed++;
+    pool->resident--;
+    pool->resident_bytes -= entry->size;
+    free(entry);
+}
+
+struct fb_pool_entry *fb_pool_acquire(struct fb_pool *pool, uint32_t width, uint32_t height,
+                                      uint32_t fourcc, uint64_t modifier) {
+    struct fb_key key = { .width = width, .height = height, .fourcc = fourcc, .modifier = modifier };
+    struct fb_pool_bucket *bucket = find_bucket(pool, &key);
+    if (!bucket)
+        return NULL;
+
+    struct fb_pool_entry *entry = bucket->free_list;
+    if (entry) {
+        bucket->free_list = entry->next_free;
+        bucket->idle--;
+        pool->reused++;
+    } else {
+        entry = create_entry(pool, bucket);
+        if (!entry)
+            return NULL;
+    }
+
+    entry->next_free = NULL;
+    entry->in_use = 1;
+    pool->in_use++;
+    return entry;
+}
+
+void fb_pool_release(struct fb_pool *pool, struct fb_pool_entry *entry) {
+    if (!entry || !entry->in_use)
+        return;
+
+    struct fb_pool_bucket *bucket = entry->bucket;
+    entry->in_use = 0;
+    pool->in_use--;
+
+    // Bounded idle list: a long session cycling through sizes stays flat
+    if (bucket->idle >= pool->max_idle) {
+        destroy_entry(pool, entry);
+        return;
+    }
+    entry->next_free = bucket->free_list;
+    bucket->free_list = entry;
+    bucket->idle++;
+}
+
+void fb_pool_trim(struct fb_pool *pool) {
+    for (int i = 0; i < FB_POOL_MAX_KEYS; i++) {
+        struct fb_pool_bucket *bucket = &pool->buckets[i];
+        while (bucket->free_list) {
+            struct fb_pool_entry *entry = bucket->free_list;
+            bucket->free_list = entry->next_free;
+            bucket->idle--;
+            destroy_entry(pool, entry);
+        }
+    }
+}
+
+void fb_pool_destroy(struct fb_pool *pool) {
+    if (pool->in_use)
+        fprintf(stderr, "Framebuffer pool: freeing %u buffers still in use\n", pool->in_use);
+
+    while (pool->entries) {
+        if (pool->entries->in_use)
+            pool->in_use--;
+        destroy_entry(pool, pool->entries);
+    }
+
+    memset(pool->buckets, 0, sizeof(pool->buckets));
+}
+
+void fb_pool_print_stats(const struct fb_pool *pool) {
+    printf("[FB_POOL]  : %u allocated, %u reused (allocations avoided), %u freed, %u resident "
+           "(%.1f MiB, peak %.1f MiB)\n",
+           pool->allocated, pool->reused, pool->freed, pool->resident,
+           pool->resident_bytes / (1024.0 * 1024.0), pool->peak_resident_bytes / (1024.0 * 1024.0));
+}
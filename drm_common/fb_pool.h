@@ -0,0 +1,114 @@
+#ifndef FB_POOL_H
+#define FB_POOL_H
+
+#include <stdint.h>
+
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#define FB_POOL_MAX_KEYS 16
+#define FB_POOL_MAX_PLANES 4
+
+struct fb_pool;
+
+// What a framebuffer is interchangeable by. modifier is the layout asked
+// for: DRM_FORMAT_MOD_INVALID lets the backend choose, anything else (e.g.
+// DRM_FORMAT_MOD_LINEAR) must be honoured exactly.
+struct fb_key {
+    uint32_t width;
+    uint32_t height;
+    uint32_t fourcc;
+    uint64_t modifier;
+};
+
+// One cached framebuffer: backing buffer, GEM handle, persistent CPU mapping
+// and KMS FB ID stay together for the lifetime of the entry.
+struct fb_pool_entry {
+    struct fb_key key;
+    uint32_t fb_id;
+    uint64_t modifier;          // layout actually allocated, DRM_FORMAT_MOD_INVALID if implicit
+    int num_planes;             // memory planes (compressed layouts add an aux plane)
+    uint32_t handles[FB_POOL_MAX_PLANES];   // GEM handle per plane
+    uint32_t pitches[FB_POOL_MAX_PLANES];
+    uint32_t offsets[FB_POOL_MAX_PLANES];
+    uint32_t size;
+    uint8_t *map;               // persistent CPU mapping, NULL if not mapped
+    uint32_t map_pitch;         // row pitch of map
+    void *bo;                   // backend object (e.g. struct gbm_bo), may be NULL
+    void *map_data;             // backend mapping cookie, may be NULL
+    int in_use;
+    struct fb_pool_entry *next_free;    // idle list of the entry's key
+    struct fb_pool_entry *prev;         // every entry owned by the pool
+    struct fb_pool_entry *next;
+    struct fb_pool_bucket *bucket;
+};
+
+// Buffer allocator behind the pool. alloc fills modifier, num_planes, the
+// per-plane handles / pitches / offsets, size and optionally map /
+// map_pitch / bo / map_data for entry->key; the pool adds the FB itself
+// (with drmModeAddFB2WithModifiers when modifier is explicit). free undoes
+// alloc (the FB is already removed).
+struct fb_pool_backend {
+    const char *name;
+    int (*alloc)(struct fb_pool *pool, struct fb_pool_entry *entry);
+    void (*free)(struct fb_pool *pool, struct fb_pool_entry *entry);
+};
+
+// Idle entries of one key, kept as a stack so acquire and release are O(1)
+struct fb_pool_bucket {
+    struct fb_key key;
+    int used;
+    int idle;
+    struct fb_pool_entry *free_list;
+};
+
+struct fb_pool {
+    int drm_fd;
+    const struct fb_pool_backend *backend;
+    void *backend_data;         // passed through to the backend (e.g. struct gbm_device)
+    int max_idle;               // idle entries kept per key, more are freed on release
+    struct fb_pool_bucket buckets[FB_POOL_MAX_KEYS];
+    struct fb_pool_entry *entries;
+
+    // Counters
+    unsigned int allocated;     // buffers created
+    unsigned int reused;        // acquires served from the pool (allocations avoided)
+    unsigned int freed;         // buffers destroyed
+    unsigned int in_use;
+    unsigned int resident;      // entries alive (in use + idle)
+    uint64_t resident_bytes;
+    uint64_t peak_resident_bytes;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Dumb buffers (DRM_IOCTL_MODE_CREATE_DUMB), mapped once at allocation.
+// 32 bpp formats and DRM_FORMAT_MOD_INVALID / LINEAR only.
+extern const struct fb_pool_backend fb_pool_dumb_backend;
+
+void fb_pool_init(struct fb_pool *pool, int drm_fd, const struct fb_pool_backend *backend,
+                  void *backend_data, int max_idle);
+
+// Hand out an idle framebuffer of this key, or allocate one. NULL on failure.
+struct fb_pool_entry *fb_pool_acquire(struct fb_pool *pool, uint32_t width, uint32_t height,
+                                      uint32_t fourcc, uint64_t modifier);
+
+// Return entry to its key's idle list (or free it if the list is full).
+// The caller must make sure the display no longer scans it out.
+void fb_pool_release(struct fb_pool *pool, struct fb_pool_entry *entry);
+
+// Free every idle entry, e.g. after switching to buffers of another key
+void fb_pool_trim(struct fb_pool *pool);
+
+// Free every entry, in use or not
+void fb_pool_destroy(struct fb_pool *pool);
+
+void fb_pool_print_stats(const struct fb_pool *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FB_POOL_H
@@ -0,0 +1,141 @@
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "frame_group.h"
+
+void frame_group_init(struct frame_group *group, int drm_fd) {
+    memset(group, 0, sizeof(*group));
+    group->drm_fd = drm_fd;
+    latency_stats_reset(&group->skew);
+}
+
+int frame_group_add(struct frame_group *group, uint32_t crtc_id, const struct drm_object_props *plane,
+                    struct swapchain *sc) {
+    if (group->count >= FRAME_GROUP_MAX)
+        return -1;
+
+    struct frame_group_member *m = &group->members[group->count];
+    memset(m, 0, sizeof(*m));
+    m->crtc_id = crtc_id;
+    m->plane = plane;
+    m->sc = sc;
+    return group->count++;
+}
+
+void frame_group_ready(struct frame_group *group, int member, struct swap_buffer *buf) {
+    group->members[member].ready = buf;
+}
+
+int frame_group_complete(const struct frame_group *group) {
+    if (group->pending > 0 || group->count == 0)
+        return 0;
+    for (int i = 0; i < group->count; i++) {
+        if (!group->members[i].ready)
+            return 0;
+    }
+    return 1;
+}
+
+int frame_group_present(struct frame_group *group) {
+    if (group->pending > 0) {
+        fprintf(stderr, "Frame group commit while the previous one is still in flight\n");
+        return -1;
+    }
+
+    drmModeAtomicReq *req = drmModeAtomicAlloc();
+    int members = 0;
+    for (int i = 0; i < group->count; i++) {
+        if (group->members[i].ready) {
+            drm_props_add(req, group->members[i].plane, DRM_PROP_PLANE_FB_ID, group->members[i].ready->fb_id);
+            members++;
+        }
+    }
+    if (members == 0) {
+        drmModeAtomicFree(req);
+        return 0;
+    }
+
+    int ret = drmModeAtomicCommit(group->drm_fd, req, DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT, group);
+    drmModeAtomicFree(req);
+    if (ret < 0) {
+        perror("drmModeAtomicCommit (frame group) failed");
+        return -1;
+    }
+
+    // One flip event per CRTC in the commit
+    for (int i = 0; i < group->count; i++) {
+        struct frame_group_member *m = &group->members[i];
+        if (!m->ready)
+            continue;
+        swapchain_queue(m->sc, m->ready);
+        m->ready = NULL;
+        m->flip_pending = 1;
+    }
+    group->pending = members;
+    group->batch = members;
+    group->presents++;
+    if (members < group->count)
+        group->partial++;
+    return 0;
+}
+
+void frame_group_flip_handler(int fd, unsigned int sequence, unsigned int tv_sec, unsigned int tv_usec,
+                              unsigned int crtc_id, void *user_data) {
+    struct frame_group *group = user_data;
+    struct frame_group_member *m = NULL;
+
+    for (int i = 0; i < group->count; i++) {
+        if (group->members[i].crtc_id == crtc_id)
+            m = &group->members[i];
+    }
+    if (!m || !m->flip_pending) {
+        fprintf(stderr, "Frame group flip event for unexpected CRTC %u\n", crtc_id);
+        return;
+    }
+
+    swapchain_page_flip_handler(fd, sequence, tv_sec, tv_usec, crtc_id, m->sc);
+    m->flip_pending = 0;
+    m->flip_time_ms = m->sc->flip_time_ms;
+    if (group->pending == group->batch || m->flip_time_ms < group->first_flip_ms)
+        group->first_flip_ms = m->flip_time_ms;
+    if (group->pending == group->batch || m->flip_time_ms > group->last_flip_ms)
+        group->last_flip_ms = m->flip_time_ms;
+
+    // Last CRTC of the commit: how far apart did the displays flip?
+    if (--group->pending == 0)
+        latency_stats_add(&group->skew, group->last_flip_ms - group->first_flip_ms);
+}
+
+int frame_group_wait(struct frame_group *group, int timeout_ms) {
+    struct pollfd pfd = { .fd = group->drm_fd, .events = POLLIN };
+    drmEventContext evctx = {
+        .version = 3,
+        .page_flip_handler2 = frame_group_flip_handler,
+    };
+
+    while (group->pending > 0) {
+        int ret = poll(&pfd, 1, timeout_ms);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("poll on DRM fd failed");
+            return -1;
+        }
+        if (ret == 0) {
+            fprintf(stderr, "Timed out waiting for frame group flips (%d outstanding)\n", group->pending);
+            return -1;
+        }
+        if (drmHandleEvent(group->drm_fd, &evctx) != 0 && errno != EAGAIN) {
+            perror("drmHandleEvent failed");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void frame_group_print_stats(const struct frame_group *group) {
+    printf("[GROUP]    : %d CRTCs, %u group commits (%u partial)\n", group->count, group->presents, group->partial);
+    latency_stats_print("inter-CRTC skew", &group->skew);
+}
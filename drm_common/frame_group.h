@@ -0,0 +1,86 @@
+#ifndef FRAME_GROUP_H
+#define FRAME_GROUP_H
+
+#include <stdint.h>
+
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#include "drm_props.h"
+#include "frame_stats.h"
+#include "swapchain.h"
+
+#define FRAME_GROUP_MAX 8
+
+// One CRTC of the group and the buffer it shows next
+struct frame_group_member {
+    uint32_t crtc_id;
+    const struct drm_object_props *plane;   // primary plane of the CRTC
+    struct swapchain *sc;
+    struct swap_buffer *ready;  // rendered, waiting for the next group commit
+    int flip_pending;           // committed, flip event not back yet
+    double flip_time_ms;        // vblank timestamp of its last flip
+};
+
+// Several CRTCs presented together (video walls): the ready buffers of all
+// members go out in one atomic commit, so every display flips on the same
+// vblank instead of drifting apart by a frame as separate commits do. The
+// kernel sends one flip event per CRTC; once all are back, the spread of
+// their vblank timestamps is recorded as the inter-display skew.
+struct frame_group {
+    int drm_fd;
+    int count;
+    struct frame_group_member members[FRAME_GROUP_MAX];
+    int pending;                // flip events of the last commit still to come
+    int batch;                  // CRTCs in the last commit
+    double first_flip_ms;       // earliest / latest vblank timestamp among them
+    double last_flip_ms;
+
+    // Counters
+    unsigned int presents;      // group commits
+    unsigned int partial;       // commits that left a member out (not ready)
+    struct latency_stats skew;  // max - min flip timestamp per group commit
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void frame_group_init(struct frame_group *group, int drm_fd);
+
+// Add a CRTC whose primary plane is already lit and whose flips are
+// tracked by sc. Returns the member index, -1 if the group is full.
+int frame_group_add(struct frame_group *group, uint32_t crtc_id, const struct drm_object_props *plane,
+                    struct swapchain *sc);
+
+// Hand in member's next frame, a buffer acquired from its swapchain
+void frame_group_ready(struct frame_group *group, int member, struct swap_buffer *buf);
+
+// True when every member has a frame waiting and no group flip is in flight
+int frame_group_complete(const struct frame_group *group);
+
+// Commit the ready buffers of all members in one nonblocking atomic commit
+// with DRM_MODE_PAGE_FLIP_EVENT and user_data = group. Fails while the
+// previous commit's flips are outstanding. Returns 0, -1 on error.
+int frame_group_present(struct frame_group *group);
+
+// True while flip events of the last group commit are outstanding
+static inline int frame_group_flip_pending(const struct frame_group *group) {
+    return group->pending > 0;
+}
+
+// Block until every flip of the last group commit arrived
+int frame_group_wait(struct frame_group *group, int timeout_ms);
+
+// Page-flip handler for drmEventContext.page_flip_handler2; user_data is the
+// group and crtc_id tells which member flipped
+void frame_group_flip_handler(int fd, unsigned int sequence, unsigned int tv_sec, unsigned int tv_usec,
+                              unsigned int crtc_id, void *user_data);
+
+void frame_group_print_stats(const struct frame_group *group);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FRAME_GROUP_H
@@ -0,0 +1,42 @@
+#include <math.h>
+#include <stdio.h>
+
+#include "frame_stats.h"
+
+void latency_stats_reset(struct latency_stats *stats) {
+    stats->count = 0;
+    stats->sum_ms = 0.0;
+    stats->sum_sq_ms = 0.0;
+    stats->min_ms = 0.0;
+    stats->max_ms = 0.0;
+}
+
+void latency_stats_add(struct latency_stats *stats, double ms) {
+    if (stats->count == 0 || ms < stats->min_ms)
+        stats->min_ms = ms;
+    if (stats->count == 0 || ms > stats->max_ms)
+        stats->max_ms = ms;
+
+    stats->count++;
+    stats->sum_ms += ms;
+    stats->sum_sq_ms += ms * ms;
+}
+
+double latency_stats_avg(const struct latency_stats *stats) {
+    return stats->count ? stats->sum_ms / stats->count : 0.0;
+}
+
+double latency_stats_stddev(const struct latency_stats *stats) {
+    if (stats->count < 2)
+        return 0.0;
+
+    double avg = latency_stats_avg(stats);
+    double var = stats->sum_sq_ms / stats->count - avg * avg;
+    return var > 0.0 ? sqrt(var) : 0.0;
+}
+
+void latency_stats_print(const char *name, const struct latency_stats *stats) {
+    printf("[STATS]    : %-16s n = %llu  min = %.3f ms  avg = %.3f ms  max = %.3f ms  stddev = %.3f ms\n",
+           name, (unsigned long long)stats->count, stats->min_ms, latency_stats_avg(stats),
+           stats->max_ms, latency_stats_stddev(stats));
+}
@@ -0,0 +1,37 @@
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+#include <stdint.h>
+#include <time.h>
+
+// Running min/avg/max of a latency sample set, in milliseconds
+struct latency_stats {
+    uint64_t count;
+    double sum_ms;
+    double sum_sq_ms;
+    double min_ms;
+    double max_ms;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Monotonic wall clock in milliseconds (clock() only counts CPU time)
+static inline double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+void latency_stats_reset(struct latency_stats *stats);
+void latency_stats_add(struct latency_stats *stats, double ms);
+double latency_stats_avg(const struct latency_stats *stats);
+double latency_stats_stddev(const struct latency_stats *stats);
+void latency_stats_print(const char *name, const struct latency_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FRAME_STATS_H
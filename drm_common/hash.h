@@ -0,0 +1,29 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// 64-bit FNV-1a, for the cache keys and fingerprints that only have to
+// tell configurations apart (plane test results, snapshots, cursor images)
+#define FNV1A_OFFSET 0xcbf29ce484222325ULL
+
+static inline uint64_t fnv1a_bytes(uint64_t hash, const void *data, size_t size) {
+    const uint8_t *bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// One value, least significant byte first whatever the host byte order
+static inline uint64_t fnv1a_u32(uint64_t hash, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        hash ^= (value >> (i * 8)) & 0xff;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+#endif // HASH_H
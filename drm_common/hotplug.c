@@ -0,0 +1,198 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <linux/netlink.h>
+
+#include "hotplug.h"
+
+// Slot of connector_id in the monitor, added if new (MST connectors come
+// and go with the topology). -1 if the table is full.
+static int connector_slot(struct hotplug_monitor *mon, uint32_t connector_id) {
+    for (int i = 0; i < mon->count; i++) {
+        if (mon->connector_ids[i] == connector_id)
+            return i;
+    }
+    if (mon->count >= HOTPLUG_MAX_CONNECTORS)
+        return -1;
+    mon->connector_ids[mon->count] = connector_id;
+    mon->connected[mon->count] = 0;
+    return mon->count++;
+}
+
+// Status as last detected by the kernel, no probe
+static int connector_connected(int drm_fd, uint32_t connector_id) {
+    drmModeConnector *conn = drmModeGetConnectorCurrent(drm_fd, connector_id);
+    int connected = conn && conn->connection == DRM_MODE_CONNECTED;
+    drmModeFreeConnector(conn);
+    return connected;
+}
+
+static void add_change(struct hotplug_change *changes, uint32_t connector_id, int connected) {
+    for (int i = 0; i < changes->count; i++) {
+        if (changes->connector_ids[i] == connector_id) {
+            changes->connected[i] = connected;
+            return;
+        }
+    }
+    if (changes->count < HOTPLUG_MAX_CONNECTORS) {
+        changes->connector_ids[changes->count] = connector_id;
+        changes->connected[changes->count++] = connected;
+    }
+}
+
+int hotplug_init(struct hotplug_monitor *mon, int drm_fd) {
+    struct sockaddr_nl addr = {
+        .nl_family = AF_NETLINK,
+        .nl_groups = 1,         // kernel uevents (udevd re-broadcasts on group 2)
+    };
+    struct stat st;
+
+    memset(mon, 0, sizeof(*mon));
+    mon->drm_fd = drm_fd;
+    mon->sock = -1;
+    if (fstat(drm_fd, &st) != 0) {
+        perror("fstat on DRM fd failed");
+        return -1;
+    }
+    mon->drm_minor = minor(st.st_rdev);
+
+    mon->sock = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+    if (mon->sock < 0) {
+        perror("Failed to open uevent socket");
+        return -1;
+    }
+    if (bind(mon->sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        perror("Failed to bind uevent socket");
+        close(mon->sock);
+        mon->sock = -1;
+        return -1;
+    }
+
+    drmModeRes *res = drmModeGetResources(drm_fd);
+    if (res) {
+        for (int i = 0; i < res->count_connectors; i++) {
+            int slot = connector_slot(mon, res->connectors[i]);
+            if (slot >= 0)
+                mon->connected[slot] = connector_connected(drm_fd, res->connectors[i]);
+        }
+        drmModeFreeResources(res);
+    }
+    return 0;
+}
+
+// "change@/devices/...\0ACTION=change\0SUBSYSTEM=drm\0HOTPLUG=1\0MINOR=1\0..."
+// Returns 1 for a hotplug of our device, with *connector_id the connector
+// the kernel named (0 if it did not), else 0.
+static int parse_uevent(const struct hotplug_monitor *mon, const char *buf, size_t len, uint32_t *connector_id) {
+    int drm = 0, hotplug = 0, ours = 0;
+
+    *connector_id = 0;
+    for (size_t pos = 0; pos < len; pos += strlen(buf + pos) + 1) {
+        const char *key = buf + pos;
+        if (strcmp(key, "SUBSYSTEM=drm") == 0)
+            drm = 1;
+        else if (strcmp(key, "HOTPLUG=1") == 0)
+            hotplug = 1;
+        else if (strncmp(key, "MINOR=", 6) == 0)
+            ours = strtoul(key + 6, NULL, 10) == mon->drm_minor;
+        else if (strncmp(key, "CONNECTOR=", 10) == 0)
+            *connector_id = (uint32_t)strtoul(key + 10, NULL, 10);
+    }
+    return drm && hotplug && ours;
+}
+
+// Connectors whose status changed since the last event, without probing
+static void diff_connectors(struct hotplug_monitor *mon, struct hotplug_change *changes) {
+    drmModeRes *res = drmModeGetResources(mon->drm_fd);
+    if (!res)
+        return;
+
+    for (int i = 0; i < res->count_connectors; i++) {
+        int slot = connector_slot(mon, res->connectors[i]);
+        if (slot < 0)
+            continue;
+        int connected = connector_connected(mon->drm_fd, res->connectors[i]);
+        if (connected != mon->connected[slot]) {
+            mon->connected[slot] = connected;
+            add_change(changes, res->connectors[i], connected);
+        }
+    }
+
+    // Connectors that disappeared (MST) count as unplugged
+    for (int s = 0; s < mon->count; s++) {
+        int present = 0;
+        for (int i = 0; i < res->count_connectors; i++)
+            present |= res->connectors[i] == mon->connector_ids[s];
+        if (!present && mon->connected[s]) {
+            mon->connected[s] = 0;
+            add_change(changes, mon->connector_ids[s], 0);
+        }
+    }
+    drmModeFreeResources(res);
+}
+
+int hotplug_read(struct hotplug_monitor *mon, struct hotplug_change *changes) {
+    char buf[8192];
+
+    changes->count = 0;
+    for (;;) {
+        struct sockaddr_nl src;
+        struct iovec iov = { .iov_base = buf, .iov_len = sizeof(buf) - 1 };
+        struct msghdr msg = { .msg_name = &src, .msg_namelen = sizeof(src), .msg_iov = &iov, .msg_iovlen = 1 };
+
+        ssize_t len = recvmsg(mon->sock, &msg, 0);
+        if (len < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            if (errno == EINTR)
+                continue;
+            if (errno == ENOBUFS) {
+                // Events were dropped: compare every connector
+                diff_connectors(mon, changes);
+                continue;
+            }
+            perror("recvmsg on uevent socket failed");
+            return -1;
+        }
+        // Only the kernel may send on group 1
+        if (src.nl_pid != 0)
+            continue;
+        buf[len] = '\0';
+
+        uint32_t connector_id;
+        if (!parse_uevent(mon, buf, (size_t)len, &connector_id))
+            continue;
+        mon->events++;
+
+        if (!connector_id) {
+            diff_connectors(mon, changes);
+            continue;
+        }
+
+        // The kernel named the connector: report it even if the status is
+        // the same, the display behind it may have been swapped
+        int slot = connector_slot(mon, connector_id);
+        int connected = connector_connected(mon->drm_fd, connector_id);
+        if (slot >= 0)
+            mon->connected[slot] = connected;
+        add_change(changes, connector_id, connected);
+    }
+    return changes->count;
+}
+
+void hotplug_destroy(struct hotplug_monitor *mon) {
+    if (mon->sock >= 0)
+        close(mon->sock);
+    mon->sock = -1;
+}
+
+void hotplug_print_stats(const struct hotplug_monitor *mon) {
+    printf("[HOTPLUG]  : %u hotplug events, %d connectors watched\n", mon->events, mon->count);
+}
@@ -0,0 +1,58 @@
+#ifndef HOTPLUG_H
+#define HOTPLUG_H
+
+#include <stdint.h>
+
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#define HOTPLUG_MAX_CONNECTORS 32
+
+// Display hotplug without a udev daemon: the kernel's uevents are read
+// straight from a NETLINK_KOBJECT_UEVENT socket and filtered to HOTPLUG=1
+// events of one DRM device. Newer kernels name the connector that changed
+// (CONNECTOR=<id>) and only that one is reported. Otherwise every
+// connector's status is compared with the last one seen. Statuses are read
+// with drmModeGetConnectorCurrent, which returns what the kernel's own
+// hotplug handling detected, so nothing is probed here; the caller probes
+// only the connectors it lights up (topology_solve_output()).
+struct hotplug_monitor {
+    int sock;                   // netlink socket, poll it for POLLIN
+    int drm_fd;
+    unsigned int drm_minor;     // card minor the events must carry (MINOR=)
+    int count;
+    uint32_t connector_ids[HOTPLUG_MAX_CONNECTORS];
+    int connected[HOTPLUG_MAX_CONNECTORS];  // status last seen
+
+    // Counters
+    unsigned int events;        // hotplug uevents for this device
+};
+
+// Connectors that changed state in one event
+struct hotplug_change {
+    int count;
+    uint32_t connector_ids[HOTPLUG_MAX_CONNECTORS];
+    int connected[HOTPLUG_MAX_CONNECTORS];
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Open the uevent socket and record the current status of every connector
+int hotplug_init(struct hotplug_monitor *mon, int drm_fd);
+
+// Read the queued uevents without blocking and collect the connectors that
+// came, went or were named by a hotplug of the device. Returns the number
+// of changed connectors, -1 on error.
+int hotplug_read(struct hotplug_monitor *mon, struct hotplug_change *changes);
+
+void hotplug_destroy(struct hotplug_monitor *mon);
+
+void hotplug_print_stats(const struct hotplug_monitor *mon);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOTPLUG_H
@@ -0,0 +1,175 @@
+#include <stdio.h>
+
+#include "pixel_convert.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PIXEL_CONVERT_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+typedef void (*convert_row_fn)(uint32_t *dst, const uint32_t *src, int width);
+
+// RGBA bytes read as a little-endian word are 0xAABBGGRR; XRGB8888 wants
+// 0xXXRRGGBB. G and A/X stay where they are, R and B trade places.
+static inline uint32_t swizzle_pixel(uint32_t v) {
+    return (v & 0xff00ff00u) | ((v >> 16) & 0xffu) | ((v & 0xffu) << 16);
+}
+
+static void convert_row_scalar(uint32_t *dst, const uint32_t *src, int width) {
+    for (int x = 0; x < width; x++)
+        dst[x] = swizzle_pixel(src[x]);
+}
+
+#ifdef PIXEL_CONVERT_X86
+// Streaming stores need an aligned destination: the head of each row is
+// converted one pixel at a time until dst reaches the vector alignment.
+__attribute__((target("sse2")))
+static void convert_row_sse2(uint32_t *dst, const uint32_t *src, int width) {
+    const __m128i keep = _mm_set1_epi32((int)0xff00ff00);
+    const __m128i low = _mm_set1_epi32(0xff);
+    int x = 0;
+
+    for (; x < width && ((uintptr_t)(dst + x) & 15); x++)
+        dst[x] = swizzle_pixel(src[x]);
+
+    for (; x + 4 <= width; x += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + x));
+        __m128i rb = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(v, 16), low),
+                                  _mm_slli_epi32(_mm_and_si128(v, low), 16));
+        _mm_stream_si128((__m128i *)(dst + x), _mm_or_si128(_mm_and_si128(v, keep), rb));
+    }
+
+    for (; x < width; x++)
+        dst[x] = swizzle_pixel(src[x]);
+}
+
+__attribute__((target("avx2")))
+static void convert_row_avx2(uint32_t *dst, const uint32_t *src, int width) {
+    const __m256i keep = _mm256_set1_epi32((int)0xff00ff00);
+    const __m256i low = _mm256_set1_epi32(0xff);
+    int x = 0;
+
+    for (; x < width && ((uintptr_t)(dst + x) & 31); x++)
+        dst[x] = swizzle_pixel(src[x]);
+
+    for (; x + 8 <= width; x += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + x));
+        __m256i rb = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(v, 16), low),
+                                     _mm256_slli_epi32(_mm256_and_si256(v, low), 16));
+        _mm256_stream_si256((__m256i *)(dst + x), _mm256_or_si256(_mm256_and_si256(v, keep), rb));
+    }
+
+    for (; x < width; x++)
+        dst[x] = swizzle_pixel(src[x]);
+}
+#endif
+
+#if defined(__ARM_NEON)
+// vld4/vst4 de-interleave the channels, so the swap is a register rename.
+// NEON intrinsics have no non-temporal store; plain stores are used.
+static void convert_row_neon(uint32_t *dst, const uint32_t *src, int width) {
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16) {
+        uint8x16x4_t px = vld4q_u8((const uint8_t *)(src + x));
+        uint8x16_t r = px.val[0];
+        px.val[0] = px.val[2];
+        px.val[2] = r;
+        vst4q_u8((uint8_t *)(dst + x), px);
+    }
+
+    for (; x < width; x++)
+        dst[x] = swizzle_pixel(src[x]);
+}
+#endif
+
+int pixel_convert_supported(enum pixel_convert_impl impl) {
+    switch (impl) {
+    case PIXEL_CONVERT_SCALAR:
+        return 1;
+#ifdef PIXEL_CONVERT_X86
+    case PIXEL_CONVERT_SSE2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse2");
+    case PIXEL_CONVERT_AVX2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#endif
+#if defined(__ARM_NEON)
+    case PIXEL_CONVERT_NEON:
+        return 1;
+#endif
+    default:
+        return 0;
+    }
+}
+
+enum pixel_convert_impl pixel_convert_best(void) {
+    static int best = -1;
+
+    if (best < 0) {
+        best = PIXEL_CONVERT_SCALAR;
+        for (int impl = PIXEL_CONVERT_IMPL_COUNT - 1; impl > PIXEL_CONVERT_SCALAR; impl--) {
+            if (pixel_convert_supported(impl)) {
+                best = impl;
+                break;
+            }
+        }
+        printf("[CONVERT]  : RGBA -> XRGB8888 using %s\n", pixel_convert_impl_name(best));
+    }
+    return best;
+}
+
+const char *pixel_convert_impl_name(enum pixel_convert_impl impl) {
+    static const char *const names[PIXEL_CONVERT_IMPL_COUNT] = {
+        [PIXEL_CONVERT_SCALAR] = "scalar",
+        [PIXEL_CONVERT_SSE2]   = "SSE2",
+        [PIXEL_CONVERT_AVX2]   = "AVX2",
+        [PIXEL_CONVERT_NEON]   = "NEON",
+    };
+    return impl < PIXEL_CONVERT_IMPL_COUNT ? names[impl] : "unknown";
+}
+
+static convert_row_fn row_function(enum pixel_convert_impl impl) {
+    switch (impl) {
+#ifdef PIXEL_CONVERT_X86
+    case PIXEL_CONVERT_SSE2:
+        return convert_row_sse2;
+    case PIXEL_CONVERT_AVX2:
+        return convert_row_avx2;
+#endif
+#if defined(__ARM_NEON)
+    case PIXEL_CONVERT_NEON:
+        return convert_row_neon;
+#endif
+    default:
+        return convert_row_scalar;
+    }
+}
+
+int convert_rgba_to_xrgb8888_impl(enum pixel_convert_impl impl, uint8_t *dst, uint32_t dst_pitch,
+                                  const uint8_t *src, uint32_t src_pitch, int width, int height) {
+    if (!pixel_convert_supported(impl))
+        return -1;
+
+    convert_row_fn convert_row = row_function(impl);
+    for (int y = 0; y < height; y++)
+        convert_row((uint32_t *)(dst + (size_t)y * dst_pitch), (const uint32_t *)(src + (size_t)y * src_pitch), width);
+
+#ifdef PIXEL_CONVERT_X86
+    // Streaming stores are weakly ordered: drain them before the buffer is
+    // handed to the display
+    if (impl == PIXEL_CONVERT_SSE2 || impl == PIXEL_CONVERT_AVX2)
+        _mm_sfence();
+#endif
+    return 0;
+}
+
+void convert_rgba_to_xrgb8888(uint8_t *dst, uint32_t dst_pitch, const uint8_t *src, uint32_t src_pitch,
+                              int width, int height) {
+    convert_rgba_to_xrgb8888_impl(pixel_convert_best(), dst, dst_pitch, src, src_pitch, width, height);
+}
@@ -0,0 +1,45 @@
+#ifndef PIXEL_CONVERT_H
+#define PIXEL_CONVERT_H
+
+#include <stdint.h>
+
+// GL hands back GL_RGBA / GL_UNSIGNED_BYTE pixels (bytes R, G, B, A) while
+// the framebuffers are DRM_FORMAT_XRGB8888 (little-endian 0xXXRRGGBB, bytes
+// B, G, R, X). The converter swaps R and B and writes each row at the
+// destination pitch, so padded dumb-buffer strides work.
+enum pixel_convert_impl {
+    PIXEL_CONVERT_SCALAR,
+    PIXEL_CONVERT_SSE2,
+    PIXEL_CONVERT_AVX2,
+    PIXEL_CONVERT_NEON,
+    PIXEL_CONVERT_IMPL_COUNT
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Convert width x height pixels. The SIMD kernels write with non-temporal
+// stores where the ISA has them: the destination is usually a write-combined
+// scanout mapping that is never read back by the CPU.
+void convert_rgba_to_xrgb8888(uint8_t *dst, uint32_t dst_pitch, const uint8_t *src, uint32_t src_pitch,
+                              int width, int height);
+
+// Same conversion with an explicit kernel (benchmarks). Returns -1 if the
+// kernel is not built in or the CPU lacks the instructions.
+int convert_rgba_to_xrgb8888_impl(enum pixel_convert_impl impl, uint8_t *dst, uint32_t dst_pitch,
+                                  const uint8_t *src, uint32_t src_pitch, int width, int height);
+
+// True if impl can run on this CPU
+int pixel_convert_supported(enum pixel_convert_impl impl);
+
+// Kernel picked at first use by CPU feature detection
+enum pixel_convert_impl pixel_convert_best(void);
+
+const char *pixel_convert_impl_name(enum pixel_convert_impl impl);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PIXEL_CONVERT_H
@@ -0,0 +1,394 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <drm_fourcc.h>
+
+#include "hash.h"
+#include "plane_alloc.h"
+
+static int type_rank(int type) {
+    switch (type) {
+    case DRM_PLANE_TYPE_PRIMARY:
+        return 0;
+    case DRM_PLANE_TYPE_OVERLAY:
+        return 1;
+    default:
+        return 2;
+    }
+}
+
+// Stacking order: primary first (the composition target), then by zpos
+// where the driver has it, else overlays by ID and the cursor last
+static int compare_planes(const void *a, const void *b) {
+    const struct hw_plane *pa = a;
+    const struct hw_plane *pb = b;
+
+    if ((pa->type == DRM_PLANE_TYPE_PRIMARY) != (pb->type == DRM_PLANE_TYPE_PRIMARY))
+        return pa->type == DRM_PLANE_TYPE_PRIMARY ? -1 : 1;
+    if (pa->props.ids[DRM_PROP_PLANE_ZPOS] && pb->props.ids[DRM_PROP_PLANE_ZPOS] &&
+        pa->props.values[DRM_PROP_PLANE_ZPOS] != pb->props.values[DRM_PROP_PLANE_ZPOS])
+        return pa->props.values[DRM_PROP_PLANE_ZPOS] < pb->props.values[DRM_PROP_PLANE_ZPOS] ? -1 : 1;
+    if (type_rank(pa->type) != type_rank(pb->type))
+        return type_rank(pa->type) - type_rank(pb->type);
+    return pa->id < pb->id ? -1 : pa->id > pb->id;
+}
+
+int plane_alloc_init(struct plane_alloc *alloc, int drm_fd, uint32_t crtc_id, int crtc_index) {
+    memset(alloc, 0, sizeof(*alloc));
+    alloc->drm_fd = drm_fd;
+    alloc->crtc_id = crtc_id;
+
+    drmModePlaneRes *res = drmModeGetPlaneResources(drm_fd);
+    if (!res) {
+        perror("drmModeGetPlaneResources failed");
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < res->count_planes && alloc->count < PLANE_ALLOC_MAX_PLANES; i++) {
+        drmModePlane *plane = drmModeGetPlane(drm_fd, res->planes[i]);
+        if (!plane)
+            continue;
+        if (!(plane->possible_crtcs & (1u << crtc_index))) {
+            drmModeFreePlane(plane);
+            continue;
+        }
+
+        struct hw_plane *hw = &alloc->planes[alloc->count];
+        if (drm_props_init(drm_fd, plane->plane_id, DRM_MODE_OBJECT_PLANE, &hw->props) != 0) {
+            drmModeFreePlane(plane);
+            continue;
+        }
+        hw->id = plane->plane_id;
+        hw->type = (int)hw->props.values[DRM_PROP_PLANE_TYPE];
+        hw->initial_crtc = plane->crtc_id;
+        hw->count_formats = plane->count_formats < PLANE_ALLOC_MAX_FORMATS ? (int)plane->count_formats
+                                                                          : PLANE_ALLOC_MAX_FORMATS;
+        memcpy(hw->formats, plane->formats, hw->count_formats * sizeof(uint32_t));
+        alloc->count++;
+        drmModeFreePlane(plane);
+    }
+    drmModeFreePlaneResources(res);
+
+    qsort(alloc->planes, alloc->count, sizeof(alloc->planes[0]), compare_planes);
+    if (alloc->count == 0 || alloc->planes[0].type != DRM_PLANE_TYPE_PRIMARY) {
+        fprintf(stderr, "CRTC %u has no primary plane\n", crtc_id);
+        return -1;
+    }
+    return 0;
+}
+
+int hw_plane_has_format(const struct hw_plane *plane, uint32_t fourcc) {
+    for (int i = 0; i < plane->count_formats; i++) {
+        if (plane->formats[i] == fourcc)
+            return 1;
+    }
+    return 0;
+}
+
+static int layers_overlap(const struct plane_layer *a, const struct plane_layer *b) {
+    return a->x < b->x + (int32_t)b->w && b->x < a->x + (int32_t)a->w &&
+           a->y < b->y + (int32_t)b->h && b->y < a->y + (int32_t)a->h;
+}
+
+// Hash of everything the kernel's check depends on
+static uint64_t config_key(const struct plane_alloc *alloc, const struct plane_layer *layers, int count,
+                           const drmModeAtomicReq *base, uint32_t flags) {
+    uint64_t hash = fnv1a_u32(FNV1A_OFFSET, alloc->crtc_id);
+
+    // The base state itself cannot be read back from the request: callers
+    // reset the memo when it changes (plane_alloc_reset_memo)
+    hash = fnv1a_u32(hash, flags);
+    hash = fnv1a_u32(hash, base != NULL);
+
+    for (int i = 0; i < count; i++) {
+        const struct plane_layer *layer = &layers[i];
+        if (layer->plane < 0)
+            continue;
+        hash = fnv1a_u32(hash, alloc->planes[layer->plane].id);
+        hash = fnv1a_u32(hash, layer->fourcc);
+        hash = fnv1a_u32(hash, (uint32_t)layer->modifier);
+        hash = fnv1a_u32(hash, (uint32_t)(layer->modifier >> 32));
+        hash = fnv1a_u32(hash, layer->src_w);
+        hash = fnv1a_u32(hash, layer->src_h);
+        hash = fnv1a_u32(hash, (uint32_t)layer->x);
+        hash = fnv1a_u32(hash, (uint32_t)layer->y);
+        hash = fnv1a_u32(hash, layer->w);
+        hash = fnv1a_u32(hash, layer->h);
+        hash = fnv1a_u32(hash, layer->zorder);
+        hash = fnv1a_u32(hash, layer->alpha);
+        hash = fnv1a_u32(hash, layer->blend);
+    }
+    return hash;
+}
+
+// Would the kernel take the current assignment? Memoized per configuration.
+static int config_ok(struct plane_alloc *alloc, const struct plane_layer *layers, int count,
+                     drmModeAtomicReq *base, uint32_t flags) {
+    uint64_t key = config_key(alloc, layers, count, base, flags);
+    struct plane_memo *memo = &alloc->memo[key % PLANE_ALLOC_MEMO_SIZE];
+    if (memo->result && memo->key == key) {
+        alloc->memo_hits++;
+        return memo->result > 0;
+    }
+
+    drmModeAtomicReq *req = base ? drmModeAtomicDuplicate(base) : drmModeAtomicAlloc();
+    if (!req) {
+        fprintf(stderr, "Failed to allocate atomic request\n");
+        return 0;
+    }
+    int ret = plane_alloc_add(alloc, req, layers, count);
+    if (ret >= 0)
+        ret = drmModeAtomicCommit(alloc->drm_fd, req, flags | DRM_MODE_ATOMIC_TEST_ONLY, NULL);
+    drmModeAtomicFree(req);
+    alloc->tests++;
+
+    memo->key = key;
+    memo->result = ret == 0 ? 1 : -1;
+    return ret == 0;
+}
+
+void plane_alloc_reset_memo(struct plane_alloc *alloc) {
+    memset(alloc->memo, 0, sizeof(alloc->memo));
+}
+
+// Bottom to top; insertion sort keeps equal zorders in caller order
+static void sort_by_zorder(const struct plane_layer *layers, int count, int *order) {
+    for (int i = 0; i < count; i++) {
+        int j = i;
+        while (j > 0 && layers[order[j - 1]].zorder > layers[i].zorder) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+}
+
+// Composited layers end up in the bottom buffer, below every plane, so a
+// layer left on a plane would show above a composited layer it overlaps
+// from below. Demoting such a layer makes it composited too, which can
+// uncover another one lower down: repeat until nothing changes. Looks at
+// order[1..top]; returns the number of layers taken off their planes.
+static int demote_covered(struct plane_layer *layers, const int *order, int top) {
+    int demoted = 0;
+    int changed = 1;
+
+    while (changed) {
+        changed = 0;
+        for (int c = 2; c <= top; c++) {
+            const struct plane_layer *composited = &layers[order[c]];
+            if (composited->plane >= 0)
+                continue;
+            for (int j = 1; j < c; j++) {
+                struct plane_layer *below = &layers[order[j]];
+                if (below->plane > 0 && layers_overlap(below, composited)) {
+                    below->plane = -1;
+                    demoted++;
+                    changed = 1;
+                }
+            }
+        }
+    }
+    return demoted;
+}
+
+int plane_alloc_assign(struct plane_alloc *alloc, struct plane_layer *layers, int count,
+                       drmModeAtomicReq *base, uint32_t flags) {
+    int order[PLANE_ALLOC_MAX_LAYERS];
+
+    if (count > PLANE_ALLOC_MAX_LAYERS)
+        count = PLANE_ALLOC_MAX_LAYERS;
+
+    sort_by_zorder(layers, count, order);
+    for (int i = 0; i < count; i++)
+        layers[i].plane = -1;
+    if (count == 0)
+        return 0;
+
+    // The bottom layer is the composition target and must be on the primary
+    struct plane_layer *bottom = &layers[order[0]];
+    bottom->plane = 0;
+    if (!hw_plane_has_format(&alloc->planes[0], bottom->fourcc) || !config_ok(alloc, layers, count, base, flags)) {
+        bottom->plane = -1;
+        return 0;
+    }
+
+    // Greedy from the bottom up: each layer takes the lowest plane above the
+    // previous one the kernel accepts, so the hardware stacking matches zorder
+    int offloaded = 1;
+    int next_plane = 1;
+    for (int k = 1; k < count; k++) {
+        struct plane_layer *layer = &layers[order[k]];
+
+        for (int p = next_plane; p < alloc->count; p++) {
+            if (!hw_plane_has_format(&alloc->planes[p], layer->fourcc))
+                continue;
+            layer->plane = p;
+            if (config_ok(alloc, layers, count, base, flags)) {
+                next_plane = p + 1;
+                offloaded++;
+                break;
+            }
+            layer->plane = -1;
+        }
+        if (layer->plane >= 0)
+            continue;
+
+        // Composited into the bottom buffer, i.e. below every plane: layers
+        // it covers cannot stay on planes above it
+        offloaded -= demote_covered(layers, order, k);
+    }
+
+    // Demotions change the configuration; normally a memo hit or a subset
+    // of an accepted one, but never commit something unchecked
+    if (!config_ok(alloc, layers, count, base, flags)) {
+        for (int k = 1; k < count; k++)
+            layers[order[k]].plane = -1;
+        offloaded = 1;
+    }
+    return offloaded;
+}
+
+// zpos, alpha and blend mode of one layer. zpos must grow with zorder:
+// next_zpos is the lowest value still free above the layers below.
+static int add_blending(drmModeAtomicReq *req, const struct hw_plane *plane, const struct plane_layer *layer,
+                        uint64_t *next_zpos) {
+    const struct drm_object_props *props = &plane->props;
+
+    if (props->ids[DRM_PROP_PLANE_ZPOS]) {
+        uint64_t zpos = props->values[DRM_PROP_PLANE_ZPOS];
+        if (!drm_prop_immutable(props, DRM_PROP_PLANE_ZPOS))
+            zpos = *next_zpos > props->min[DRM_PROP_PLANE_ZPOS] ? *next_zpos : props->min[DRM_PROP_PLANE_ZPOS];
+        if (zpos < *next_zpos || !drm_prop_accepts(props, DRM_PROP_PLANE_ZPOS, zpos))
+            return -1;
+        if (!drm_prop_immutable(props, DRM_PROP_PLANE_ZPOS))
+            drm_props_add(req, props, DRM_PROP_PLANE_ZPOS, zpos);
+        *next_zpos = zpos + 1;
+    }
+
+    // Without the property a plane is opaque
+    uint64_t alpha = layer->alpha ? layer->alpha : 0xffff;
+    if (props->ids[DRM_PROP_PLANE_ALPHA]) {
+        if (!drm_prop_accepts(props, DRM_PROP_PLANE_ALPHA, alpha))
+            return -1;
+        if (!drm_prop_immutable(props, DRM_PROP_PLANE_ALPHA))
+            drm_props_add(req, props, DRM_PROP_PLANE_ALPHA, alpha);
+    } else if (alpha != 0xffff) {
+        return -1;
+    }
+
+    // Without the property alpha formats are blended pre-multiplied
+    if (layer->blend != PLANE_BLEND_DEFAULT) {
+        uint64_t mode = (uint64_t)(layer->blend - 1);
+        if (props->ids[DRM_PROP_PLANE_BLEND_MODE]) {
+            if (!drm_prop_accepts(props, DRM_PROP_PLANE_BLEND_MODE, mode))
+                return -1;
+            if (!drm_prop_immutable(props, DRM_PROP_PLANE_BLEND_MODE))
+                drm_props_add(req, props, DRM_PROP_PLANE_BLEND_MODE, mode);
+        } else if (layer->blend != PLANE_BLEND_PREMULTIPLIED) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int plane_alloc_add(const struct plane_alloc *alloc, drmModeAtomicReq *req,
+                    const struct plane_layer *layers, int count) {
+    int used[PLANE_ALLOC_MAX_PLANES] = {0};
+    int order[PLANE_ALLOC_MAX_LAYERS];
+    uint64_t next_zpos = 0;
+    int ret = 0;
+
+    if (count > PLANE_ALLOC_MAX_LAYERS)
+        count = PLANE_ALLOC_MAX_LAYERS;
+    sort_by_zorder(layers, count, order);
+
+    for (int k = 0; k < count; k++) {
+        const struct plane_layer *layer = &layers[order[k]];
+        if (layer->plane < 0)
+            continue;
+        const struct hw_plane *plane = &alloc->planes[layer->plane];
+        const struct drm_object_props *props = &plane->props;
+        used[layer->plane] = 1;
+
+        if (drm_props_add(req, props, DRM_PROP_PLANE_FB_ID, layer->fb_id) < 0 ||
+            drm_props_add(req, props, DRM_PROP_PLANE_CRTC_ID, alloc->crtc_id) < 0 ||
+            drm_props_add(req, props, DRM_PROP_PLANE_SRC_X, 0) < 0 ||
+            drm_props_add(req, props, DRM_PROP_PLANE_SRC_Y, 0) < 0 ||
+            drm_props_add(req, props, DRM_PROP_PLANE_SRC_W, (uint64_t)layer->src_w << 16) < 0 ||
+            drm_props_add(req, props, DRM_PROP_PLANE_SRC_H, (uint64_t)layer->src_h << 16) < 0 ||
+            drm_props_add(req, props, DRM_PROP_PLANE_CRTC_X, (uint64_t)(int64_t)layer->x) < 0 ||
+            drm_props_add(req, props, DRM_PROP_PLANE_CRTC_Y, (uint64_t)(int64_t)layer->y) < 0 ||
+            drm_props_add(req, props, DRM_PROP_PLANE_CRTC_W, layer->w) < 0 ||
+            drm_props_add(req, props, DRM_PROP_PLANE_CRTC_H, layer->h) < 0 ||
+            add_blending(req, plane, layer, &next_zpos) < 0)
+            ret = -1;
+    }
+
+    // Planes another CRTC is using are left alone
+    for (int p = 0; p < alloc->count; p++) {
+        const struct hw_plane *plane = &alloc->planes[p];
+        if (used[p] || (plane->initial_crtc && plane->initial_crtc != alloc->crtc_id))
+            continue;
+        drm_props_add(req, &plane->props, DRM_PROP_PLANE_FB_ID, 0);
+        drm_props_add(req, &plane->props, DRM_PROP_PLANE_CRTC_ID, 0);
+    }
+    return ret;
+}
+
+static const char *type_name(int type) {
+    switch (type) {
+    case DRM_PLANE_TYPE_PRIMARY:
+        return "primary";
+    case DRM_PLANE_TYPE_OVERLAY:
+        return "overlay";
+    case DRM_PLANE_TYPE_CURSOR:
+        return "cursor";
+    default:
+        return "unknown";
+    }
+}
+
+// ", zpos 1-255, alpha, blend 0x7": what the plane offers for blending
+static void describe_blending(const struct hw_plane *plane, char *buf, size_t size) {
+    const struct drm_object_props *props = &plane->props;
+    int len = 0;
+
+    buf[0] = '\0';
+    if (props->ids[DRM_PROP_PLANE_ZPOS] && drm_prop_immutable(props, DRM_PROP_PLANE_ZPOS))
+        len += snprintf(buf + len, size - len, ", zpos %llu fixed",
+                        (unsigned long long)props->values[DRM_PROP_PLANE_ZPOS]);
+    else if (props->ids[DRM_PROP_PLANE_ZPOS])
+        len += snprintf(buf + len, size - len, ", zpos %llu-%llu", (unsigned long long)props->min[DRM_PROP_PLANE_ZPOS],
+                        (unsigned long long)props->max[DRM_PROP_PLANE_ZPOS]);
+    if (props->ids[DRM_PROP_PLANE_ALPHA] && len < (int)size)
+        len += snprintf(buf + len, size - len, ", alpha");
+    if (props->ids[DRM_PROP_PLANE_BLEND_MODE] && len < (int)size)
+        snprintf(buf + len, size - len, ", blend modes 0x%llx",
+                 (unsigned long long)props->enum_mask[DRM_PROP_PLANE_BLEND_MODE]);
+}
+
+void plane_alloc_print(const struct plane_alloc *alloc, const struct plane_layer *layers, int count) {
+    int composited = 0;
+
+    for (int i = 0; i < count; i++) {
+        const struct plane_layer *layer = &layers[i];
+        if (layer->plane >= 0) {
+            const struct hw_plane *plane = &alloc->planes[layer->plane];
+            char blending[96];
+            describe_blending(plane, blending, sizeof(blending));
+            printf("[PLANES]   : layer %d (%ux%u at %d,%d) -> plane %u (%s%s)\n", i, layer->w, layer->h,
+                   layer->x, layer->y, plane->id, type_name(plane->type), blending);
+        } else {
+            printf("[PLANES]   : layer %d (%ux%u at %d,%d) -> not offloaded, composited\n", i, layer->w,
+                   layer->h, layer->x, layer->y);
+            composited++;
+        }
+    }
+    printf("[PLANES]   : %d of %d layers on hardware planes, %d composited\n", count - composited, count,
+           composited);
+}
+
+void plane_alloc_print_stats(const struct plane_alloc *alloc) {
+    printf("[PLANES]   : %u TEST_ONLY commits, %u answered from memo\n", alloc->tests, alloc->memo_hits);
+}
@@ -0,0 +1,121 @@
+#ifndef PLANE_ALLOC_H
+#define PLANE_ALLOC_H
+
+#include <stdint.h>
+
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#include "drm_props.h"
+
+#define PLANE_ALLOC_MAX_PLANES 16
+#define PLANE_ALLOC_MAX_LAYERS 8
+#define PLANE_ALLOC_MAX_FORMATS 64
+#define PLANE_ALLOC_MEMO_SIZE 64
+
+// One hardware plane usable on the allocator's CRTC
+struct hw_plane {
+    uint32_t id;
+    int type;                   // DRM_PLANE_TYPE_*
+    uint32_t initial_crtc;      // CRTC the plane was on at startup, 0 if off
+    uint32_t formats[PLANE_ALLOC_MAX_FORMATS];
+    int count_formats;
+    struct drm_object_props props;
+};
+
+// How a layer's pixels combine with what is below (the kernel's "pixel
+// blend mode" values plus one). DEFAULT leaves the plane's setting alone.
+enum plane_blend {
+    PLANE_BLEND_DEFAULT,
+    PLANE_BLEND_NONE,           // alpha channel ignored
+    PLANE_BLEND_PREMULTIPLIED,  // colour already multiplied by alpha
+    PLANE_BLEND_COVERAGE,       // straight alpha
+};
+
+// Something to show: an FB placed at a CRTC rectangle. Layers with a higher
+// zorder are above. plane is the allocator's answer: an index into
+// plane_alloc.planes, or -1 if the layer has to be composited into the
+// bottom layer's buffer by the caller.
+struct plane_layer {
+    uint32_t fb_id;
+    uint32_t fourcc;
+    uint64_t modifier;          // DRM_FORMAT_MOD_INVALID if implicit
+    uint32_t src_w;             // FB area shown, in pixels
+    uint32_t src_h;
+    int32_t x;                  // CRTC rectangle
+    int32_t y;
+    uint32_t w;
+    uint32_t h;
+    int zorder;
+    uint16_t alpha;             // plane-wide opacity, 0xffff (or 0, unset) opaque
+    int blend;                  // enum plane_blend
+    int plane;
+};
+
+// Configurations the kernel has already judged, keyed by a hash of the
+// plane assignment, geometry and commit flags (not the FB IDs, so results
+// carry over between frames with the same layout). The contents of the base
+// request are not part of the key: see plane_alloc_reset_memo().
+struct plane_memo {
+    uint64_t key;
+    int result;                 // 1 accepted, -1 rejected, 0 empty slot
+};
+
+// Assigns layers to the primary, overlay and cursor planes of one CRTC,
+// checking every candidate with a DRM_MODE_ATOMIC_TEST_ONLY commit. Planes
+// are stacked by their zpos where the driver has one, else primary <
+// overlays (in plane ID order) < cursor. A plane only takes a layer if its
+// zpos, alpha and blend mode properties (range, enum values, immutable)
+// allow what the layer asks for.
+struct plane_alloc {
+    int drm_fd;
+    uint32_t crtc_id;
+    int count;
+    struct hw_plane planes[PLANE_ALLOC_MAX_PLANES];
+    struct plane_memo memo[PLANE_ALLOC_MEMO_SIZE];
+
+    // Counters
+    unsigned int tests;         // TEST_ONLY commits issued
+    unsigned int memo_hits;     // probes answered from the memo
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Collect every plane that can feed crtc_id (crtc_index in the resource list)
+int plane_alloc_init(struct plane_alloc *alloc, int drm_fd, uint32_t crtc_id, int crtc_index);
+
+// Find a plane for as many layers as possible. base (may be NULL) holds the
+// rest of the state the commit will carry, e.g. a modeset, and flags are
+// its commit flags (ALLOW_MODESET); both are used for the TEST_ONLY probes.
+// The bottom layer always gets the primary plane. Returns the number of
+// layers on planes (0 if not even the bottom layer fits), and sets
+// layers[i].plane.
+int plane_alloc_assign(struct plane_alloc *alloc, struct plane_layer *layers, int count,
+                       drmModeAtomicReq *base, uint32_t flags);
+
+// Forget every memoized TEST_ONLY result. The memo assumes the same base
+// state on every probe; call this before an assign with a different base
+// (e.g. flip-only probes after the modeset, or another mode).
+void plane_alloc_reset_memo(struct plane_alloc *alloc);
+
+// Add the assigned layers to req, with a zpos increasing with zorder, alpha
+// and blend mode, and switch off this CRTC's unused planes. Returns -1 if
+// a plane cannot be set up as its layer needs.
+int plane_alloc_add(const struct plane_alloc *alloc, drmModeAtomicReq *req,
+                    const struct plane_layer *layers, int count);
+
+// Print which plane each layer went to and which are left for composition
+void plane_alloc_print(const struct plane_alloc *alloc, const struct plane_layer *layers, int count);
+
+void plane_alloc_print_stats(const struct plane_alloc *alloc);
+
+// True if the plane can scan out fourcc
+int hw_plane_has_format(const struct hw_plane *plane, uint32_t fourcc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PLANE_ALLOC_H
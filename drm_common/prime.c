@@ -0,0 +1,188 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <gbm.h>
+#include <drm_fourcc.h>
+
+#include "prime.h"
+
+static void gem_close(int drm_fd, uint32_t handle) {
+    struct drm_gem_close close_req = { .handle = handle };
+    if (drmIoctl(drm_fd, DRM_IOCTL_GEM_CLOSE, &close_req) < 0)
+        perror("DRM_IOCTL_GEM_CLOSE failed");
+}
+
+static void free_buffer(struct prime_device *prime, struct prime_buffer *buf) {
+    if (buf->dmabuf_fd >= 0)
+        close(buf->dmabuf_fd);
+    if (buf->bo)
+        gbm_bo_destroy(buf->bo);
+    if (buf->render_handle) {
+        struct drm_mode_destroy_dumb destroy = { .handle = buf->render_handle };
+        drmIoctl(prime->render_fd, DRM_IOCTL_MODE_DESTROY_DUMB, &destroy);
+    }
+    free(buf);
+}
+
+// Linear buffer on the render device, exported as a dma-buf
+static int alloc_on_render(struct prime_device *prime, const struct fb_key *key, struct prime_buffer *buf,
+                           uint32_t *pitch, uint32_t *offset) {
+    *offset = 0;
+    if (prime->gbm) {
+        buf->bo = gbm_bo_create(prime->gbm, key->width, key->height, key->fourcc,
+                                GBM_BO_USE_RENDERING | GBM_BO_USE_LINEAR);
+        if (!buf->bo) {
+            fprintf(stderr, "gbm_bo_create (linear) failed on the render device\n");
+            return -1;
+        }
+        *pitch = gbm_bo_get_stride(buf->bo);
+        *offset = gbm_bo_get_offset(buf->bo, 0);
+        buf->dmabuf_fd = gbm_bo_get_fd(buf->bo);
+    } else {
+        struct drm_mode_create_dumb create = { .width = key->width, .height = key->height, .bpp = 32 };
+        if (drmIoctl(prime->render_fd, DRM_IOCTL_MODE_CREATE_DUMB, &create) < 0) {
+            perror("DRM_IOCTL_MODE_CREATE_DUMB failed on the render device");
+            return -1;
+        }
+        buf->render_handle = create.handle;
+        *pitch = create.pitch;
+        if (drmPrimeHandleToFD(prime->render_fd, create.handle, DRM_CLOEXEC | DRM_RDWR, &buf->dmabuf_fd) != 0)
+            buf->dmabuf_fd = -1;
+    }
+    if (buf->dmabuf_fd < 0) {
+        fprintf(stderr, "Failed to export a dma-buf from the render device\n");
+        return -1;
+    }
+    prime->exported++;
+    return 0;
+}
+
+static int render_alloc(struct fb_pool *pool, struct fb_pool_entry *entry) {
+    struct prime_device *prime = pool->backend_data;
+    uint32_t pitch, offset;
+
+    if (entry->key.modifier != DRM_FORMAT_MOD_INVALID && entry->key.modifier != DRM_FORMAT_MOD_LINEAR) {
+        fprintf(stderr, "PRIME buffers are always linear\n");
+        return -1;
+    }
+
+    struct prime_buffer *buf = calloc(1, sizeof(*buf));
+    if (!buf) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+    buf->dmabuf_fd = -1;
+
+    if (alloc_on_render(prime, &entry->key, buf, &pitch, &offset) != 0) {
+        free_buffer(prime, buf);
+        return -1;
+    }
+    if (drmPrimeFDToHandle(pool->drm_fd, buf->dmabuf_fd, &entry->handles[0]) != 0) {
+        perror("drmPrimeFDToHandle failed");
+        free_buffer(prime, buf);
+        return -1;
+    }
+    prime->imported++;
+
+    entry->modifier = entry->key.modifier;
+    entry->num_planes = 1;
+    entry->pitches[0] = pitch;
+    entry->offsets[0] = offset;
+    entry->size = pitch * entry->key.height;
+    entry->bo = buf;
+    return 0;
+}
+
+static void render_free(struct fb_pool *pool, struct fb_pool_entry *entry) {
+    gem_close(pool->drm_fd, entry->handles[0]);
+    free_buffer(pool->backend_data, entry->bo);
+}
+
+const struct fb_pool_backend prime_render_alloc_backend = {
+    .name = "prime (render device)",
+    .alloc = render_alloc,
+    .free = render_free,
+};
+
+// Scanout-capable dumb buffer of the KMS device, exported for GL
+static int display_alloc(struct fb_pool *pool, struct fb_pool_entry *entry) {
+    struct prime_device *prime = pool->backend_data;
+
+    struct prime_buffer *buf = calloc(1, sizeof(*buf));
+    if (!buf) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+    if (fb_pool_dumb_backend.alloc(pool, entry) != 0) {
+        free(buf);
+        return -1;
+    }
+    if (drmPrimeHandleToFD(pool->drm_fd, entry->handles[0], DRM_CLOEXEC | DRM_RDWR, &buf->dmabuf_fd) != 0) {
+        perror("drmPrimeHandleToFD failed");
+        fb_pool_dumb_backend.free(pool, entry);
+        free(buf);
+        return -1;
+    }
+    prime->exported++;
+    entry->bo = buf;
+    return 0;
+}
+
+static void display_free(struct fb_pool *pool, struct fb_pool_entry *entry) {
+    struct prime_buffer *buf = entry->bo;
+
+    close(buf->dmabuf_fd);
+    free(buf);
+    entry->bo = NULL;
+    fb_pool_dumb_backend.free(pool, entry);
+}
+
+const struct fb_pool_backend prime_display_alloc_backend = {
+    .name = "prime (KMS device)",
+    .alloc = display_alloc,
+    .free = display_free,
+};
+
+int prime_device_init(struct prime_device *prime, int kms_fd, const char *render_path) {
+    memset(prime, 0, sizeof(*prime));
+    prime->kms_fd = kms_fd;
+    prime->render_fd = open(render_path, O_RDWR | O_CLOEXEC);
+    if (prime->render_fd < 0) {
+        perror("Failed to open the render device");
+        return -1;
+    }
+
+    // No GBM driver (vgem): fall back to the device's dumb buffers
+    prime->gbm = gbm_create_device(prime->render_fd);
+    printf("[PRIME]    : allocating on %s with %s\n", render_path, prime->gbm ? "GBM" : "dumb buffers");
+    return 0;
+}
+
+void prime_device_destroy(struct prime_device *prime) {
+    if (prime->gbm)
+        gbm_device_destroy(prime->gbm);
+    if (prime->render_fd >= 0)
+        close(prime->render_fd);
+    prime->gbm = NULL;
+    prime->render_fd = -1;
+}
+
+const char *prime_strategy_name(enum prime_strategy strategy) {
+    switch (strategy) {
+    case PRIME_RENDER_ALLOC:
+        return "render device buffers imported into KMS (zero copy)";
+    case PRIME_DISPLAY_ALLOC:
+        return "KMS buffers imported into GL (zero copy)";
+    case PRIME_COPY:
+        return "glReadPixels into KMS dumb buffers (CPU copy)";
+    }
+    return "?";
+}
+
+void prime_print_stats(const struct prime_device *prime, enum prime_strategy strategy) {
+    printf("[PRIME]    : %s, %u dma-bufs exported, %u imported into KMS\n", prime_strategy_name(strategy),
+           prime->exported, prime->imported);
+}
@@ -0,0 +1,82 @@
+#ifndef PRIME_H
+#define PRIME_H
+
+#include <stdint.h>
+
+#include "fb_pool.h"
+
+struct gbm_device;
+struct gbm_bo;
+
+// Rendering on one device and scanning out on another (a SoC display
+// controller next to a separate GPU, or VKMS fed by llvmpipe). Frames cross
+// between the devices as dma-bufs (PRIME). Strategies, cheapest first:
+//
+//   PRIME_RENDER_ALLOC   linear buffers allocated on the render device and
+//                        imported into the KMS device with drmPrimeFDToHandle:
+//                        the GPU draws straight into what is scanned out
+//   PRIME_DISPLAY_ALLOC  dumb buffers allocated on the KMS device, exported
+//                        with drmPrimeHandleToFD and imported into GL: no copy
+//                        either, for display controllers that can only scan
+//                        out memory they allocated (e.g. contiguous)
+//   PRIME_COPY           nothing shared: glReadPixels into a dumb buffer,
+//                        one CPU copy per frame
+//
+// Whether a zero-copy strategy works depends on the pair of devices (the
+// import is refused, the plane rejects the buffer, GL cannot import the
+// dma-buf), so the caller tries them in this order and keeps the first one
+// that works end to end.
+enum prime_strategy {
+    PRIME_RENDER_ALLOC,
+    PRIME_DISPLAY_ALLOC,
+    PRIME_COPY,
+};
+
+// The device buffers are allocated on for PRIME_RENDER_ALLOC: a render node
+// through GBM, or, where GBM has no driver for it (vgem), dumb buffers on
+// its card node
+struct prime_device {
+    int kms_fd;
+    int render_fd;
+    struct gbm_device *gbm;     // NULL: dumb buffers on render_fd
+
+    // Counters
+    unsigned int exported;      // dma-bufs handed out (gbm_bo_get_fd / drmPrimeHandleToFD)
+    unsigned int imported;      // drmPrimeFDToHandle into the KMS device
+};
+
+// entry->bo of the PRIME pool backends
+struct prime_buffer {
+    struct gbm_bo *bo;          // render device bo, NULL if none
+    uint32_t render_handle;     // dumb buffer on render_fd, 0 if none
+    int dmabuf_fd;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Pool backends, backend_data = struct prime_device. Single-plane 32 bpp
+// linear buffers; the dma-buf stays open for the life of the entry.
+extern const struct fb_pool_backend prime_render_alloc_backend;
+extern const struct fb_pool_backend prime_display_alloc_backend;
+
+// Open render_path (e.g. /dev/dri/renderD128, or vgem's /dev/dri/cardN) as
+// the allocation device. Returns 0, -1 on error.
+int prime_device_init(struct prime_device *prime, int kms_fd, const char *render_path);
+void prime_device_destroy(struct prime_device *prime);
+
+// dma-buf of an entry from a PRIME backend, owned by the entry
+static inline int prime_buffer_fd(const struct fb_pool_entry *entry) {
+    return ((const struct prime_buffer *)entry->bo)->dmabuf_fd;
+}
+
+const char *prime_strategy_name(enum prime_strategy strategy);
+
+void prime_print_stats(const struct prime_device *prime, enum prime_strategy strategy);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PRIME_H
@@ -0,0 +1,170 @@
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sprite.h"
+
+void sprite_engine_init(struct sprite_engine *engine, int drm_fd, drmEventContext *evctx, uint32_t crtc_w,
+                        uint32_t crtc_h) {
+    memset(engine, 0, sizeof(*engine));
+    engine->drm_fd = drm_fd;
+    engine->evctx = evctx;
+    engine->crtc_w = crtc_w;
+    engine->crtc_h = crtc_h;
+    latency_stats_reset(&engine->commit_time);
+}
+
+struct sprite *sprite_engine_add(struct sprite_engine *engine, const struct sprite *sprite) {
+    if (engine->count == SPRITE_MAX) {
+        fprintf(stderr, "Sprite engine full (%d sprites)\n", SPRITE_MAX);
+        return NULL;
+    }
+
+    struct sprite *s = &engine->sprites[engine->count++];
+    *s = *sprite;
+    s->shown_x = s->x;
+    s->shown_y = s->y;
+    s->shown_src_x = s->src_x;
+    s->shown_src_y = s->src_y;
+    return s;
+}
+
+// Reflect pos back into [0, limit - size] and flip the velocity on a hit
+static void bounce(int32_t *pos, int32_t *velocity, uint32_t size, uint32_t limit) {
+    int32_t max = (int32_t)limit - (int32_t)size;
+    if (max <= 0) {
+        *pos = 0;
+        return;
+    }
+
+    *pos += *velocity;
+    if (*pos < 0) {
+        *pos = -*pos;
+        *velocity = -*velocity;
+    } else if (*pos > max) {
+        *pos = 2 * max - *pos;
+        *velocity = -*velocity;
+    }
+}
+
+// Move the crop origin by step, wrapping within the FB
+static void scroll(uint32_t *origin, int32_t step, uint32_t size, uint32_t fb_size) {
+    int64_t range = (int64_t)fb_size - size + 1;
+    if (range <= 1 || step == 0)
+        return;
+
+    int64_t next = ((int64_t)*origin + step) % range;
+    *origin = (uint32_t)(next < 0 ? next + range : next);
+}
+
+void sprite_engine_step(struct sprite_engine *engine) {
+    for (int i = 0; i < engine->count; i++) {
+        struct sprite *s = &engine->sprites[i];
+        bounce(&s->x, &s->vx, s->w, engine->crtc_w);
+        bounce(&s->y, &s->vy, s->h, engine->crtc_h);
+        scroll(&s->src_x, s->scroll_x, s->w, s->fb_w);
+        scroll(&s->src_y, s->scroll_y, s->h, s->fb_h);
+    }
+    engine->frames++;
+}
+
+void sprite_flip_handler(int fd, unsigned int sequence, unsigned int tv_sec, unsigned int tv_usec,
+                         unsigned int crtc_id, void *user_data) {
+    struct sprite_engine *engine = user_data;
+
+    (void)fd;
+    (void)sequence;
+    (void)tv_sec;
+    (void)tv_usec;
+    (void)crtc_id;
+
+    engine->flip_pending = 0;
+}
+
+int sprite_engine_commit(struct sprite_engine *engine) {
+    drmModeAtomicReq *req = drmModeAtomicAlloc();
+    if (!req) {
+        fprintf(stderr, "Failed to allocate atomic request\n");
+        return -1;
+    }
+
+    // Only the properties that moved; size, FB and CRTC stay as they are
+    int props = 0;
+    for (int i = 0; i < engine->count; i++) {
+        const struct sprite *s = &engine->sprites[i];
+        if (s->x != s->shown_x) {
+            drm_props_add(req, s->plane, DRM_PROP_PLANE_CRTC_X, (uint64_t)(int64_t)s->x);
+            props++;
+        }
+        if (s->y != s->shown_y) {
+            drm_props_add(req, s->plane, DRM_PROP_PLANE_CRTC_Y, (uint64_t)(int64_t)s->y);
+            props++;
+        }
+        if (s->src_x != s->shown_src_x) {
+            drm_props_add(req, s->plane, DRM_PROP_PLANE_SRC_X, (uint64_t)s->src_x << 16);
+            props++;
+        }
+        if (s->src_y != s->shown_src_y) {
+            drm_props_add(req, s->plane, DRM_PROP_PLANE_SRC_Y, (uint64_t)s->src_y << 16);
+            props++;
+        }
+    }
+
+    if (props == 0) {
+        engine->idle_frames++;
+        drmModeAtomicFree(req);
+        return 0;
+    }
+
+    double start = now_ms();
+    int ret = drmModeAtomicCommit(engine->drm_fd, req, DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT, engine);
+    drmModeAtomicFree(req);
+    if (ret < 0) {
+        perror("drmModeAtomicCommit (sprites) failed");
+        return -1;
+    }
+    latency_stats_add(&engine->commit_time, now_ms() - start);
+
+    for (int i = 0; i < engine->count; i++) {
+        struct sprite *s = &engine->sprites[i];
+        s->shown_x = s->x;
+        s->shown_y = s->y;
+        s->shown_src_x = s->src_x;
+        s->shown_src_y = s->src_y;
+    }
+    engine->flip_pending = 1;
+    engine->commits++;
+    engine->props += props;
+    return 0;
+}
+
+int sprite_engine_wait(struct sprite_engine *engine, int timeout_ms) {
+    struct pollfd pfd = { .fd = engine->drm_fd, .events = POLLIN };
+
+    while (engine->flip_pending) {
+        int ret = poll(&pfd, 1, timeout_ms);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("poll on DRM fd failed");
+            return -1;
+        }
+        if (ret == 0) {
+            fprintf(stderr, "Timed out waiting for sprite flip\n");
+            return -1;
+        }
+        if (drmHandleEvent(engine->drm_fd, engine->evctx) != 0 && errno != EAGAIN) {
+            perror("drmHandleEvent failed");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void sprite_engine_print_stats(const struct sprite_engine *engine) {
+    printf("[SPRITES]  : %u frames, %u commits (%.1f properties each), %u frames without motion\n",
+           engine->frames, engine->commits, engine->commits ? (double)engine->props / engine->commits : 0.0,
+           engine->idle_frames);
+    latency_stats_print("sprite commit", &engine->commit_time);
+}
@@ -0,0 +1,91 @@
+#ifndef SPRITE_H
+#define SPRITE_H
+
+#include <stdint.h>
+
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#include "drm_props.h"
+#include "frame_stats.h"
+
+#define SPRITE_MAX 8
+
+// Static content that only moves (tickers, pointers, picture-in-picture)
+// shown on its own plane. Each frame only the plane's CRTC_X/Y and SRC_X/Y
+// change; the pixels are never touched again.
+struct sprite {
+    const struct drm_object_props *plane;
+    int32_t x;                  // CRTC position
+    int32_t y;
+    uint32_t w;                 // size on screen = crop window size
+    uint32_t h;
+    uint32_t src_x;             // crop window origin in the FB, in pixels
+    uint32_t src_y;
+    uint32_t fb_w;              // the crop window stays inside the FB
+    uint32_t fb_h;
+    int32_t vx;                 // pixels per frame, bouncing off the CRTC edges
+    int32_t vy;
+    int32_t scroll_x;           // crop window pixels per frame, wrapping in the FB
+    int32_t scroll_y;
+
+    // What the display has now, so commits only carry what changed
+    int32_t shown_x;
+    int32_t shown_y;
+    uint32_t shown_src_x;
+    uint32_t shown_src_y;
+};
+
+struct sprite_engine {
+    int drm_fd;
+    drmEventContext *evctx;     // the caller's, see sprite_engine_init()
+    uint32_t crtc_w;
+    uint32_t crtc_h;
+    struct sprite sprites[SPRITE_MAX];
+    int count;
+    int flip_pending;
+
+    // Counters
+    unsigned int frames;
+    unsigned int commits;
+    unsigned int props;         // properties sent over all commits
+    unsigned int idle_frames;   // nothing moved, no commit
+    struct latency_stats commit_time;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Flip events are read through evctx, the caller's context for the shared
+// DRM fd: its page_flip_handler2 has to hand the events whose user_data is
+// the engine to sprite_flip_handler(). NULL if the engine never commits.
+void sprite_engine_init(struct sprite_engine *engine, int drm_fd, drmEventContext *evctx, uint32_t crtc_w,
+                        uint32_t crtc_h);
+
+// Register a sprite whose plane is already set up (FB, CRTC, size) at the
+// sprite's initial position and crop. Returns the sprite, NULL if full.
+struct sprite *sprite_engine_add(struct sprite_engine *engine, const struct sprite *sprite);
+
+// Advance every sprite by one frame of motion
+void sprite_engine_step(struct sprite_engine *engine);
+
+// Nonblocking commit of the changed positions and crop windows, completed
+// by a page-flip event. Returns 0 (also when nothing changed), -1 on error.
+int sprite_engine_commit(struct sprite_engine *engine);
+
+// Block until the last commit's flip event arrived
+int sprite_engine_wait(struct sprite_engine *engine, int timeout_ms);
+
+// Page-flip handler for drmEventContext.page_flip_handler2; user_data is the
+// engine
+void sprite_flip_handler(int fd, unsigned int sequence, unsigned int tv_sec, unsigned int tv_usec,
+                         unsigned int crtc_id, void *user_data);
+
+void sprite_engine_print_stats(const struct sprite_engine *engine);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SPRITE_H
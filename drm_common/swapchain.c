@@ -0,0 +1,108 @@
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "swapchain.h"
+
+int swapchain_init(struct swapchain *sc, int drm_fd, int count) {
+    if (count < SWAPCHAIN_MIN_BUFFERS || count > SWAPCHAIN_MAX_BUFFERS) {
+        fprintf(stderr, "Swapchain needs %d-%d buffers (got %d)\n",
+                SWAPCHAIN_MIN_BUFFERS, SWAPCHAIN_MAX_BUFFERS, count);
+        return -1;
+    }
+
+    memset(sc, 0, sizeof(*sc));
+    sc->drm_fd = drm_fd;
+    sc->count = count;
+    sc->queued = -1;
+    sc->scanout = -1;
+    for (int i = 0; i < SWAPCHAIN_MAX_BUFFERS; i++) {
+        sc->buffers[i].render_target = -1;
+        sc->buffers[i].release_fence = -1;
+    }
+    return 0;
+}
+
+struct swap_buffer *swapchain_acquire(struct swapchain *sc) {
+    for (int i = 0; i < sc->count; i++) {
+        if (sc->buffers[i].state == SWAP_BUFFER_FREE) {
+            sc->buffers[i].state = SWAP_BUFFER_RENDERING;
+            return &sc->buffers[i];
+        }
+    }
+    return NULL;
+}
+
+void swapchain_queue(struct swapchain *sc, struct swap_buffer *buf) {
+    buf->state = SWAP_BUFFER_QUEUED;
+    sc->queued = (int)(buf - sc->buffers);
+
+    // Explicit sync: reuse is gated by the out-fence, not by the flip event
+    if (sc->scanout >= 0 && sc->buffers[sc->scanout].release_fence >= 0) {
+        sc->buffers[sc->scanout].state = SWAP_BUFFER_FREE;
+        sc->scanout = -1;
+    }
+}
+
+void swapchain_present_now(struct swapchain *sc, struct swap_buffer *buf) {
+    if (sc->scanout >= 0)
+        sc->buffers[sc->scanout].state = SWAP_BUFFER_FREE;
+
+    buf->state = SWAP_BUFFER_SCANOUT;
+    sc->scanout = (int)(buf - sc->buffers);
+}
+
+void swapchain_page_flip_handler(int fd, unsigned int sequence, unsigned int tv_sec,
+                                 unsigned int tv_usec, unsigned int crtc_id, void *user_data) {
+    struct swapchain *sc = user_data;
+
+    (void)fd;
+    (void)crtc_id;
+
+    if (sc->queued < 0) {
+        fprintf(stderr, "Page flip event without a queued buffer\n");
+        return;
+    }
+
+    // The queued buffer is now on screen; the one it replaced can be reused
+    swapchain_present_now(sc, &sc->buffers[sc->queued]);
+    sc->queued = -1;
+    sc->flips++;
+    sc->sequence = sequence;
+    sc->flip_time_ms = tv_sec * 1000.0 + tv_usec / 1000.0;
+}
+
+int swapchain_dispatch(struct swapchain *sc) {
+    drmEventContext evctx = {
+        .version = 3,
+        .page_flip_handler2 = swapchain_page_flip_handler,
+    };
+
+    if (drmHandleEvent(sc->drm_fd, &evctx) != 0 && errno != EAGAIN) {
+        perror("drmHandleEvent failed");
+        return -1;
+    }
+    return 0;
+}
+
+int swapchain_wait_flip(struct swapchain *sc, int timeout_ms) {
+    struct pollfd pfd = { .fd = sc->drm_fd, .events = POLLIN };
+
+    while (swapchain_flip_pending(sc)) {
+        int ret = poll(&pfd, 1, timeout_ms);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("poll on DRM fd failed");
+            return -1;
+        }
+        if (ret == 0) {
+            fprintf(stderr, "Timed out waiting for page flip\n");
+            return -1;
+        }
+        if (swapchain_dispatch(sc) != 0)
+            return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,93 @@
+#ifndef SWAPCHAIN_H
+#define SWAPCHAIN_H
+
+#include <stdint.h>
+
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#define SWAPCHAIN_MIN_BUFFERS 2
+#define SWAPCHAIN_MAX_BUFFERS 4
+
+// Life cycle of a swapchain buffer:
+//   FREE -> RENDERING (acquire) -> QUEUED (flip committed) -> SCANOUT (flip event)
+//   -> FREE (the next flip event replaced it on screen)
+// With explicit sync the buffer being replaced goes back to FREE as soon as
+// the replacing flip is queued: its release_fence (the commit's OUT_FENCE_PTR)
+// signals when the display stops reading it, and the renderer makes the GPU
+// wait on that fence instead of waiting for the flip event.
+enum swap_buffer_state {
+    SWAP_BUFFER_FREE,
+    SWAP_BUFFER_RENDERING,
+    SWAP_BUFFER_QUEUED,
+    SWAP_BUFFER_SCANOUT,
+};
+
+struct swap_buffer {
+    uint32_t fb_id;
+    uint32_t handle;    // GEM handle
+    uint32_t pitch;
+    uint32_t size;
+    uint8_t *map;       // CPU mapping, NULL if the buffer is not mapped
+    uint32_t map_pitch; // row pitch of map (a staged gbm_bo_map may differ from pitch)
+    void *bo;           // backend object (e.g. struct gbm_bo), may be NULL
+    void *map_data;     // backend mapping cookie (e.g. gbm_bo_map), may be NULL
+    void *owner;        // allocator entry backing the buffer (struct fb_pool_entry), may be NULL
+    int render_target;  // GPU render target wrapping this buffer, -1 if none
+    int release_fence;  // sync_file fd signalled when scanout stops reading, -1 if none
+    enum swap_buffer_state state;
+};
+
+// N framebuffers for one CRTC. KMS allows a single flip in flight per CRTC,
+// so at any time there is at most one QUEUED and one SCANOUT buffer and the
+// remaining N - 2 are available for rendering.
+struct swapchain {
+    int drm_fd;
+    int count;
+    struct swap_buffer buffers[SWAPCHAIN_MAX_BUFFERS];
+    int queued;                 // index of the buffer waiting for its flip, -1 if none
+    int scanout;                // index of the buffer on screen, -1 if none
+    unsigned int flips;         // completed page flips
+    unsigned int sequence;      // vblank sequence of the last flip
+    double flip_time_ms;        // CLOCK_MONOTONIC timestamp of the last flip
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Reset state for count buffers; the caller fills buffers[i] with its framebuffers
+int swapchain_init(struct swapchain *sc, int drm_fd, int count);
+
+// Take a FREE buffer for rendering. Returns NULL when every buffer is busy.
+struct swap_buffer *swapchain_acquire(struct swapchain *sc);
+
+// Mark buf as committed with DRM_MODE_PAGE_FLIP_EVENT and user_data = sc.
+// If the buffer on screen was given a release_fence for this commit, it is
+// returned to FREE right away.
+void swapchain_queue(struct swapchain *sc, struct swap_buffer *buf);
+
+// Mark buf as on screen right away (after a blocking modeset, no event follows)
+void swapchain_present_now(struct swapchain *sc, struct swap_buffer *buf);
+
+// True while a committed flip has not completed yet
+static inline int swapchain_flip_pending(const struct swapchain *sc) {
+    return sc->queued >= 0;
+}
+
+// Read and dispatch pending DRM events without blocking.
+int swapchain_dispatch(struct swapchain *sc);
+
+// Block until the pending flip completes (or timeout_ms elapses, -1 = forever).
+// Returns 0 when no flip is pending anymore, -1 on error or timeout.
+int swapchain_wait_flip(struct swapchain *sc, int timeout_ms);
+
+// Page-flip handler for drmEventContext.page_flip_handler2; user_data is the swapchain
+void swapchain_page_flip_handler(int fd, unsigned int sequence, unsigned int tv_sec,
+                                 unsigned int tv_usec, unsigned int crtc_id, void *user_data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SWAPCHAIN_H
@@ -0,0 +1,90 @@
+#include <stdio.h>
+
+#include "frame_stats.h"
+#include "takeover.h"
+
+int takeover_mode_equal(const drmModeModeInfo *a, const drmModeModeInfo *b) {
+    return a->clock == b->clock &&
+           a->hdisplay == b->hdisplay && a->hsync_start == b->hsync_start && a->hsync_end == b->hsync_end &&
+           a->htotal == b->htotal && a->hskew == b->hskew &&
+           a->vdisplay == b->vdisplay && a->vsync_start == b->vsync_start && a->vsync_end == b->vsync_end &&
+           a->vtotal == b->vtotal && a->vscan == b->vscan && a->flags == b->flags;
+}
+
+// Current value of a registered property, one ioctl
+static int current_value(int drm_fd, const struct drm_object_props *props, enum drm_prop prop, uint64_t *value) {
+    uint32_t prop_id = drm_prop_id(props, prop);
+    if (!prop_id)
+        return -1;
+
+    drmModeObjectProperties *obj = drmModeObjectGetProperties(drm_fd, props->obj_id, props->obj_type);
+    if (!obj)
+        return -1;
+
+    int ret = -1;
+    for (uint32_t i = 0; i < obj->count_props; i++) {
+        if (obj->props[i] == prop_id) {
+            *value = obj->prop_values[i];
+            ret = 0;
+            break;
+        }
+    }
+    drmModeFreeObjectProperties(obj);
+    return ret;
+}
+
+int takeover_check(int drm_fd, const struct drm_object_props *conn_props, const struct drm_object_props *crtc_props,
+                   const drmModeModeInfo *mode, struct takeover *state) {
+    uint64_t conn_crtc = 0, active = 0;
+
+    state->lit = 0;
+    state->current_fb_id = 0;
+
+    if (current_value(drm_fd, conn_props, DRM_PROP_CONNECTOR_CRTC_ID, &conn_crtc) != 0 ||
+        conn_crtc != crtc_props->obj_id)
+        return 0;
+    if (current_value(drm_fd, crtc_props, DRM_PROP_CRTC_ACTIVE, &active) != 0 || !active)
+        return 0;
+
+    drmModeCrtc *crtc = drmModeGetCrtc(drm_fd, crtc_props->obj_id);
+    if (!crtc)
+        return 0;
+    state->lit = crtc->mode_valid && takeover_mode_equal(&crtc->mode, mode);
+    state->current_fb_id = crtc->buffer_id;
+    drmModeFreeCrtc(crtc);
+    return state->lit;
+}
+
+int takeover_commit(int drm_fd, const struct drm_object_props *plane_props, uint32_t crtc_id,
+                    const drmModeModeInfo *mode, uint32_t fb_id) {
+    drmModeAtomicReq *req = drmModeAtomicAlloc();
+    if (!req) {
+        fprintf(stderr, "Failed to allocate atomic request\n");
+        return -1;
+    }
+
+    // The plane may have been set up differently (fbcon, another
+    // resolution's splash): program all of it, but nothing on the CRTC
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_FB_ID, fb_id);
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_CRTC_ID, crtc_id);
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_SRC_X, 0);
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_SRC_Y, 0);
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_SRC_W, mode->hdisplay << 16);
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_SRC_H, mode->vdisplay << 16);
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_CRTC_X, 0);
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_CRTC_Y, 0);
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_CRTC_W, mode->hdisplay);
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_CRTC_H, mode->vdisplay);
+
+    // Blocking: returns once the frame is on screen
+    int ret = drmModeAtomicCommit(drm_fd, req, 0, NULL);
+    drmModeAtomicFree(req);
+    return ret < 0 ? -1 : 0;
+}
+
+void takeover_report(const struct takeover *state, int modeset) {
+    printf("[TAKEOVER] : %s, first frame on screen %.3f ms after start\n",
+           modeset ? (state->lit ? "page flip refused, full modeset" : "full modeset")
+                   : "mode already lit, plain page flip",
+           now_ms() - state->start_ms);
+}
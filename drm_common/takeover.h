@@ -0,0 +1,53 @@
+#ifndef TAKEOVER_H
+#define TAKEOVER_H
+
+#include <stdint.h>
+
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#include "drm_props.h"
+
+// Flicker-free startup. The firmware (boot splash), fbcon or a previous
+// compositor usually leaves the display lit, and a full modeset to the same
+// mode still blanks it and costs hundreds of ms on real panels (link
+// training, panel power sequencing). takeover_check() reads what the kernel
+// is showing now: the connector's CRTC_ID, the CRTC's ACTIVE and its mode.
+// If that is already the requested routing and mode, takeover_commit()
+// puts the first frame up with the plane state alone, without
+// ALLOW_MODESET, like any later page flip.
+//
+// Only property IDs are taken from the registries; the current values are
+// read from the kernel, so registries loaded from a topology snapshot work.
+struct takeover {
+    double start_ms;            // now_ms() at program start, set by the caller
+    int lit;                    // connector already shown on the CRTC with the mode
+    uint32_t current_fb_id;     // FB the CRTC was scanning out, 0 if none
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Same timings and flags. The name and type bits are ignored: the
+// firmware's copy of a mode need not carry the driver's preferred flag.
+int takeover_mode_equal(const drmModeModeInfo *a, const drmModeModeInfo *b);
+
+// Fill state->lit and current_fb_id for showing mode on the CRTC of
+// crtc_props through the connector of conn_props. Returns state->lit.
+int takeover_check(int drm_fd, const struct drm_object_props *conn_props, const struct drm_object_props *crtc_props,
+                   const drmModeModeInfo *mode, struct takeover *state);
+
+// Blocking commit of fb_id on the plane, full screen on crtc_id, without
+// ALLOW_MODESET. Returns 0, -1 if the kernel wants a modeset after all.
+int takeover_commit(int drm_fd, const struct drm_object_props *plane_props, uint32_t crtc_id,
+                    const drmModeModeInfo *mode, uint32_t fb_id);
+
+// Time to first frame since state->start_ms, and how it got there
+void takeover_report(const struct takeover *state, int modeset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TAKEOVER_H
@@ -0,0 +1,301 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <drm_fourcc.h>
+
+#include "topology.h"
+
+// A connected connector waiting for a CRTC
+struct candidate {
+    drmModeConnector *conn;
+    uint32_t crtc_mask;         // CRTC indices any of its encoders can drive
+    int current;                // CRTC index it is on now, -1 if none
+};
+
+// Kuhn's augmenting path: give candidate c a CRTC, moving earlier
+// candidates to another of their CRTCs if that frees one up
+static int match(const struct candidate *cands, int c, int count_crtcs, int *crtc_owner, int *visited) {
+    for (int k = -1; k < count_crtcs; k++) {
+        // The CRTC the connector is already on is tried first
+        int i = k < 0 ? cands[c].current : k;
+        if (i < 0 || (k >= 0 && i == cands[c].current))
+            continue;
+        if (!(cands[c].crtc_mask & (1u << i)) || visited[i])
+            continue;
+
+        visited[i] = 1;
+        if (crtc_owner[i] < 0 || match(cands, crtc_owner[i], count_crtcs, crtc_owner, visited)) {
+            crtc_owner[i] = c;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int crtc_index_of(const drmModeRes *res, uint32_t crtc_id) {
+    for (int i = 0; i < res->count_crtcs; i++) {
+        if (res->crtcs[i] == crtc_id)
+            return i;
+    }
+    return -1;
+}
+
+static const drmModeModeInfo *preferred_mode(const drmModeConnector *conn) {
+    for (int i = 0; i < conn->count_modes; i++) {
+        if (conn->modes[i].type & DRM_MODE_TYPE_PREFERRED)
+            return &conn->modes[i];
+    }
+    return &conn->modes[0];
+}
+
+// Primary plane for a CRTC, preferring the one already on it
+static uint32_t find_primary(int drm_fd, const drmModePlaneRes *planes, const struct kms_output *out,
+                             const uint32_t *taken, int count_taken) {
+    uint32_t found = 0;
+
+    for (uint32_t i = 0; i < planes->count_planes; i++) {
+        int used = 0;
+        for (int t = 0; t < count_taken; t++)
+            used |= taken[t] == planes->planes[i];
+        if (used)
+            continue;
+
+        drmModePlane *plane = drmModeGetPlane(drm_fd, planes->planes[i]);
+        if (!plane)
+            continue;
+        int usable = (plane->possible_crtcs & (1u << out->crtc_index)) != 0;
+        int current = plane->crtc_id == out->crtc_id;
+        drmModeFreePlane(plane);
+        if (!usable)
+            continue;
+
+        struct drm_object_props props;
+        if (drm_props_init(drm_fd, planes->planes[i], DRM_MODE_OBJECT_PLANE, &props) != 0 ||
+            props.values[DRM_PROP_PLANE_TYPE] != DRM_PLANE_TYPE_PRIMARY)
+            continue;
+        if (current)
+            return planes->planes[i];
+        if (!found)
+            found = planes->planes[i];
+    }
+    return found;
+}
+
+// Formats of the primary plane and the modifiers it takes XRGB8888 in
+static int read_formats(int drm_fd, struct kms_output *out) {
+    drmModePlane *plane = drmModeGetPlane(drm_fd, out->plane_id);
+    if (!plane)
+        return -1;
+    out->count_formats = 0;
+    for (uint32_t i = 0; i < plane->count_formats && out->count_formats < TOPOLOGY_MAX_FORMATS; i++)
+        out->formats[out->count_formats++] = plane->formats[i];
+    drmModeFreePlane(plane);
+
+    out->count_modifiers = plane_format_modifiers(drm_fd, &out->plane_props, DRM_FORMAT_XRGB8888, out->modifiers,
+                                                  DRM_FORMATS_MAX_MODIFIERS);
+    return out->count_modifiers < 0 ? -1 : 0;
+}
+
+// CRTC indices the connector's encoders can drive, and the one it is on now
+static uint32_t connector_crtcs(int drm_fd, const drmModeRes *res, const drmModeConnector *conn, int *current) {
+    uint32_t mask = 0;
+
+    *current = -1;
+    for (int e = 0; e < conn->count_encoders; e++) {
+        drmModeEncoder *enc = drmModeGetEncoder(drm_fd, conn->encoders[e]);
+        if (!enc)
+            continue;
+        mask |= enc->possible_crtcs;
+        if (enc->encoder_id == conn->encoder_id && enc->crtc_id)
+            *current = crtc_index_of(res, enc->crtc_id);
+        drmModeFreeEncoder(enc);
+    }
+    return mask;
+}
+
+// Everything about conn on the CRTC at crtc_index: mode, a primary plane
+// not in taken, property registries and formats. Returns 0, -1 if skipped.
+static int fill_output(int drm_fd, const drmModeRes *res, const drmModePlaneRes *planes, const drmModeConnector *conn,
+                       int crtc_index, const uint32_t *taken, int count_taken, struct kms_output *out) {
+    const char *type = drmModeGetConnectorTypeName(conn->connector_type);
+    snprintf(out->name, sizeof(out->name), "%s-%u", type ? type : "Unknown", conn->connector_type_id);
+
+    if (crtc_index < 0) {
+        fprintf(stderr, "%s: no free CRTC its encoders can drive, skipped\n", out->name);
+        return -1;
+    }
+    out->connector_id = conn->connector_id;
+    out->crtc_index = crtc_index;
+    out->crtc_id = res->crtcs[crtc_index];
+    out->mode = *preferred_mode(conn);
+
+    out->plane_id = planes ? find_primary(drm_fd, planes, out, taken, count_taken) : 0;
+    if (!out->plane_id) {
+        fprintf(stderr, "%s: no primary plane for CRTC %u, skipped\n", out->name, out->crtc_id);
+        return -1;
+    }
+
+    if (drm_props_init(drm_fd, out->connector_id, DRM_MODE_OBJECT_CONNECTOR, &out->conn_props) != 0 ||
+        drm_props_init(drm_fd, out->crtc_id, DRM_MODE_OBJECT_CRTC, &out->crtc_props) != 0 ||
+        drm_props_init(drm_fd, out->plane_id, DRM_MODE_OBJECT_PLANE, &out->plane_props) != 0) {
+        fprintf(stderr, "%s: failed to read KMS properties, skipped\n", out->name);
+        return -1;
+    }
+    if (read_formats(drm_fd, out) != 0) {
+        fprintf(stderr, "%s: failed to read the formats of plane %u, skipped\n", out->name, out->plane_id);
+        return -1;
+    }
+    return 0;
+}
+
+int topology_solve(int drm_fd, struct kms_topology *topo) {
+    struct candidate cands[TOPOLOGY_MAX_OUTPUTS];
+    int crtc_owner[TOPOLOGY_MAX_CRTCS];
+    int count = 0;
+
+    memset(topo, 0, sizeof(*topo));
+
+    drmModeRes *res = drmModeGetResources(drm_fd);
+    if (!res) {
+        perror("drmModeGetResources failed");
+        return -1;
+    }
+    int count_crtcs = res->count_crtcs < TOPOLOGY_MAX_CRTCS ? res->count_crtcs : TOPOLOGY_MAX_CRTCS;
+
+    for (int i = 0; i < res->count_connectors && count < TOPOLOGY_MAX_OUTPUTS; i++) {
+        drmModeConnector *conn = topology_connector(drm_fd, res->connectors[i], 0);
+        if (!conn)
+            continue;
+        if (conn->connection != DRM_MODE_CONNECTED || conn->count_modes == 0) {
+            drmModeFreeConnector(conn);
+            continue;
+        }
+
+        struct candidate *cand = &cands[count++];
+        cand->conn = conn;
+        cand->crtc_mask = connector_crtcs(drm_fd, res, conn, &cand->current);
+    }
+
+    for (int i = 0; i < TOPOLOGY_MAX_CRTCS; i++)
+        crtc_owner[i] = -1;
+    for (int c = 0; c < count; c++) {
+        int visited[TOPOLOGY_MAX_CRTCS] = {0};
+        match(cands, c, count_crtcs, crtc_owner, visited);
+    }
+
+    drmModePlaneRes *planes = drmModeGetPlaneResources(drm_fd);
+    uint32_t taken[TOPOLOGY_MAX_OUTPUTS];
+    int count_taken = 0;
+
+    // Outputs in connector order
+    for (int c = 0; c < count; c++) {
+        struct kms_output *out = &topo->outputs[topo->count];
+        int crtc_index = -1;
+        for (int i = 0; i < count_crtcs; i++) {
+            if (crtc_owner[i] == c)
+                crtc_index = i;
+        }
+        if (fill_output(drm_fd, res, planes, cands[c].conn, crtc_index, taken, count_taken, out) != 0)
+            continue;
+        taken[count_taken++] = out->plane_id;
+        topo->count++;
+    }
+
+    for (int c = 0; c < count; c++)
+        drmModeFreeConnector(cands[c].conn);
+    if (planes)
+        drmModeFreePlaneResources(planes);
+    drmModeFreeResources(res);
+    return topo->count;
+}
+
+int topology_solve_output(int drm_fd, uint32_t connector_id, const struct kms_topology *busy, struct kms_output *out) {
+    uint32_t taken[TOPOLOGY_MAX_OUTPUTS];
+    uint32_t busy_crtcs = 0;
+    int ret = -1;
+
+    memset(out, 0, sizeof(*out));
+    for (int i = 0; i < busy->count; i++) {
+        busy_crtcs |= 1u << busy->outputs[i].crtc_index;
+        taken[i] = busy->outputs[i].plane_id;
+    }
+
+    drmModeRes *res = drmModeGetResources(drm_fd);
+    if (!res) {
+        perror("drmModeGetResources failed");
+        return -1;
+    }
+    drmModeConnector *conn = topology_connector(drm_fd, connector_id, 1);
+    drmModePlaneRes *planes = drmModeGetPlaneResources(drm_fd);
+
+    if (conn && conn->connection == DRM_MODE_CONNECTED && conn->count_modes > 0) {
+        int current;
+        uint32_t free_crtcs = connector_crtcs(drm_fd, res, conn, &current) & ~busy_crtcs;
+        int crtc_index = -1;
+        if (current >= 0 && (free_crtcs & (1u << current)))
+            crtc_index = current;
+        for (int i = 0; i < res->count_crtcs && i < TOPOLOGY_MAX_CRTCS && crtc_index < 0; i++) {
+            if (free_crtcs & (1u << i))
+                crtc_index = i;
+        }
+        ret = fill_output(drm_fd, res, planes, conn, crtc_index, taken, busy->count, out);
+    }
+
+    drmModeFreeConnector(conn);
+    if (planes)
+        drmModeFreePlaneResources(planes);
+    drmModeFreeResources(res);
+    return ret;
+}
+
+int topology_add_output_modeset(const struct kms_output *out, struct drm_blob_cache *blobs, drmModeAtomicReq *req,
+                                uint32_t fb_id) {
+    uint32_t blob_id = drm_mode_blob_get(blobs, &out->mode);
+    if (!blob_id)
+        return -1;
+
+    drm_props_add(req, &out->conn_props, DRM_PROP_CONNECTOR_CRTC_ID, out->crtc_id);
+    drm_props_add(req, &out->crtc_props, DRM_PROP_CRTC_MODE_ID, blob_id);
+    drm_props_add(req, &out->crtc_props, DRM_PROP_CRTC_ACTIVE, 1);
+
+    const struct drm_object_props *plane = &out->plane_props;
+    drm_props_add(req, plane, DRM_PROP_PLANE_FB_ID, fb_id);
+    drm_props_add(req, plane, DRM_PROP_PLANE_CRTC_ID, out->crtc_id);
+    drm_props_add(req, plane, DRM_PROP_PLANE_SRC_X, 0);
+    drm_props_add(req, plane, DRM_PROP_PLANE_SRC_Y, 0);
+    drm_props_add(req, plane, DRM_PROP_PLANE_SRC_W, (uint64_t)out->mode.hdisplay << 16);
+    drm_props_add(req, plane, DRM_PROP_PLANE_SRC_H, (uint64_t)out->mode.vdisplay << 16);
+    drm_props_add(req, plane, DRM_PROP_PLANE_CRTC_X, 0);
+    drm_props_add(req, plane, DRM_PROP_PLANE_CRTC_Y, 0);
+    drm_props_add(req, plane, DRM_PROP_PLANE_CRTC_W, out->mode.hdisplay);
+    drm_props_add(req, plane, DRM_PROP_PLANE_CRTC_H, out->mode.vdisplay);
+    return 0;
+}
+
+int topology_add_output_disable(const struct kms_output *out, drmModeAtomicReq *req) {
+    drm_props_add(req, &out->plane_props, DRM_PROP_PLANE_FB_ID, 0);
+    drm_props_add(req, &out->plane_props, DRM_PROP_PLANE_CRTC_ID, 0);
+    drm_props_add(req, &out->conn_props, DRM_PROP_CONNECTOR_CRTC_ID, 0);
+    drm_props_add(req, &out->crtc_props, DRM_PROP_CRTC_MODE_ID, 0);
+    return drm_props_add(req, &out->crtc_props, DRM_PROP_CRTC_ACTIVE, 0);
+}
+
+int topology_add_modeset(const struct kms_topology *topo, struct drm_blob_cache *blobs, drmModeAtomicReq *req,
+                         const uint32_t *fb_ids) {
+    for (int i = 0; i < topo->count; i++) {
+        if (topology_add_output_modeset(&topo->outputs[i], blobs, req, fb_ids[i]) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+void topology_print(const struct kms_topology *topo) {
+    for (int i = 0; i < topo->count; i++) {
+        const struct kms_output *out = &topo->outputs[i];
+        printf("[OUTPUT]   : %s: connector %u -> CRTC %u (index %d) -> plane %u, %dx%d@%dHz, "
+               "%d formats, %d XRGB8888 modifiers\n", out->name, out->connector_id, out->crtc_id, out->crtc_index,
+               out->plane_id, out->mode.hdisplay, out->mode.vdisplay, out->mode.vrefresh, out->count_formats,
+               out->count_modifiers);
+    }
+    printf("[OUTPUT]   : %d output%s\n", topo->count, topo->count == 1 ? "" : "s");
+}
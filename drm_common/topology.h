@@ -0,0 +1,94 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <stdint.h>
+
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#include "drm_blob.h"
+#include "drm_formats.h"
+#include "drm_props.h"
+
+#define TOPOLOGY_MAX_OUTPUTS 8
+#define TOPOLOGY_MAX_CRTCS 32
+#define TOPOLOGY_MAX_FORMATS 64
+
+// One lit display: connector -> CRTC -> primary plane, with the mode to
+// drive it at, the property registries of all three objects and what the
+// primary plane can scan out. Plain data, so it can be saved as is (see
+// topology_cache.h).
+struct kms_output {
+    char name[32];              // e.g. "HDMI-A-1"
+    uint32_t connector_id;
+    uint32_t crtc_id;
+    int crtc_index;             // position in drmModeRes::crtcs (possible_crtcs bit)
+    uint32_t plane_id;
+    drmModeModeInfo mode;
+    struct drm_object_props conn_props;
+    struct drm_object_props crtc_props;
+    struct drm_object_props plane_props;
+    int count_formats;          // drmModePlane::formats of the primary plane
+    uint32_t formats[TOPOLOGY_MAX_FORMATS];
+    int count_modifiers;        // layouts it takes XRGB8888 in (IN_FORMATS), 0 if implicit only
+    uint64_t modifiers[DRM_FORMATS_MAX_MODIFIERS];
+};
+
+struct kms_topology {
+    int count;
+    struct kms_output outputs[TOPOLOGY_MAX_OUTPUTS];
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Connector state as the kernel last detected it (drmModeGetConnectorCurrent):
+// no detect cycle, no EDID read. A full probe (drmModeGetConnector) is only
+// done when probe is set or the connector has never been probed (status
+// unknown, or connected without modes).
+static inline drmModeConnector *topology_connector(int drm_fd, uint32_t connector_id, int probe) {
+    if (!probe) {
+        drmModeConnector *conn = drmModeGetConnectorCurrent(drm_fd, connector_id);
+        if (conn && (conn->connection == DRM_MODE_DISCONNECTED ||
+                     (conn->connection == DRM_MODE_CONNECTED && conn->count_modes > 0)))
+            return conn;
+        drmModeFreeConnector(conn);
+    }
+    return drmModeGetConnector(drm_fd, connector_id);
+}
+
+// Map every connected connector to a CRTC one of its encoders can drive
+// (possible_crtcs) and to a primary plane of that CRTC. CRTCs are matched
+// so that as many connectors as possible get one, keeping the CRTC a
+// connector is already on where that works. Connectors left without a CRTC
+// or plane are reported and skipped. Returns the number of outputs, -1 on
+// error.
+int topology_solve(int drm_fd, struct kms_topology *topo);
+
+// Probe one connector (e.g. the one a hotplug event named) and give it a
+// CRTC and primary plane none of the outputs in busy use. Returns 0, -1 if
+// it is not connected or nothing is free for it.
+int topology_solve_output(int drm_fd, uint32_t connector_id, const struct kms_topology *busy, struct kms_output *out);
+
+// Atomic state that lights every output: connector CRTC_ID, MODE_ID (from
+// blobs) and ACTIVE per CRTC, and the primary plane scanning out fb_ids[i]
+// full screen. Commit with DRM_MODE_ATOMIC_ALLOW_MODESET.
+int topology_add_modeset(const struct kms_topology *topo, struct drm_blob_cache *blobs, drmModeAtomicReq *req,
+                         const uint32_t *fb_ids);
+
+// The same for one output, to light it without touching the others
+int topology_add_output_modeset(const struct kms_output *out, struct drm_blob_cache *blobs, drmModeAtomicReq *req,
+                                uint32_t fb_id);
+
+// Switch one output off: plane detached, connector unrouted, CRTC inactive
+// (commit with DRM_MODE_ATOMIC_ALLOW_MODESET)
+int topology_add_output_disable(const struct kms_output *out, drmModeAtomicReq *req);
+
+void topology_print(const struct kms_topology *topo);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TOPOLOGY_H
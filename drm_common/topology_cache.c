@@ -0,0 +1,188 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+#include "frame_stats.h"
+#include "hash.h"
+#include "topology_cache.h"
+
+#define SNAPSHOT_MAGIC 0x54534d4b      // "KMST"
+#define SNAPSHOT_VERSION 1
+
+// Fixed header; count struct kms_output records follow. The record size
+// and property count tie a file to the build that wrote it.
+struct snapshot_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t output_size;
+    uint32_t prop_count;
+    uint64_t fingerprint;
+    uint32_t count;
+    uint32_t reserved;
+};
+
+int topology_cache_path(int drm_fd, char *path, size_t size) {
+    struct stat st;
+    const char *dir = getenv("XDG_RUNTIME_DIR");
+    unsigned int minor_id = fstat(drm_fd, &st) == 0 ? minor(st.st_rdev) : 0;
+
+    // Not /tmp: under sudo that would be a predictable name any local user
+    // can plant or point a symlink at
+    if (!dir || !*dir)
+        return -1;
+    int len = snprintf(path, size, "%s/drm-topology-%u.bin", dir, minor_id);
+    return len > 0 && (size_t)len < size ? 0 : -1;
+}
+
+uint64_t topology_fingerprint(int drm_fd) {
+    uint64_t hash = FNV1A_OFFSET;
+
+    drmVersionPtr version = drmGetVersion(drm_fd);
+    if (version) {
+        int numbers[] = { version->version_major, version->version_minor, version->version_patchlevel };
+        hash = fnv1a_bytes(hash, version->name, version->name_len);
+        hash = fnv1a_bytes(hash, numbers, sizeof(numbers));
+        drmFreeVersion(version);
+    }
+
+    drmModeRes *res = drmModeGetResources(drm_fd);
+    if (!res)
+        return 0;
+    hash = fnv1a_bytes(hash, res->connectors, res->count_connectors * sizeof(uint32_t));
+    hash = fnv1a_bytes(hash, res->encoders, res->count_encoders * sizeof(uint32_t));
+    hash = fnv1a_bytes(hash, res->crtcs, res->count_crtcs * sizeof(uint32_t));
+
+    // Status and modes as last probed: no EDID read, no detect cycle
+    for (int i = 0; i < res->count_connectors; i++) {
+        drmModeConnector *conn = drmModeGetConnectorCurrent(drm_fd, res->connectors[i]);
+        if (!conn)
+            continue;
+        hash = fnv1a_bytes(hash, &conn->connection, sizeof(conn->connection));
+        hash = fnv1a_bytes(hash, conn->modes, conn->count_modes * sizeof(drmModeModeInfo));
+        drmModeFreeConnector(conn);
+    }
+    drmModeFreeResources(res);
+
+    drmModePlaneRes *planes = drmModeGetPlaneResources(drm_fd);
+    if (planes) {
+        hash = fnv1a_bytes(hash, planes->planes, planes->count_planes * sizeof(uint32_t));
+        drmModeFreePlaneResources(planes);
+    }
+    return hash ? hash : 1;
+}
+
+int topology_save(const char *path, const struct kms_topology *topo, uint64_t fingerprint) {
+    struct snapshot_header hdr = {
+        .magic = SNAPSHOT_MAGIC,
+        .version = SNAPSHOT_VERSION,
+        .output_size = sizeof(struct kms_output),
+        .prop_count = DRM_PROP_COUNT,
+        .fingerprint = fingerprint,
+        .count = (uint32_t)topo->count,
+    };
+    char tmp[4096];
+
+    if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path) >= (int)sizeof(tmp))
+        return -1;
+
+    // mkstemp: a new 0600 file, never an existing one or a symlink target
+    int fd = mkstemp(tmp);
+    FILE *f = fd >= 0 ? fdopen(fd, "wb") : NULL;
+    if (!f) {
+        perror("Failed to write topology snapshot");
+        if (fd >= 0) {
+            close(fd);
+            unlink(tmp);
+        }
+        return -1;
+    }
+    int ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1 &&
+             (topo->count == 0 || fwrite(topo->outputs, sizeof(struct kms_output), topo->count, f) ==
+                                      (size_t)topo->count);
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp, path) != 0) {
+        perror("Failed to write topology snapshot");
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+// Open a snapshot only if it is a regular file of ours that nobody else can
+// write; anything else is ignored as if missing
+static FILE *open_snapshot(const char *path) {
+    struct stat st;
+
+    int fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_uid != geteuid() ||
+        (st.st_mode & 0777) != 0600) {
+        close(fd);
+        return NULL;
+    }
+
+    FILE *f = fdopen(fd, "rb");
+    if (!f)
+        close(fd);
+    return f;
+}
+
+int topology_load(const char *path, struct kms_topology *topo, uint64_t fingerprint) {
+    struct snapshot_header hdr;
+
+    FILE *f = open_snapshot(path);
+    if (!f)
+        return -1;
+
+    int ok = fread(&hdr, sizeof(hdr), 1, f) == 1 && hdr.magic == SNAPSHOT_MAGIC &&
+             hdr.version == SNAPSHOT_VERSION && hdr.output_size == sizeof(struct kms_output) &&
+             hdr.prop_count == DRM_PROP_COUNT && hdr.fingerprint == fingerprint &&
+             hdr.count <= TOPOLOGY_MAX_OUTPUTS;
+    if (ok) {
+        memset(topo, 0, sizeof(*topo));
+        ok = fread(topo->outputs, sizeof(struct kms_output), hdr.count, f) == hdr.count;
+        topo->count = ok ? (int)hdr.count : 0;
+    }
+    fclose(f);
+    return ok ? topo->count : -1;
+}
+
+int topology_solve_cached(int drm_fd, const char *path, struct kms_topology *topo) {
+    char default_path[4096];
+
+    if (!path) {
+        if (topology_cache_path(drm_fd, default_path, sizeof(default_path)) != 0)
+            return topology_solve(drm_fd, topo);
+        path = default_path;
+    }
+
+    double start = now_ms();
+    uint64_t fingerprint = topology_fingerprint(drm_fd);
+    if (fingerprint && topology_load(path, topo, fingerprint) > 0) {
+        printf("[TOPOLOGY] : snapshot %s is current, %d outputs in %.3f ms\n", path, topo->count, now_ms() - start);
+        return topo->count;
+    }
+
+    int count = topology_solve(drm_fd, topo);
+    if (count > 0 && fingerprint && topology_save(path, topo, fingerprint) == 0)
+        printf("[TOPOLOGY] : enumerated %d outputs in %.3f ms, saved to %s\n", count, now_ms() - start, path);
+    return count;
+}
+
+void topology_cache_invalidate(int drm_fd, const char *path) {
+    char default_path[4096];
+
+    if (!path) {
+        if (topology_cache_path(drm_fd, default_path, sizeof(default_path)) != 0)
+            return;
+        path = default_path;
+    }
+    if (unlink(path) != 0 && errno != ENOENT)
+        perror("Failed to remove topology snapshot");
+}
@@ -0,0 +1,57 @@
+#ifndef TOPOLOGY_CACHE_H
+#define TOPOLOGY_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "topology.h"
+
+// Solved topologies saved to a small binary file so a warm start skips the
+// enumeration (every connector, encoder and plane, and a properties ioctl
+// plus one per property for each object). A snapshot is only used if the
+// device still has the same fingerprint: driver name and version, the IDs
+// of all connectors, encoders, CRTCs and planes, and each connector's
+// connection status and mode list as last probed. Reading that takes a few
+// ioctls per connector and probes nothing (drmModeGetConnectorCurrent), so
+// a monitor plugged or unplugged since the save changes the fingerprint
+// and the topology is solved again.
+//
+// Property values in a loaded snapshot are those seen when it was saved;
+// only the IDs, limits and immutable values are meant to be used.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Default snapshot file for the device: $XDG_RUNTIME_DIR/drm-topology-
+// <minor>.bin. Returns 0, -1 if XDG_RUNTIME_DIR is unset (e.g. under sudo;
+// no snapshot then) or path does not fit.
+int topology_cache_path(int drm_fd, char *path, size_t size);
+
+// Cheap identity of the device's current KMS state, 0 on error
+uint64_t topology_fingerprint(int drm_fd);
+
+// Write topo with fingerprint to path (through a new mode 0600 temporary
+// file and a rename, so readers never see a partial snapshot). Returns 0,
+// -1 on error.
+int topology_save(const char *path, const struct kms_topology *topo, uint64_t fingerprint);
+
+// Read the snapshot at path into topo if it was saved with fingerprint by
+// this build. Files that are not regular, not owned by the effective user
+// or not mode 0600 are ignored. Returns the number of outputs, -1 if
+// missing, stale or not trusted.
+int topology_load(const char *path, struct kms_topology *topo, uint64_t fingerprint);
+
+// topology_load() from path (NULL = topology_cache_path()), falling back
+// to topology_solve() and saving the result. Returns the number of
+// outputs, -1 on error.
+int topology_solve_cached(int drm_fd, const char *path, struct kms_topology *topo);
+
+// Drop the snapshot, e.g. on a hotplug event. NULL = topology_cache_path().
+void topology_cache_invalidate(int drm_fd, const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TOPOLOGY_CACHE_H
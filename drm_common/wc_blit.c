@@ -0,0 +1,123 @@
+#include <string.h>
+
+#include "wc_blit.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+
+// One destination row: 4-byte movnti until 16-byte aligned, 16-byte
+// streams until 64-byte aligned, whole cache lines, then the same in
+// reverse for the tail. Every store bypasses the cache.
+static void fill_row(uint8_t *dst, uint32_t bytes, uint32_t color) {
+    const __m128i v = _mm_set1_epi32((int)color);
+    uint8_t *end = dst + bytes;
+
+    while (dst < end && ((uintptr_t)dst & 15)) {
+        _mm_stream_si32((int *)dst, (int)color);
+        dst += 4;
+    }
+    while (end - dst >= 16 && ((uintptr_t)dst & 63)) {
+        _mm_stream_si128((__m128i *)dst, v);
+        dst += 16;
+    }
+    while (end - dst >= 64) {
+        _mm_stream_si128((__m128i *)dst, v);
+        _mm_stream_si128((__m128i *)(dst + 16), v);
+        _mm_stream_si128((__m128i *)(dst + 32), v);
+        _mm_stream_si128((__m128i *)(dst + 48), v);
+        dst += 64;
+    }
+    while (end - dst >= 16) {
+        _mm_stream_si128((__m128i *)dst, v);
+        dst += 16;
+    }
+    while (dst < end) {
+        _mm_stream_si32((int *)dst, (int)color);
+        dst += 4;
+    }
+}
+
+// Same layout as fill_row; source loads are unaligned and cached
+static void copy_row(uint8_t *dst, const uint8_t *src, uint32_t bytes) {
+    uint8_t *end = dst + bytes;
+
+    while (dst < end && ((uintptr_t)dst & 15)) {
+        int v;
+        memcpy(&v, src, 4);
+        _mm_stream_si32((int *)dst, v);
+        dst += 4;
+        src += 4;
+    }
+    while (end - dst >= 16 && ((uintptr_t)dst & 63)) {
+        _mm_stream_si128((__m128i *)dst, _mm_loadu_si128((const __m128i *)src));
+        dst += 16;
+        src += 16;
+    }
+    while (end - dst >= 64) {
+        __m128i a = _mm_loadu_si128((const __m128i *)src);
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *)(src + 32));
+        __m128i d = _mm_loadu_si128((const __m128i *)(src + 48));
+        _mm_stream_si128((__m128i *)dst, a);
+        _mm_stream_si128((__m128i *)(dst + 16), b);
+        _mm_stream_si128((__m128i *)(dst + 32), c);
+        _mm_stream_si128((__m128i *)(dst + 48), d);
+        dst += 64;
+        src += 64;
+    }
+    while (end - dst >= 16) {
+        _mm_stream_si128((__m128i *)dst, _mm_loadu_si128((const __m128i *)src));
+        dst += 16;
+        src += 16;
+    }
+    while (dst < end) {
+        int v;
+        memcpy(&v, src, 4);
+        _mm_stream_si32((int *)dst, v);
+        dst += 4;
+        src += 4;
+    }
+}
+
+// Streaming stores are weakly ordered: drain them before the buffer is
+// handed to the display
+static inline void store_fence(void) {
+    _mm_sfence();
+}
+#else
+static void fill_row(uint8_t *dst, uint32_t bytes, uint32_t color) {
+    uint32_t *row = (uint32_t *)dst;
+
+    for (uint32_t x = 0; x < bytes / 4; x++)
+        row[x] = color;
+}
+
+static void copy_row(uint8_t *dst, const uint8_t *src, uint32_t bytes) {
+    memcpy(dst, src, bytes);
+}
+
+static inline void store_fence(void) {
+}
+#endif
+
+void wc_fill(uint8_t *dst, uint32_t dst_pitch, int width, int height, uint32_t color) {
+    for (int y = 0; y < height; y++)
+        fill_row(dst + (size_t)y * dst_pitch, (uint32_t)width * 4, color);
+    store_fence();
+}
+
+void wc_fill_rect(uint8_t *fb, uint32_t fb_pitch, int x, int y, int width, int height, uint32_t color) {
+    wc_fill(fb + (size_t)y * fb_pitch + (size_t)x * 4, fb_pitch, width, height, color);
+}
+
+void wc_copy(uint8_t *dst, uint32_t dst_pitch, const uint8_t *src, uint32_t src_pitch,
+             uint32_t row_bytes, int height) {
+    for (int y = 0; y < height; y++)
+        copy_row(dst + (size_t)y * dst_pitch, src + (size_t)y * src_pitch, row_bytes);
+    store_fence();
+}
+
+void wc_blit(uint8_t *fb, uint32_t fb_pitch, int x, int y,
+             const uint8_t *src, uint32_t src_pitch, int width, int height) {
+    wc_copy(fb + (size_t)y * fb_pitch + (size_t)x * 4, fb_pitch, src, src_pitch, (uint32_t)width * 4, height);
+}
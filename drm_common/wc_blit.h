@@ -0,0 +1,39 @@
+#ifndef WC_BLIT_H
+#define WC_BLIT_H
+
+#include <stdint.h>
+
+// Fill / copy / blit primitives for 32 bpp framebuffers in mmapped dumb or
+// GBM memory, which is usually write-combined or uncached. Reads from such
+// memory are very slow and partial-line writes flush the WC buffers early,
+// so these functions never read the destination and, on x86, write every
+// row as full 64-byte cache lines of streaming stores with aligned
+// non-temporal stores for the unaligned head and tail. Other CPUs fall back
+// to plain stores that still never read dst.
+//
+// Strides are in bytes; x, y, width and height are in pixels. Rows are
+// independent, so callers may split a call into row bands across threads.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Solid colour over width x height pixels starting at dst
+void wc_fill(uint8_t *dst, uint32_t dst_pitch, int width, int height, uint32_t color);
+
+// Solid colour over the rectangle (x, y, width, height) of a framebuffer
+void wc_fill_rect(uint8_t *fb, uint32_t fb_pitch, int x, int y, int width, int height, uint32_t color);
+
+// Copy row_bytes (a multiple of 4) per row for height rows
+void wc_copy(uint8_t *dst, uint32_t dst_pitch, const uint8_t *src, uint32_t src_pitch,
+             uint32_t row_bytes, int height);
+
+// Copy a width x height pixel image to (x, y) of a framebuffer
+void wc_blit(uint8_t *fb, uint32_t fb_pitch, int x, int y,
+             const uint8_t *src, uint32_t src_pitch, int width, int height);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WC_BLIT_H
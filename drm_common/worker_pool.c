@@ -0,0 +1,238 @@
+#define _GNU_SOURCE
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pixel_convert.h"
+#include "wc_blit.h"
+#include "worker_pool.h"
+
+// Parse a sysfs cpulist such as "0-7,16-23"
+static int read_node_cpus(int node, cpu_set_t *cpus) {
+    char path[64];
+    char line[1024];
+
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror("Failed to open NUMA node cpulist");
+        return -1;
+    }
+    if (!fgets(line, sizeof(line), f))
+        line[0] = '\0';
+    fclose(f);
+
+    CPU_ZERO(cpus);
+    char *p = line;
+    while (*p && *p != '\n') {
+        char *end;
+        long first = strtol(p, &end, 10);
+        if (end == p)
+            break;
+        long last = first;
+        if (*end == '-')
+            last = strtol(end + 1, &end, 10);
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+            CPU_SET(cpu, cpus);
+        p = *end == ',' ? end + 1 : end;
+    }
+
+    if (CPU_COUNT(cpus) == 0) {
+        fprintf(stderr, "NUMA node %d has no CPUs\n", node);
+        return -1;
+    }
+    return 0;
+}
+
+static void run_band(struct worker_pool *pool, int band) {
+    int begin = (int)((long)pool->rows * band / pool->count);
+    int end = (int)((long)pool->rows * (band + 1) / pool->count);
+
+    if (begin < end)
+        pool->fn(pool->arg, begin, end);
+}
+
+static void *worker_main(void *data) {
+    struct worker_thread *worker = data;
+    struct worker_pool *pool = worker->pool;
+    unsigned int seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->generation == seen && !pool->quit)
+            pthread_cond_wait(&pool->start, &pool->lock);
+        if (pool->quit)
+            break;
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        run_band(pool, worker->band);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0)
+            pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+int worker_pool_init(struct worker_pool *pool, int threads, int numa_node) {
+    cpu_set_t cpus;
+
+    memset(pool, 0, sizeof(*pool));
+    pool->numa_node = numa_node;
+
+    if (numa_node >= 0 && read_node_cpus(numa_node, &cpus) != 0)
+        return -1;
+
+    if (threads <= 0)
+        threads = numa_node >= 0 ? CPU_COUNT(&cpus) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1)
+        threads = 1;
+    if (threads > WORKER_POOL_MAX_THREADS)
+        threads = WORKER_POOL_MAX_THREADS;
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    // Workers start with every signal blocked, so process-directed signals
+    // (SIGINT, SIGTERM) always reach the caller's thread, e.g. its signalfd,
+    // whether the pool is created before or after the caller blocks them
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+
+    // The caller runs band 0, so only count - 1 threads are started
+    pool->count = 1;
+    for (int i = 1; i < threads; i++) {
+        struct worker_thread *worker = &pool->workers[i];
+        worker->pool = pool;
+        worker->band = i;
+
+        if (pthread_create(&worker->thread, NULL, worker_main, worker) != 0) {
+            perror("pthread_create failed");
+            pthread_sigmask(SIG_SETMASK, &old, NULL);
+            worker_pool_destroy(pool);
+            return -1;
+        }
+        pool->count++;
+
+        if (numa_node >= 0 && pthread_setaffinity_np(worker->thread, sizeof(cpus), &cpus) != 0)
+            fprintf(stderr, "Failed to pin worker %d to NUMA node %d\n", i, numa_node);
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    printf("[WORKERS]  : %d threads", pool->count);
+    if (numa_node >= 0)
+        printf(" on NUMA node %d", numa_node);
+    printf("\n");
+    return 0;
+}
+
+void worker_pool_run(struct worker_pool *pool, worker_band_fn fn, void *arg, int rows) {
+    if (pool->count == 1) {
+        fn(arg, 0, rows);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->arg = arg;
+    pool->rows = rows;
+    pool->pending = pool->count - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    run_band(pool, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending > 0)
+        pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void worker_pool_destroy(struct worker_pool *pool) {
+    if (pool->count == 0)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 1; i < pool->count; i++)
+        pthread_join(pool->workers[i].thread, NULL);
+
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->start);
+    pthread_mutex_destroy(&pool->lock);
+    pool->count = 0;
+}
+
+// Job descriptions for the band-parallel pixel transfers
+struct pixel_job {
+    uint8_t *dst;
+    uint32_t dst_pitch;
+    const uint8_t *src;
+    uint32_t src_pitch;
+    uint32_t row_bytes;
+    int width;
+    uint32_t color;
+};
+
+static void fill_band(void *arg, int row_begin, int row_end) {
+    const struct pixel_job *job = arg;
+
+    wc_fill(job->dst + (size_t)row_begin * job->dst_pitch, job->dst_pitch, job->width, row_end - row_begin,
+            job->color);
+}
+
+static void copy_band(void *arg, int row_begin, int row_end) {
+    const struct pixel_job *job = arg;
+
+    wc_copy(job->dst + (size_t)row_begin * job->dst_pitch, job->dst_pitch,
+            job->src + (size_t)row_begin * job->src_pitch, job->src_pitch, job->row_bytes, row_end - row_begin);
+}
+
+static void convert_band(void *arg, int row_begin, int row_end) {
+    const struct pixel_job *job = arg;
+
+    convert_rgba_to_xrgb8888(job->dst + (size_t)row_begin * job->dst_pitch, job->dst_pitch,
+                             job->src + (size_t)row_begin * job->src_pitch, job->src_pitch,
+                             job->width, row_end - row_begin);
+}
+
+static void run_job(struct worker_pool *pool, worker_band_fn fn, struct pixel_job *job, int height) {
+    if (pool)
+        worker_pool_run(pool, fn, job, height);
+    else
+        fn(job, 0, height);
+}
+
+void parallel_fill_xrgb8888(struct worker_pool *pool, uint8_t *dst, uint32_t dst_pitch,
+                            int width, int height, uint32_t color) {
+    struct pixel_job job = { .dst = dst, .dst_pitch = dst_pitch, .width = width, .color = color };
+    run_job(pool, fill_band, &job, height);
+}
+
+void parallel_copy(struct worker_pool *pool, uint8_t *dst, uint32_t dst_pitch,
+                   const uint8_t *src, uint32_t src_pitch, uint32_t row_bytes, int height) {
+    struct pixel_job job = { .dst = dst, .dst_pitch = dst_pitch, .src = src, .src_pitch = src_pitch,
+                             .row_bytes = row_bytes };
+    run_job(pool, copy_band, &job, height);
+}
+
+void parallel_convert_rgba_to_xrgb8888(struct worker_pool *pool, uint8_t *dst, uint32_t dst_pitch,
+                                       const uint8_t *src, uint32_t src_pitch, int width, int height) {
+    // Pick the kernel once here, not concurrently from every worker
+    pixel_convert_best();
+
+    struct pixel_job job = { .dst = dst, .dst_pitch = dst_pitch, .src = src, .src_pitch = src_pitch,
+                             .width = width };
+    run_job(pool, convert_band, &job, height);
+}
@@ -0,0 +1,65 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#define WORKER_POOL_MAX_THREADS 32
+
+// Runs a job over the rows of a framebuffer split into one contiguous band
+// per thread. The calling thread takes the first band, so a pool of N
+// threads starts N - 1 workers; they stay parked on a condition variable
+// between jobs.
+typedef void (*worker_band_fn)(void *arg, int row_begin, int row_end);
+
+struct worker_pool;
+
+struct worker_thread {
+    struct worker_pool *pool;
+    pthread_t thread;
+    int band;                   // band index this thread runs, 1..count-1
+};
+
+// Workers keep a pointer to the pool: it must not move after init.
+struct worker_pool {
+    int count;                  // threads per job, including the caller
+    int numa_node;              // node the workers are pinned to, -1 if not pinned
+    struct worker_thread workers[WORKER_POOL_MAX_THREADS];
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    unsigned int generation;    // bumped for every job
+    int pending;                // workers still running the current job
+    int quit;
+    worker_band_fn fn;
+    void *arg;
+    int rows;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// threads = 0 uses every CPU online (or every CPU of numa_node).
+// numa_node >= 0 pins the workers to the CPUs listed in
+// /sys/devices/system/node/nodeN/cpulist.
+int worker_pool_init(struct worker_pool *pool, int threads, int numa_node);
+
+// Run fn over rows [0, rows) split into bands; returns when every band is done
+void worker_pool_run(struct worker_pool *pool, worker_band_fn fn, void *arg, int rows);
+
+void worker_pool_destroy(struct worker_pool *pool);
+
+// Band-parallel pixel transfers. pool may be NULL to run on the calling thread.
+void parallel_fill_xrgb8888(struct worker_pool *pool, uint8_t *dst, uint32_t dst_pitch,
+                            int width, int height, uint32_t color);
+void parallel_copy(struct worker_pool *pool, uint8_t *dst, uint32_t dst_pitch,
+                   const uint8_t *src, uint32_t src_pitch, uint32_t row_bytes, int height);
+void parallel_convert_rgba_to_xrgb8888(struct worker_pool *pool, uint8_t *dst, uint32_t dst_pitch,
+                                       const uint8_t *src, uint32_t src_pitch, int width, int height);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WORKER_POOL_H
@@ -1,19 +1,22 @@
 #!/bin/bash
 
-# Compile main.c to main.o
-gcc -c main_gbm.c -o main_gbm.o -I/usr/include/libdrm
+# Shared DRM helpers from ../drm_common
+COMMON_SRCS="../drm_common/drm_props.c ../drm_common/drm_blob.c ../drm_common/drm_formats.c ../drm_common/frame_stats.c ../drm_common/swapchain.c ../drm_common/event_loop.c ../drm_common/pixel_convert.c ../drm_common/worker_pool.c ../drm_common/wc_blit.c ../drm_common/fb_pool.c ../drm_common/topology.c ../drm_common/topology_cache.c ../drm_common/drm_device.c ../drm_common/takeover.c"
+COMMON_OBJS="drm_props.o drm_blob.o drm_formats.o frame_stats.o swapchain.o event_loop.o pixel_convert.o worker_pool.o wc_blit.o fb_pool.o topology.o topology_cache.o drm_device.o takeover.o"
+
+# Compile main_gbm.c and the shared helpers to object files
+gcc -c main_gbm.c $COMMON_SRCS -I/usr/include/libdrm -I../drm_common
 
 # Compile cube_render.cpp to cube_render.o
-g++ -c cube_render.cpp -o cube_render.o -I.
+g++ -c cube_render.cpp -o cube_render.o -I. -I/usr/include/libdrm -I../drm_common
 
 # Link object files to create the executable
-g++ cube_render.o main_gbm.o -o gbm_cube_demo -lGLESv2 -lEGL -ldrm -lm -lgbm
+g++ cube_render.o main_gbm.o $COMMON_OBJS -o gbm_cube_demo -lGLESv2 -lEGL -ldrm -lm -lpthread -lgbm
 
 # Check if the compilation and linking were successful
 if [ $? -eq 0 ]; then
-    rm main_gbm.o cube_render.o
+    rm main_gbm.o cube_render.o $COMMON_OBJS
     echo "Compilation and linking successful!"
 else
     echo "Compilation or linking failed."
 fi
-
@@ -1,7 +1,16 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #include "cube_render.h"
+#include <GLES3/gl3.h>
 #include <ctime>
+#include <cstring>
+#include <drm_fourcc.h>
+#include <cstdlib>
+#include <climits>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include "pixel_convert.h"
+#include "worker_pool.h"
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
@@ -13,6 +22,58 @@ static GLuint tex;
 static GLuint program;
 static GLint mvp_loc;
 
+// dma-buf backed render targets (zero-copy GBM path): the scanout buffer is
+// wrapped in an EGLImage and used directly as the FBO colour attachment
+#define MAX_RENDER_TARGETS 4
+
+static struct {
+    EGLImageKHR image;
+    GLuint tex;
+    GLuint fbo;
+} targets[MAX_RENDER_TARGETS];
+static int target_count;
+
+static PFNEGLCREATEIMAGEKHRPROC create_image;
+static PFNEGLDESTROYIMAGEKHRPROC destroy_image;
+static PFNGLEGLIMAGETARGETTEXTURE2DOESPROC image_target_texture;
+
+// Explicit sync: native fence fds exported after a draw (handed to KMS as
+// IN_FENCE_FD) and imported from KMS out-fences as GPU-side waits
+static PFNEGLCREATESYNCKHRPROC create_sync;
+static PFNEGLDESTROYSYNCKHRPROC destroy_sync;
+static PFNEGLWAITSYNCKHRPROC wait_sync;
+static PFNEGLCLIENTWAITSYNCKHRPROC client_wait_sync;
+static PFNEGLDUPNATIVEFENCEFDANDROIDPROC dup_native_fence_fd;
+
+// Client API version of the current context (3 enables the readback ring)
+static int gles_version;
+
+// Asynchronous readback ring: frame N is read into a pixel-pack buffer
+// slot guarded by a fence and copied out to the CPU K frames later, so the
+// CPU never waits for the GPU to finish the frame it just submitted
+#define MAX_READBACK_DEPTH 4
+
+static struct {
+    GLuint pbo;
+    GLsync fence;
+} readback_slots[MAX_READBACK_DEPTH];
+static int readback_depth;
+static int readback_head;       // next slot to fill
+static int readback_pending;    // slots with a readback in flight
+static int readback_width;
+static int readback_height;
+
+// Synchronous path: glReadPixels lands here, then is converted into the
+// caller's buffer at its pitch
+static uint8_t* staging;
+static size_t staging_size;
+
+// Threads for the CPU-side conversions, NULL to convert on this thread
+static struct worker_pool* pixel_workers;
+
+// Readbacks are GL_RGBA bytes; only an XRGB8888 scanout needs R and B swapped
+static int readback_swizzle = 1;
+
 
 // Shader sources
 const char* vertex_shader_source = R"(
@@ -134,13 +195,80 @@ void load_texture(const char* path) {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 }
 
-int EGL_init(int width, int height) {
+// EGL_EXT_device_enumeration / EGL_EXT_device_drm(_render_node)
+#ifndef EGL_PLATFORM_DEVICE_EXT
+#define EGL_PLATFORM_DEVICE_EXT 0x313F
+#endif
+#ifndef EGL_DRM_DEVICE_FILE_EXT
+#define EGL_DRM_DEVICE_FILE_EXT 0x3233
+#endif
+#ifndef EGL_DRM_RENDER_NODE_FILE_EXT
+#define EGL_DRM_RENDER_NODE_FILE_EXT 0x3377
+#endif
+
+typedef EGLBoolean (EGLAPIENTRY *query_devices_fn)(EGLint max_devices, void **devices, EGLint *num_devices);
+typedef const char *(EGLAPIENTRY *query_device_string_fn)(void *device, EGLint name);
+
+// Whether two DRM nodes (cardN, renderDN) belong to the same GPU: both
+// nodes of a device hang off the same parent in sysfs
+static bool same_device(const char* a, const char* b) {
+    struct stat sa, sb;
+    if (stat(a, &sa) != 0 || stat(b, &sb) != 0)
+        return false;
+    if (sa.st_rdev == sb.st_rdev)
+        return true;
+
+    char link_a[64], link_b[64], path_a[PATH_MAX], path_b[PATH_MAX];
+    snprintf(link_a, sizeof(link_a), "/sys/dev/char/%u:%u/device", major(sa.st_rdev), minor(sa.st_rdev));
+    snprintf(link_b, sizeof(link_b), "/sys/dev/char/%u:%u/device", major(sb.st_rdev), minor(sb.st_rdev));
+    return realpath(link_a, path_a) && realpath(link_b, path_b) && strcmp(path_a, path_b) == 0;
+}
+
+// Display on the EGL device that owns render_node, EGL_NO_DISPLAY if the
+// driver cannot enumerate devices or none matches
+static EGLDisplay device_display(PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplayEXT, const char *render_node) {
+    query_devices_fn query_devices = (query_devices_fn)eglGetProcAddress("eglQueryDevicesEXT");
+    query_device_string_fn query_string = (query_device_string_fn)eglGetProcAddress("eglQueryDeviceStringEXT");
+    void *devices[16];
+    EGLint count = 0;
+
+    if (!query_devices || !query_string || !query_devices(16, devices, &count))
+        return EGL_NO_DISPLAY;
+
+    for (EGLint i = 0; i < count; i++) {
+        // The render node is only reported with EGL_EXT_device_drm_render_node,
+        // the primary node with EGL_EXT_device_drm; either identifies the GPU
+        const char *extensions = query_string(devices[i], EGL_EXTENSIONS);
+        const char *node = NULL;
+        if (extensions && strstr(extensions, "EGL_EXT_device_drm_render_node"))
+            node = query_string(devices[i], EGL_DRM_RENDER_NODE_FILE_EXT);
+        if (!node && extensions && strstr(extensions, "EGL_EXT_device_drm"))
+            node = query_string(devices[i], EGL_DRM_DEVICE_FILE_EXT);
+        if (!node || !same_device(node, render_node))
+            continue;
+
+        EGLDisplay display = getPlatformDisplayEXT(EGL_PLATFORM_DEVICE_EXT, devices[i], NULL);
+        if (display != EGL_NO_DISPLAY)
+            printf("Using EGL device %s\n", node);
+        return display;
+    }
+    return EGL_NO_DISPLAY;
+}
+
+int EGL_init(int width, int height, const char* render_node) {
     // 1. Load the extension function
     PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplayEXT = 
         (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
-    
-    // 2. Try surfaceless first if available
-    if (getPlatformDisplayEXT) {
+
+    // 2. Render on the KMS device's own GPU when it is known
+    if (getPlatformDisplayEXT && render_node && *render_node) {
+        egl.display = device_display(getPlatformDisplayEXT, render_node);
+        if (egl.display == EGL_NO_DISPLAY)
+            printf("No EGL device for %s\n", render_node);
+    }
+
+    // 3. Else try surfaceless if available
+    if (getPlatformDisplayEXT && egl.display == EGL_NO_DISPLAY) {
         egl.display = getPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, 
                                           EGL_DEFAULT_DISPLAY, 
                                           NULL);
@@ -149,7 +277,7 @@ int EGL_init(int width, int height) {
         }
     }
     
-    // 3. Fallback to default display
+    // 4. Fallback to default display
     if (egl.display == EGL_NO_DISPLAY) {
         egl.display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
         printf("Using default EGL display\n");
@@ -161,26 +289,32 @@ int EGL_init(int width, int height) {
         printf("EGL init failed: %#x\n", eglGetError());
         return -1;
     }
-    const EGLint configAttribs[] = {
-        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
-        EGL_NONE
-    };
-
-    EGLint numConfigs;
-    if (!eglChooseConfig(egl.display, configAttribs, &egl.config, 1, &numConfigs)) {
-        printf("No EGL config found. Error: %#x\n", eglGetError());
-        return -1;
+    // Prefer GLES3 (pixel-pack buffers and fences for async readback),
+    // fall back to GLES2
+    egl.context = EGL_NO_CONTEXT;
+    for (gles_version = 3; gles_version >= 2 && egl.context == EGL_NO_CONTEXT; gles_version--) {
+        const EGLint configAttribs[] = {
+            EGL_RENDERABLE_TYPE, gles_version == 3 ? EGL_OPENGL_ES3_BIT_KHR : EGL_OPENGL_ES2_BIT,
+            EGL_NONE
+        };
+
+        EGLint numConfigs;
+        if (!eglChooseConfig(egl.display, configAttribs, &egl.config, 1, &numConfigs) || numConfigs < 1)
+            continue;
+
+        const EGLint contextAttribs[] = {
+            EGL_CONTEXT_CLIENT_VERSION, gles_version,
+            EGL_NONE
+        };
+        egl.context = eglCreateContext(egl.display, egl.config, EGL_NO_CONTEXT, contextAttribs);
     }
+    gles_version++;
 
-    const EGLint contextAttribs[] = {
-        EGL_CONTEXT_CLIENT_VERSION, 2,
-        EGL_NONE
-    };
-    egl.context = eglCreateContext(egl.display, egl.config, EGL_NO_CONTEXT, contextAttribs);
     if (egl.context == EGL_NO_CONTEXT) {
         printf("Context creation failed. Error: %#x\n", eglGetError());
         return -1;
     }
+    printf("Using OpenGL ES %d context\n", gles_version);
 
     if (!eglMakeCurrent(egl.display, EGL_NO_SURFACE, EGL_NO_SURFACE, egl.context)) {
         printf("MakeCurrent failed. Error: %#x\n", eglGetError());
@@ -191,6 +325,198 @@ int EGL_init(int width, int height) {
     return 0;
 }
 
+// Whole-token match in an EGL extension string
+static bool has_egl_extension(const char* name) {
+    const char* exts = eglQueryString(egl.display, EGL_EXTENSIONS);
+    size_t len = strlen(name);
+
+    while (exts && (exts = strstr(exts, name))) {
+        if (exts[len] == ' ' || exts[len] == '\0')
+            return true;
+        exts += len;
+    }
+    return false;
+}
+
+static int load_dmabuf_import() {
+    if (create_image)
+        return 0;
+
+    if (!has_egl_extension("EGL_EXT_image_dma_buf_import")) {
+        printf("EGL_EXT_image_dma_buf_import not supported\n");
+        return -1;
+    }
+
+    create_image = (PFNEGLCREATEIMAGEKHRPROC)eglGetProcAddress("eglCreateImageKHR");
+    destroy_image = (PFNEGLDESTROYIMAGEKHRPROC)eglGetProcAddress("eglDestroyImageKHR");
+    image_target_texture = (PFNGLEGLIMAGETARGETTEXTURE2DOESPROC)eglGetProcAddress("glEGLImageTargetTexture2DOES");
+    if (!create_image || !destroy_image || !image_target_texture) {
+        printf("EGLImage entry points not available\n");
+        create_image = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+int native_fence_init() {
+    if (dup_native_fence_fd)
+        return 0;
+
+    if (!has_egl_extension("EGL_ANDROID_native_fence_sync") || !has_egl_extension("EGL_KHR_wait_sync")) {
+        printf("EGL_ANDROID_native_fence_sync / EGL_KHR_wait_sync not supported\n");
+        return -1;
+    }
+
+    create_sync = (PFNEGLCREATESYNCKHRPROC)eglGetProcAddress("eglCreateSyncKHR");
+    destroy_sync = (PFNEGLDESTROYSYNCKHRPROC)eglGetProcAddress("eglDestroySyncKHR");
+    wait_sync = (PFNEGLWAITSYNCKHRPROC)eglGetProcAddress("eglWaitSyncKHR");
+    client_wait_sync = (PFNEGLCLIENTWAITSYNCKHRPROC)eglGetProcAddress("eglClientWaitSyncKHR");
+    dup_native_fence_fd = (PFNEGLDUPNATIVEFENCEFDANDROIDPROC)eglGetProcAddress("eglDupNativeFenceFDANDROID");
+    if (!create_sync || !destroy_sync || !wait_sync || !client_wait_sync || !dup_native_fence_fd) {
+        printf("EGL fence entry points not available\n");
+        dup_native_fence_fd = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+int render_fence_export() {
+    if (!dup_native_fence_fd)
+        return -1;
+
+    EGLSyncKHR sync = create_sync(egl.display, EGL_SYNC_NATIVE_FENCE_ANDROID, NULL);
+    if (sync == EGL_NO_SYNC_KHR) {
+        printf("eglCreateSyncKHR failed: %#x\n", eglGetError());
+        return -1;
+    }
+
+    // The fd only exists once the fence command has been flushed to the GPU
+    glFlush();
+    int fence_fd = dup_native_fence_fd(egl.display, sync);
+    destroy_sync(egl.display, sync);
+    if (fence_fd == EGL_NO_NATIVE_FENCE_FD_ANDROID) {
+        printf("eglDupNativeFenceFDANDROID failed: %#x\n", eglGetError());
+        return -1;
+    }
+    return fence_fd;
+}
+
+int render_fence_wait(int fence_fd) {
+    if (!dup_native_fence_fd)
+        return -1;
+
+    const EGLint attribs[] = { EGL_SYNC_NATIVE_FENCE_FD_ANDROID, fence_fd, EGL_NONE };
+    EGLSyncKHR sync = create_sync(egl.display, EGL_SYNC_NATIVE_FENCE_ANDROID, attribs);
+    if (sync == EGL_NO_SYNC_KHR) {
+        printf("eglCreateSyncKHR (import) failed: %#x\n", eglGetError());
+        return -1;
+    }
+
+    // EGL owns fence_fd from here on, so this no longer fails: if the wait
+    // cannot be queued on the GPU, block the CPU on the sync instead
+    if (wait_sync(egl.display, sync, 0) != EGL_TRUE) {
+        printf("eglWaitSyncKHR failed: %#x\n", eglGetError());
+        client_wait_sync(egl.display, sync, 0, 1000000000ull);
+    }
+    destroy_sync(egl.display, sync);
+    return 0;
+}
+
+// Per-plane attribute names of EGL_EXT_image_dma_buf_import(_modifiers)
+static const EGLint plane_attribs[4][5] = {
+    { EGL_DMA_BUF_PLANE0_FD_EXT, EGL_DMA_BUF_PLANE0_OFFSET_EXT, EGL_DMA_BUF_PLANE0_PITCH_EXT,
+      EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT, EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT },
+    { EGL_DMA_BUF_PLANE1_FD_EXT, EGL_DMA_BUF_PLANE1_OFFSET_EXT, EGL_DMA_BUF_PLANE1_PITCH_EXT,
+      EGL_DMA_BUF_PLANE1_MODIFIER_LO_EXT, EGL_DMA_BUF_PLANE1_MODIFIER_HI_EXT },
+    { EGL_DMA_BUF_PLANE2_FD_EXT, EGL_DMA_BUF_PLANE2_OFFSET_EXT, EGL_DMA_BUF_PLANE2_PITCH_EXT,
+      EGL_DMA_BUF_PLANE2_MODIFIER_LO_EXT, EGL_DMA_BUF_PLANE2_MODIFIER_HI_EXT },
+    { EGL_DMA_BUF_PLANE3_FD_EXT, EGL_DMA_BUF_PLANE3_OFFSET_EXT, EGL_DMA_BUF_PLANE3_PITCH_EXT,
+      EGL_DMA_BUF_PLANE3_MODIFIER_LO_EXT, EGL_DMA_BUF_PLANE3_MODIFIER_HI_EXT },
+};
+
+int import_dmabuf_target(int width, int height, uint32_t fourcc, int num_planes, const int *dmabuf_fds,
+                         const uint32_t *strides, const uint32_t *offsets, uint64_t modifier) {
+    if (target_count == MAX_RENDER_TARGETS) {
+        printf("Too many render targets\n");
+        return -1;
+    }
+    if (load_dmabuf_import() < 0)
+        return -1;
+
+    if (num_planes < 1 || num_planes > 4) {
+        printf("Unsupported dma-buf plane count %d\n", num_planes);
+        return -1;
+    }
+    bool with_modifier = modifier != DRM_FORMAT_MOD_INVALID;
+    if (with_modifier && !has_egl_extension("EGL_EXT_image_dma_buf_import_modifiers")) {
+        // Tiled or compressed layouts cannot be described without it
+        if (modifier != DRM_FORMAT_MOD_LINEAR) {
+            printf("EGL_EXT_image_dma_buf_import_modifiers missing for modifier 0x%016llx\n",
+                   (unsigned long long)modifier);
+            return -1;
+        }
+        with_modifier = false;
+    }
+
+    EGLint attribs[7 + 4 * 10];
+    int n = 0;
+    attribs[n++] = EGL_WIDTH;                      attribs[n++] = width;
+    attribs[n++] = EGL_HEIGHT;                     attribs[n++] = height;
+    attribs[n++] = EGL_LINUX_DRM_FOURCC_EXT;       attribs[n++] = (EGLint)fourcc;
+    for (int p = 0; p < num_planes; p++) {
+        attribs[n++] = plane_attribs[p][0];        attribs[n++] = dmabuf_fds[p];
+        attribs[n++] = plane_attribs[p][1];        attribs[n++] = (EGLint)offsets[p];
+        attribs[n++] = plane_attribs[p][2];        attribs[n++] = (EGLint)strides[p];
+        if (with_modifier) {
+            attribs[n++] = plane_attribs[p][3];    attribs[n++] = (EGLint)(modifier & 0xffffffff);
+            attribs[n++] = plane_attribs[p][4];    attribs[n++] = (EGLint)(modifier >> 32);
+        }
+    }
+    attribs[n++] = EGL_NONE;
+
+    // EGL keeps its own reference to the dma-buf, the caller may close the fds
+    EGLImageKHR image = create_image(egl.display, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT, NULL, attribs);
+    if (image == EGL_NO_IMAGE_KHR) {
+        printf("eglCreateImageKHR failed: %#x\n", eglGetError());
+        return -1;
+    }
+
+    int index = target_count;
+    targets[index].image = image;
+
+    glGenTextures(1, &targets[index].tex);
+    glBindTexture(GL_TEXTURE_2D, targets[index].tex);
+    image_target_texture(GL_TEXTURE_2D, (GLeglImageOES)image);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    // Same depth renderbuffer as the internal FBO, only the colour target differs
+    glGenFramebuffers(1, &targets[index].fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, targets[index].fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, targets[index].tex, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_rb);
+
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        printf("dma-buf framebuffer not complete (status: 0x%x)\n", status);
+        glDeleteFramebuffers(1, &targets[index].fbo);
+        glDeleteTextures(1, &targets[index].tex);
+        destroy_image(egl.display, image);
+        return -1;
+    }
+
+    target_count++;
+    return index;
+}
+
+int bind_render_target(int target) {
+    if (target >= target_count)
+        return -1;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, target < 0 ? fbo : targets[target].fbo);
+    return 0;
+}
 
 int setup_textures_framebuffers(int width, int height) {
     // Create framebuffer with depth buffer  
@@ -240,7 +566,7 @@ int setup_textures_framebuffers(int width, int height) {
     return 0;
 }
 
-int render_the_cube(int width, int height, uint8_t* dumb_buffer) {
+int draw_the_cube(int width, int height) {
     // Clear and enable depth test
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -261,20 +587,186 @@ int render_the_cube(int width, int height, uint8_t* dumb_buffer) {
     glBindTexture(GL_TEXTURE_2D, tex);
     glDrawArrays(GL_TRIANGLES, 0, 36);
 
-    // Read pixels to dumb buffer
-    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, dumb_buffer);
+    return 0;
+}
+
+int render_the_cube(int width, int height, uint8_t* dumb_buffer, uint32_t dumb_pitch) {
+    draw_the_cube(width, height);
+
+    if (dumb_buffer && !readback_swizzle && (gles_version >= 3 || dumb_pitch == (uint32_t)width * 4)) {
+        // Same layout as the scanout buffer: read straight into it
+        if (gles_version >= 3)
+            glPixelStorei(GL_PACK_ROW_LENGTH, dumb_pitch / 4);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, dumb_buffer);
+        if (gles_version >= 3)
+            glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+    } else if (dumb_buffer) {
+        size_t size = (size_t)width * height * 4;
+        if (staging_size < size) {
+            free(staging);
+            staging = (uint8_t*)malloc(size);
+            staging_size = staging ? size : 0;
+            if (!staging) {
+                printf("Failed to allocate readback staging buffer\n");
+                return -1;
+            }
+        }
 
+        // GL_RGBA bytes -> XRGB8888 (or copied as is) at the dumb buffer pitch
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, staging);
+        if (readback_swizzle)
+            parallel_convert_rgba_to_xrgb8888(pixel_workers, dumb_buffer, dumb_pitch, staging, width * 4, width, height);
+        else
+            parallel_copy(pixel_workers, dumb_buffer, dumb_pitch, staging, width * 4, width * 4, height);
+    } else {
+        // Rendered straight into a scanout buffer: it must be complete
+        // before the flip that shows it is committed
+        glFinish();
+    }
+
+    return 0;
+}
+
+int readback_init(int width, int height, int depth) {
+    if (gles_version < 3) {
+        printf("Async readback needs an OpenGL ES 3 context\n");
+        return -1;
+    }
+    if (depth < 1 || depth > MAX_READBACK_DEPTH) {
+        printf("Readback depth must be 1-%d (got %d)\n", MAX_READBACK_DEPTH, depth);
+        return -1;
+    }
+
+    readback_depth = depth;
+    readback_head = 0;
+    readback_pending = 0;
+    readback_width = width;
+    readback_height = height;
+
+    for (int i = 0; i < depth; i++) {
+        glGenBuffers(1, &readback_slots[i].pbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback_slots[i].pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, width * height * 4, NULL, GL_STREAM_READ);
+        readback_slots[i].fence = 0;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
     return 0;
 }
 
+int readback_submit() {
+    if (readback_pending == readback_depth)
+        return -1;
+
+    // With a pack buffer bound, glReadPixels only queues the transfer
+    int slot = readback_head;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback_slots[slot].pbo);
+    glReadPixels(0, 0, readback_width, readback_height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    readback_slots[slot].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+
+    readback_head = (readback_head + 1) % readback_depth;
+    readback_pending++;
+    return 0;
+}
+
+int readback_in_flight() {
+    return readback_pending;
+}
+
+int readback_collect(uint8_t* dst, uint32_t dst_pitch, int wait) {
+    if (readback_pending == 0)
+        return 0;
+
+    int slot = (readback_head - readback_pending + readback_depth) % readback_depth;
+    GLsync fence = readback_slots[slot].fence;
+
+    GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? GL_TIMEOUT_IGNORED : 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+        return 0;
+    if (status == GL_WAIT_FAILED) {
+        printf("glClientWaitSync failed: 0x%x\n", glGetError());
+        return -1;
+    }
+
+    glDeleteSync(fence);
+    readback_slots[slot].fence = 0;
+
+    uint32_t row_bytes = readback_width * 4;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback_slots[slot].pbo);
+    const uint8_t* src = (const uint8_t*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, row_bytes * readback_height,
+                                                          GL_MAP_READ_BIT);
+    if (src) {
+        // Swizzle (or copy) into the dumb buffer, honouring its pitch
+        if (readback_swizzle)
+            parallel_convert_rgba_to_xrgb8888(pixel_workers, dst, dst_pitch, src, row_bytes, readback_width,
+                                              readback_height);
+        else
+            parallel_copy(pixel_workers, dst, dst_pitch, src, row_bytes, row_bytes, readback_height);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    readback_pending--;
+    return src ? 1 : -1;
+}
+
+void readback_cleanup() {
+    for (int i = 0; i < readback_depth; i++) {
+        if (readback_slots[i].fence)
+            glDeleteSync(readback_slots[i].fence);
+        glDeleteBuffers(1, &readback_slots[i].pbo);
+        readback_slots[i].fence = 0;
+        readback_slots[i].pbo = 0;
+    }
+    readback_depth = 0;
+    readback_pending = 0;
+
+    free(staging);
+    staging = NULL;
+    staging_size = 0;
+}
+
+int set_readback_format(uint32_t fourcc) {
+    switch (fourcc) {
+    case DRM_FORMAT_XRGB8888:
+        readback_swizzle = 1;
+        return 0;
+    case DRM_FORMAT_ABGR8888:
+    case DRM_FORMAT_XBGR8888:
+        readback_swizzle = 0;
+        return 0;
+    default:
+        printf("Readback cannot produce %.4s\n", (const char*)&fourcc);
+        return -1;
+    }
+}
+
+void set_worker_pool(struct worker_pool* pool) {
+    pixel_workers = pool;
+}
+
+void release_render_targets() {
+    if (target_count == 0)
+        return;
+    bind_render_target(-1);
+    for (int i = 0; i < target_count; i++) {
+        glDeleteFramebuffers(1, &targets[i].fbo);
+        glDeleteTextures(1, &targets[i].tex);
+        destroy_image(egl.display, targets[i].image);
+    }
+    target_count = 0;
+}
+
 int cleanup_gl_setup() {
+    release_render_targets();
+    readback_cleanup();
     glDeleteBuffers(1, &vbo);
     glDeleteTextures(1, &tex);
     glDeleteProgram(program);
     glDeleteTextures(1, &fbo_tex);
     glDeleteRenderbuffers(1, &depth_rb);
     glDeleteFramebuffers(1, &fbo);
-    
-
     return 0;
 }
\ No newline at end of file
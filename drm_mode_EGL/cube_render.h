@@ -7,6 +7,8 @@
 #include <GLES2/gl2ext.h>
 #include <stdint.h>
 
+struct worker_pool;
+
 // Function pointer type for the extension
 typedef EGLDisplay (EGLAPIENTRY *PFNEGLGETPLATFORMDISPLAYEXTPROC)(EGLenum platform, void *native_display, const EGLint *attrib_list);
 
@@ -22,9 +24,62 @@ struct {
 extern "C" {
 #endif
 
-int EGL_init(int width, int height);
-int render_the_cube(int width, int height, uint8_t* dumb_buffer);
+// Create the GLES context. render_node (e.g. /dev/dri/renderD128) selects
+// the EGL device of that GPU so frames are drawn where they are scanned
+// out; NULL, "" or no matching device falls back to Mesa's surfaceless
+// platform, then the default display.
+int EGL_init(int width, int height, const char* render_node);
+// Draw and copy the frame into dumb_buffer as XRGB8888, one row every
+// dumb_pitch bytes
+int render_the_cube(int width, int height, uint8_t* dumb_buffer, uint32_t dumb_pitch);
+
+// Draw only, no readback or sync (used with the readback ring below)
+int draw_the_cube(int width, int height);
 int setup_textures_framebuffers(int width, int height);
+
+// Wrap a dma-buf (e.g. an exported gbm_bo) in an EGLImage and make it the
+// colour attachment of its own FBO. Call after setup_textures_framebuffers().
+// One fd / stride / offset per memory plane (up to 4, e.g. a compressed
+// layout's aux plane); every plane shares modifier.
+// Returns the render target index, or -1 on failure.
+int import_dmabuf_target(int width, int height, uint32_t fourcc, int num_planes, const int *dmabuf_fds,
+                         const uint32_t *strides, const uint32_t *offsets, uint64_t modifier);
+
+// Select where render_the_cube() draws: a target from import_dmabuf_target(),
+// or -1 for the internal texture FBO. Pass dumb_buffer = NULL to
+// render_the_cube() when drawing into an imported target.
+int bind_render_target(int target);
+// Drop every imported target (e.g. to retry with other buffers)
+void release_render_targets();
+
+// Explicit sync (EGL_ANDROID_native_fence_sync + EGL_KHR_wait_sync).
+// render_fence_export() flushes and returns a sync_file fd that signals when
+// the GPU has finished everything drawn so far (-1 on failure), suitable for
+// a plane's IN_FENCE_FD. render_fence_wait() makes later GL commands wait
+// for fence_fd on the GPU without blocking the CPU (or blocks on it when the
+// GPU wait cannot be queued). It returns 0 once it owns fence_fd, -1 if the
+// fd could not be imported and the caller still owns it.
+int native_fence_init();
+int render_fence_export();
+int render_fence_wait(int fence_fd);
+
+// Asynchronous readback ring for the dumb-buffer path (needs GLES3).
+// readback_submit() queues a glReadPixels of the current frame into one of
+// depth pixel-pack buffers and fences it; readback_collect() converts the
+// oldest finished frame to XRGB8888 at dst (row pitch dst_pitch) and returns 1, or 0 if
+// nothing is ready (wait = 0) / in flight. Frames reach the screen
+// depth - 1 frames after they were drawn.
+int readback_init(int width, int height, int depth);
+int readback_submit();
+int readback_in_flight();
+int readback_collect(uint8_t* dst, uint32_t dst_pitch, int wait);
+void readback_cleanup();
+// Scanout format the readbacks write: DRM_FORMAT_XRGB8888 (default) swizzles
+// the GL_RGBA bytes, DRM_FORMAT_ABGR8888 / XBGR8888 are the same layout and
+// are read back without a conversion pass. Returns -1 for other formats.
+int set_readback_format(uint32_t fourcc);
+// Split CPU-side readback conversions across pool (NULL = calling thread)
+void set_worker_pool(struct worker_pool* pool);
 int cleanup_gl_setup();
 
 #ifdef __cplusplus
@@ -11,350 +11,571 @@
 #include <ctype.h>
 #include <getopt.h>
 #include <inttypes.h>
+#include <signal.h>
+#include <sys/resource.h>
 
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 #include <drm_fourcc.h>
 
 #include "cube_render.h"
-
-// Helper function to get the *value* of a property by name for a given plane
-static int get_property_value(int drm_fd, uint32_t plane_id, const char *name) {
-    drmModeObjectPropertiesPtr props = drmModeObjectGetProperties(drm_fd, plane_id, DRM_MODE_OBJECT_PLANE);
-    if (!props)
+#include "drm_blob.h"
+#include "drm_device.h"
+#include "drm_formats.h"
+#include "drm_props.h"
+#include "event_loop.h"
+#include "fb_pool.h"
+#include "frame_stats.h"
+#include "prime.h"
+#include "swapchain.h"
+#include "takeover.h"
+#include "topology_cache.h"
+#include "worker_pool.h"
+
+// Take a dumb framebuffer from the pool for one swapchain slot. The pool
+// keeps the buffer, its mapping and FB ID together across runs of the loop.
+static int create_fb(struct fb_pool *fbs, const drmModeModeInfo *mode, struct swap_buffer *buf,
+                     struct worker_pool *workers, uint32_t fourcc) {
+    int width = mode->hdisplay;
+    int height = mode->vdisplay;
+
+    struct fb_pool_entry *fb = fb_pool_acquire(fbs, width, height, fourcc, DRM_FORMAT_MOD_INVALID);
+    if (!fb)
         return -1;
 
-    for (uint32_t i = 0; i < props->count_props; i++) {
-        drmModePropertyPtr prop = drmModeGetProperty(drm_fd, props->props[i]);
-        if (!prop)
-            continue;
+    buf->owner = fb;
+    buf->fb_id = fb->fb_id;
+    buf->handle = fb->handles[0];
+    buf->pitch = fb->pitches[0];
+    buf->size = fb->size;
+    buf->map = fb->map;
+    buf->map_pitch = fb->map_pitch;
+
+    // Fill with blue (XRGB: 0xFF0000FF, XBGR: 0xFFFF0000)
+    uint32_t color = fourcc == DRM_FORMAT_XRGB8888 ? 0xFF0000FF : 0xFFFF0000;
+    if (buf->map)
+        parallel_fill_xrgb8888(workers, buf->map, buf->map_pitch, width, height, color);
+    return 0;
+}
 
-        if (strcmp(prop->name, name) == 0) {
-            uint64_t value = props->prop_values[i];
-            drmModeFreeProperty(prop);
-            drmModeFreeObjectProperties(props);
-            return (int)value;
-        }
+// Hand a swapchain slot's framebuffer back to the pool
+static void destroy_fb(struct fb_pool *fbs, struct swap_buffer *buf) {
+    fb_pool_release(fbs, buf->owner);
+    memset(buf, 0, sizeof(*buf));
+    buf->render_target = -1;
+    buf->release_fence = -1;
+}
 
-        drmModeFreeProperty(prop);
-    }
+// One-time full modeset: route connector -> CRTC -> plane, set the mode and
+// activate the CRTC. The MODE_ID blob comes from the blob cache and stays
+// referenced until the cache is destroyed at exit.
+// With DRM_MODE_ATOMIC_TEST_ONLY in flags the kernel only checks whether
+// the configuration (e.g. a buffer from another device) would work.
+int modeset_fb(int drm_fd, struct drm_blob_cache *blobs, const struct drm_object_props *conn_props,
+               const struct drm_object_props *crtc_props, const struct drm_object_props *plane_props,
+               uint32_t crtc_id, const drmModeModeInfo *mode, int fb_id, uint32_t flags) {
+    uint32_t blob_id = drm_mode_blob_get(blobs, mode);
+    if (!blob_id)
+        return -1;
 
-    drmModeFreeObjectProperties(props);
-    return -1;
-}
+    drmModeAtomicReq *req = drmModeAtomicAlloc();
+    if (!req) {
+        fprintf(stderr, "Failed to allocate atomic request\n");
+        drm_mode_blob_put(blobs, blob_id);
+        return -1;
+    }
 
-// Helper function to get the *ID* of a property by name for a given DRM object
-static uint32_t get_property_id(int drm_fd, uint32_t obj_id, uint32_t obj_type, const char *name) {
-    drmModeObjectProperties *props = drmModeObjectGetProperties(drm_fd, obj_id, obj_type);
-    if (!props)
-        return 0;
+    // Plane setup
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_FB_ID, fb_id);
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_CRTC_ID, crtc_id);
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_SRC_X, 0);
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_SRC_Y, 0);
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_SRC_W, mode->hdisplay << 16);
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_SRC_H, mode->vdisplay << 16);
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_CRTC_X, 0);
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_CRTC_Y, 0);
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_CRTC_W, mode->hdisplay);
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_CRTC_H, mode->vdisplay);
 
-    uint32_t prop_id = 0;
-    for (uint32_t i = 0; i < props->count_props; i++) {
-        drmModePropertyPtr prop = drmModeGetProperty(drm_fd, props->props[i]);
-        if (!prop)
-            continue;
+    // Connector + CRTC setup
+    drm_props_add(req, conn_props, DRM_PROP_CONNECTOR_CRTC_ID, crtc_id);
+    drm_props_add(req, crtc_props, DRM_PROP_CRTC_MODE_ID, blob_id);
+    drm_props_add(req, crtc_props, DRM_PROP_CRTC_ACTIVE, 1);
+
+    // Blocking commit: the display is fully up before the first flip is queued
+    int test_only = flags & DRM_MODE_ATOMIC_TEST_ONLY;
+    int ret = drmModeAtomicCommit(drm_fd, req, DRM_MODE_ATOMIC_ALLOW_MODESET | flags, NULL);
+    if (ret < 0 && !test_only)
+        perror("drmModeAtomicCommit (modeset) failed");
+    else if (!test_only)
+        printf("[ATOMIC]   : Modeset successful\n");
+
+    // A checked-only configuration holds no reference to the blob
+    if (ret < 0 || test_only)
+        drm_mode_blob_put(blobs, blob_id);
 
-        if (strcmp(prop->name, name) == 0)
-            prop_id = prop->prop_id;
+    drmModeAtomicFree(req);
+    return ret;
+}
 
-        drmModeFreeProperty(prop);
-        if (prop_id)
-            break;
+// Per-frame flip: only the plane's FB_ID changes, so the driver never has to
+// check a modeset and no blob is created. Completion is reported through a
+// page-flip event carrying user_data (the swapchain).
+int flip_fb(int drm_fd, const struct drm_object_props *plane_props, int fb_id, void *user_data) {
+    drmModeAtomicReq *req = drmModeAtomicAlloc();
+    if (!req) {
+        fprintf(stderr, "Failed to allocate atomic request\n");
+        return -1;
     }
 
-    drmModeFreeObjectProperties(props);
-    return prop_id;
-}
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_FB_ID, fb_id);
 
-// Find the first connected connector with a valid mode
-static int fetch_connector(int drm_fd, drmModeRes *resources, drmModeConnector **connector_out) {
-    for (int i = 0; i < resources->count_connectors; i++) {
-        drmModeConnector *conn = drmModeGetConnector(drm_fd, resources->connectors[i]);
-        if (!conn)
-            continue;
-
-        if ((conn->connection == DRM_MODE_CONNECTED) && (conn->modes != NULL)) {
-            *connector_out = conn;
-            printf("[CONNECTOR]: ID = %d and STATUS = CONNECTED\n", conn->connector_id);
-            printf("[MODE]     : %dx%d @%dHz\n", conn->modes->hdisplay, conn->modes->vdisplay, conn->modes->vrefresh);
-            return 0;
-        }
+    int ret = drmModeAtomicCommit(drm_fd, req, DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT, user_data);
+    if (ret < 0)
+        perror("drmModeAtomicCommit (flip) failed");
 
-        drmModeFreeConnector(conn);
-    }
-    return -1;
+    drmModeAtomicFree(req);
+    return ret;
 }
 
-// Pick a CRTC from the resource list (can be improved to match connector's encoder)
-static int fetch_crtc(int drm_fd, drmModeRes *resources, drmModeConnector *connector, drmModeCrtc **crtc_out, int *crtc_indx) {
-    for (int i = 0; i < resources->count_crtcs; i++) {
-        drmModeCrtc *crtc = drmModeGetCrtc(drm_fd, resources->crtcs[i]);
-        if (crtc) {
-            *crtc_out = crtc;
-            printf("[CRTC]     : ID = %d\n", crtc->crtc_id);
-            *crtc_indx = i;
-            return 0;
-        }
+// Swapchain buffers shared between the render device and the KMS device
+// for a zero-copy PRIME strategy: every buffer must import into GL as a
+// render target and the first must pass a TEST_ONLY modeset. On failure
+// nothing is left allocated and fbs is empty.
+static int create_prime_fbs(struct fb_pool *fbs, struct prime_device *prime, enum prime_strategy strategy,
+                            const struct kms_output *out, struct drm_blob_cache *blobs, struct swapchain *sc,
+                            struct worker_pool *workers) {
+    const struct fb_pool_backend *backend =
+        strategy == PRIME_RENDER_ALLOC ? &prime_render_alloc_backend : &prime_display_alloc_backend;
+    int width = out->mode.hdisplay;
+    int height = out->mode.vdisplay;
+    int ok = 1;
+
+    fb_pool_init(fbs, prime->kms_fd, backend, prime, SWAPCHAIN_MAX_BUFFERS);
+    for (int i = 0; i < sc->count && ok; i++) {
+        struct swap_buffer *buf = &sc->buffers[i];
+        ok = create_fb(fbs, &out->mode, buf, workers, DRM_FORMAT_XRGB8888) == 0;
+        if (!ok)
+            break;
+
+        const struct fb_pool_entry *fb = buf->owner;
+        int dmabuf_fd = prime_buffer_fd(fb);
+        buf->render_target = import_dmabuf_target(width, height, DRM_FORMAT_XRGB8888, 1, &dmabuf_fd, fb->pitches,
+                                                  fb->offsets, DRM_FORMAT_MOD_LINEAR);
+        ok = buf->render_target >= 0;
     }
+    ok = ok && modeset_fb(prime->kms_fd, blobs, &out->conn_props, &out->crtc_props, &out->plane_props,
+                          out->crtc_id, &out->mode, sc->buffers[0].fb_id, DRM_MODE_ATOMIC_TEST_ONLY) == 0;
+    if (ok)
+        return 0;
+
+    release_render_targets();
+    for (int i = 0; i < sc->count; i++)
+        destroy_fb(fbs, &sc->buffers[i]);
+    fb_pool_destroy(fbs);
     return -1;
 }
 
-// Find the primary plane associated with the selected CRTC
-static int fetch_plane(int drm_fd, drmModeCrtc *crtc, drmModePlane **plane_out, int crtc_indx) {
-    drmModePlaneRes *planes = drmModeGetPlaneResources(drm_fd);
-    if (!planes)
-        return -1;
-
-    for (uint32_t i = 0; i < planes->count_planes; i++) {
-        drmModePlane *plane = drmModeGetPlane(drm_fd, planes->planes[i]);
-        if (!plane)
-            continue;
-
-        if (plane->possible_crtcs & (1 << crtc_indx)) {
-            int type = get_property_value(drm_fd, plane->plane_id, "type");
-            if (type == DRM_PLANE_TYPE_PRIMARY) {
-                printf("[PLANE]    : ID = %d and TYPE = PRIMARY\n", plane->plane_id);
-                *plane_out = plane;
-                drmModeFreePlaneResources(planes);
-                return 0;
+// State shared by the event-loop callbacks that drive rendering
+struct render_loop {
+    struct event_loop loop;
+    int drm_fd;
+    struct swapchain *swapchain;
+    const struct drm_object_props *plane_props;
+    int width;
+    int height;
+    int frame_count;            // flips to complete before quitting
+    int readback_depth;         // frames in the async readback ring, 0 = synchronous glReadPixels
+    int frames_rendered;
+    int frames_presented;
+    int window_flips;           // flips since the last stats tick
+    struct swap_buffer *ready;  // rendered, waiting for the in-flight flip
+    double last_flip_ms;
+    struct latency_stats render_time;
+    struct latency_stats readback_wait;
+    struct latency_stats flip_latency;
+    struct latency_stats frame_interval;
+};
+
+// Render the next frame into a buffer the display is not reading
+static void render_next(struct render_loop *rl) {
+    if (rl->ready || rl->frames_rendered >= rl->frame_count)
+        return;
+
+    // Every buffer busy: the next flip event hands one back
+    struct swap_buffer *buf = swapchain_acquire(rl->swapchain);
+    if (!buf)
+        return;
+
+    double render_start = now_ms();
+    if (buf->render_target >= 0) {
+        // Shared with the render device: draw straight into the scanout
+        // buffer. render_the_cube() finishes the frame before returning,
+        // fences are not shared across the two drivers.
+        bind_render_target(buf->render_target);
+        render_the_cube(rl->width, rl->height, NULL, 0);
+    } else if (rl->readback_depth > 0) {
+        // Keep readback_depth frames in flight: the frame copied into buf
+        // now was drawn readback_depth - 1 frames ago, so the fence wait is
+        // normally already satisfied. The first call primes the ring.
+        int copied = 0;
+        while (!copied) {
+            draw_the_cube(rl->width, rl->height);
+            readback_submit();
+            if (readback_in_flight() < rl->readback_depth)
+                continue;
+
+            double wait_start = now_ms();
+            copied = readback_collect(buf->map, buf->map_pitch, 1);
+            latency_stats_add(&rl->readback_wait, now_ms() - wait_start);
+            if (copied < 0) {
+                fprintf(stderr, "Frame %d: readback failed\n", rl->frames_rendered + 1);
+                break;
             }
         }
-
-        drmModeFreePlane(plane);
+    } else {
+        render_the_cube(rl->width, rl->height, buf->map, buf->map_pitch);
     }
+    rl->ready = buf;
+    rl->frames_rendered++;
 
-    drmModeFreePlaneResources(planes);  
-    return -1;
+    double render_ms = now_ms() - render_start;
+    latency_stats_add(&rl->render_time, render_ms);
+    printf("Frame %d: Render time = %.3f ms\n", rl->frames_rendered, render_ms);
 }
 
-// Fill the framebuffer with a solid color (XRGB8888 format)
-static int fill_color(uint8_t *data, int size, uint32_t color) {
-    for (int i = 0; i < size; i += 4) {
-        *(uint32_t *)(data + i) = color; // 4 bytes per pixel
+// Commit the rendered buffer unless the CRTC still has a flip in flight
+static int present_ready(struct render_loop *rl) {
+    if (!rl->ready || swapchain_flip_pending(rl->swapchain))
+        return 0;
+
+    double commit_start = now_ms();
+    if (flip_fb(rl->drm_fd, rl->plane_props, rl->ready->fb_id, rl->swapchain) < 0) {
+        fprintf(stderr, "Frame %d: Atomic commit failed\n", rl->frames_rendered);
+        return -1;
     }
+    latency_stats_add(&rl->flip_latency, now_ms() - commit_start);
+
+    swapchain_queue(rl->swapchain, rl->ready);
+    rl->ready = NULL;
     return 0;
 }
 
-// Create a framebuffer using dumb buffer and map it to userspace memory
-static int create_fb(int drm_fd, drmModeCrtc *crtc, int *fb_id, uint8_t **out_Address) {
-    int width = crtc->mode.hdisplay;
-    int height = crtc->mode.vdisplay;
-
-    struct drm_mode_create_dumb create = {
-        .height = (uint32_t)height,
-        .width = (uint32_t)width,
-        .bpp = 32 // 4 bytes per pixel (XRGB8888)
-    };
+// Queue what is ready, then render ahead into the next free buffer
+static void advance(struct render_loop *rl) {
+    if (rl->frames_presented >= rl->frame_count) {
+        event_loop_quit(&rl->loop);
+        return;
+    }
 
-    // Create dumb buffer
-    if (drmIoctl(drm_fd, DRM_IOCTL_MODE_CREATE_DUMB, &create) < 0) {
-        perror("DRM_IOCTL_MODE_CREATE_DUMB failed");
-        return -1;
+    if (present_ready(rl) < 0) {
+        event_loop_quit(&rl->loop);
+        return;
     }
+    render_next(rl);
+    if (present_ready(rl) < 0)
+        event_loop_quit(&rl->loop);
+}
 
-    uint32_t handle = create.handle;
-    uint32_t stride = create.pitch;
-    uint32_t size = create.size;
+// DRM fd readable: flip completions arrive here
+static void on_drm_event(int fd, uint32_t events, void *data) {
+    struct render_loop *rl = data;
+    unsigned int flips = rl->swapchain->flips;
 
-    uint32_t handles[4] = {handle};
-    uint32_t strides[4] = {stride};
-    uint32_t offsets[4] = {0};
+    (void)fd;
+    (void)events;
 
-    // Add framebuffer
-    if (drmModeAddFB2(drm_fd, width, height, DRM_FORMAT_XRGB8888, handles, strides, offsets, (uint32_t*)fb_id, 0) != 0) {
-        perror("drmModeAddFB2 failed");
-        return -1;
+    if (swapchain_dispatch(rl->swapchain) != 0) {
+        event_loop_quit(&rl->loop);
+        return;
     }
 
-    printf("[FB]       : ID = %d\n", *fb_id);
-
-    // Map dumb buffer to userspace
-    struct drm_mode_map_dumb map = {.handle = handle};
-    if (drmIoctl(drm_fd, DRM_IOCTL_MODE_MAP_DUMB, &map) < 0) {
-        perror("DRM_IOCTL_MODE_MAP_DUMB failed");
-        return -1;
+    if (rl->swapchain->flips != flips) {
+        // Delivery interval measured on the kernel's flip timestamps
+        if (rl->last_flip_ms > 0.0)
+            latency_stats_add(&rl->frame_interval, rl->swapchain->flip_time_ms - rl->last_flip_ms);
+        rl->last_flip_ms = rl->swapchain->flip_time_ms;
+        rl->frames_presented++;
+        rl->window_flips++;
     }
 
-    void *data = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, drm_fd, map.offset);
-    if (data == MAP_FAILED) {
-        perror("mmap failed");
-        return -1;
-    }
+    advance(rl);
+}
 
-    // Fill with blue (XRGB: 0xFF0000FF)
-    uint32_t color = 0xFF0000FF;
-    fill_color((uint8_t*)data, size, color);
+// Once per second: report the presentation rate
+static void on_stats_timer(int fd, uint32_t events, void *data) {
+    struct render_loop *rl = data;
 
-    *out_Address = (uint8_t *)data;
-    return 0;
-}
+    (void)fd;
+    (void)events;
 
-// Perform atomic commit to set plane, mode, and activate the display
-int commit_fb(int drm_fd, drmModeConnector *connector, drmModeCrtc *crtc, drmModePlane *plane, int fb_id) {
-    drmModeAtomicReq *req = drmModeAtomicAlloc();
-    if (!req) {
-        fprintf(stderr, "Failed to allocate atomic request\n");
-        return -1;
-    }
+    printf("[LOOP]     : %d flips/s, %d frames presented\n", rl->window_flips, rl->frames_presented);
+    rl->window_flips = 0;
+}
 
-    #define PROP_ID(obj, type, name) get_property_id(drm_fd, obj, type, name)
+// SIGINT / SIGTERM: leave the loop and clean up normally
+static void on_signal(int fd, uint32_t signo, void *data) {
+    struct render_loop *rl = data;
 
-    // Create a MODE_ID blob from crtc mode
-    drmModePropertyBlobPtr mode_blob;
-    uint32_t blob_id = 0;
-    drmModeCreatePropertyBlob(drm_fd, &crtc->mode, sizeof(crtc->mode), &blob_id);
+    (void)fd;
 
-    // Plane setup
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "FB_ID"), fb_id);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_ID"), crtc->crtc_id);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_X"), 0);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_Y"), 0);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_W"), crtc->mode.hdisplay << 16);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_H"), crtc->mode.vdisplay << 16);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_X"), 0);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_Y"), 0);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_W"), crtc->mode.hdisplay);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_H"), crtc->mode.vdisplay);
+    printf("[LOOP]     : Caught signal %u, stopping\n", signo);
+    event_loop_quit(&rl->loop);
+}
 
-    // Connector + CRTC setup
-    drmModeAtomicAddProperty(req, connector->connector_id, PROP_ID(connector->connector_id, DRM_MODE_OBJECT_CONNECTOR, "CRTC_ID"), crtc->crtc_id);
-    drmModeAtomicAddProperty(req, crtc->crtc_id, PROP_ID(crtc->crtc_id, DRM_MODE_OBJECT_CRTC, "MODE_ID"), blob_id);
-    drmModeAtomicAddProperty(req, crtc->crtc_id, PROP_ID(crtc->crtc_id, DRM_MODE_OBJECT_CRTC, "ACTIVE"), 1);
-
-    // Do the commit
-    int ret = drmModeAtomicCommit(drm_fd, req, DRM_MODE_ATOMIC_ALLOW_MODESET | DRM_MODE_ATOMIC_NONBLOCK, NULL);
-    if (ret < 0) {
-        perror("drmModeAtomicCommit failed");
-    } else {
-        printf("[ATOMIC]   : Commit successful\n");
-    }
+// User + system CPU time consumed by this process, in milliseconds
+static double cpu_time_ms(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec * 1000.0 + usage.ru_utime.tv_usec / 1000.0 +
+           usage.ru_stime.tv_sec * 1000.0 + usage.ru_stime.tv_usec / 1000.0;
+}
 
-    drmModeAtomicFree(req);
-    return ret;
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-b buffers] [-d depth] [-p device] [-t threads] [-n node]\n", prog);
+    fprintf(stderr, "  -b buffers   swapchain length, %d-%d (default 3)\n",
+            SWAPCHAIN_MIN_BUFFERS, SWAPCHAIN_MAX_BUFFERS);
+    fprintf(stderr, "  -d depth     async readback pipeline depth, 0 = synchronous glReadPixels\n"
+                    "               (default 2, adds depth - 1 frames of latency)\n");
+    fprintf(stderr, "  -p device    render on another device (render node, or vgem's card node)\n"
+                    "               and share buffers with the KMS device over PRIME\n");
+    fprintf(stderr, "  -t threads   CPU threads for pixel fills and copies, 0 = all CPUs (default)\n");
+    fprintf(stderr, "  -n node      pin those threads to a NUMA node (default: not pinned)\n");
 }
 
-int main() {
-    // Open DRM device
-    int drm_fd = open("/dev/dri/card1", O_RDWR | O_NONBLOCK);
-    if (drm_fd < 0) {
-        perror("Failed to open DRM device");
-        return -1;
+int main(int argc, char **argv) {
+    struct takeover takeover = { .start_ms = now_ms() };
+    int buffer_count = 3;
+    int threads = 0;
+    int numa_node = -1;
+    int readback_depth = 2;
+    const char *prime_path = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:d:p:t:n:h")) != -1) {
+        switch (opt) {
+        case 'b':
+            buffer_count = atoi(optarg);
+            break;
+        case 't':
+            threads = atoi(optarg);
+            break;
+        case 'n':
+            numa_node = atoi(optarg);
+            break;
+        case 'd':
+            readback_depth = atoi(optarg);
+            break;
+        case 'p':
+            prime_path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : -1;
+        }
     }
 
-    // Enable atomic + universal planes
-    drmSetClientCap(drm_fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1);
-    drmSetClientCap(drm_fd, DRM_CLIENT_CAP_ATOMIC, 1);
-
-    // Get DRM resources
-    drmModeRes *resources = drmModeGetResources(drm_fd);
-    if (!resources) {
-        perror("Failed to get DRM resources");
-        close(drm_fd);
+    // Open the KMS device, atomic + universal planes enabled
+    struct drm_device_info dev;
+    int drm_fd = drm_device_open(&dev);
+    if (drm_fd < 0)
         return -1;
-    }
 
-    drmModeConnector *connector = NULL;
-    drmModeCrtc *crtc = NULL;
-    drmModePlane *plane = NULL;
-    uint32_t fb_id = 0;
-    uint8_t *dumb_buffer_data = NULL;
+    static struct kms_topology topo;
+    const struct kms_output *out = NULL;
+    struct drm_blob_cache blobs;
+    struct fb_pool fbs;
+    struct swapchain swapchain;
+    struct worker_pool workers;
+    struct format_choice format;
+    struct prime_device prime = { .render_fd = -1 };
+    enum prime_strategy strategy = PRIME_COPY;
     int width = 0;
     int height = 0;
-    int crtc_indx;
-    
-    if (fetch_connector(drm_fd, resources, &connector) != 0) {
-        fprintf(stderr, "Failed to find connector\n");
-        goto cleanup;
-    }
 
-    if (fetch_crtc(drm_fd, resources, connector, &crtc, &crtc_indx) != 0) {
-        fprintf(stderr, "Failed to find CRTC\n");
-        goto cleanup;
+    drm_blob_cache_init(&blobs, drm_fd);
+    fb_pool_init(&fbs, drm_fd, &fb_pool_dumb_backend, NULL, SWAPCHAIN_MAX_BUFFERS);
+    if (swapchain_init(&swapchain, drm_fd, buffer_count) != 0) {
+        usage(argv[0]);
+        close(drm_fd);
+        return -1;
     }
 
-    if (fetch_plane(drm_fd, crtc, &plane, crtc_indx) != 0) {
-        fprintf(stderr, "Failed to find plane\n");
-        goto cleanup;
+    // CPU-side pixel work (fills, readback conversion) is split into row bands
+    if (worker_pool_init(&workers, threads, numa_node) != 0) {
+        close(drm_fd);
+        return -1;
     }
 
-    
-    width = connector->modes[0].hdisplay;
-    height = connector->modes[0].vdisplay;
-   
-    if (create_fb(drm_fd, crtc, &fb_id, &dumb_buffer_data) != 0) {
-        fprintf(stderr, "Failed to create framebuffer\n");
+    // Connector, CRTC, primary plane and their property IDs: from the
+    // topology snapshot when the device has not changed since it was saved
+    if (topology_solve_cached(drm_fd, NULL, &topo) <= 0) {
+        fprintf(stderr, "Failed to find a connected output\n");
         goto cleanup;
     }
+    out = &topo.outputs[0];
+    printf("[CONNECTOR]: ID = %d (%s) and STATUS = CONNECTED\n", out->connector_id, out->name);
+    printf("[MODE]     : %dx%d @%dHz\n", out->mode.hdisplay, out->mode.vdisplay, out->mode.vrefresh);
+    printf("[CRTC]     : ID = %d\n", out->crtc_id);
+    printf("[PLANE]    : ID = %d and TYPE = PRIMARY\n", out->plane_id);
+
+    width = out->mode.hdisplay;
+    height = out->mode.vdisplay;
+
+    // GL reads back RGBA bytes (ABGR8888): scan them out as they are if the
+    // plane has that layout, swizzle to XRGB8888 otherwise
+    if (format_negotiate(DRM_FORMAT_ABGR8888, out->formats, out->count_formats, &format) != 0)
+        goto cleanup;
+    printf("[FORMAT]   : GL RGBA -> %.4s (%s), %.1f MB/frame of conversion avoided\n",
+           (const char *)&format.fourcc, format_conversion_name(format.conversion),
+           format_bytes_avoided(&format, width, height) / 1e6);
 
-    // Initialize EGL and OpenGL
-    if (EGL_init(width, height) < 0) {
+    // Initialize EGL and OpenGL, on the other device with -p
+    if (prime_path && prime_device_init(&prime, drm_fd, prime_path) != 0)
+        goto cleanup;
+    if (EGL_init(width, height, prime_path ? prime_path : dev.render) < 0) {
         fprintf(stderr, "Failed to initialize EGL\n");
         goto cleanup;
     }
 
+    set_worker_pool(&workers);
+
     // Set up textures and framebuffers once
     if (setup_textures_framebuffers(width, height) < 0) {
         fprintf(stderr, "Failed to setup textures and framebuffers\n");
         goto cleanup;
     }
 
-    // Perform initial atomic commit to set mode 
-    if (commit_fb(drm_fd, connector, crtc, plane, fb_id) < 0) {
-        fprintf(stderr, "Initial atomic commit failed\n");
-        goto cleanup;
+    // Across devices: share the swapchain buffers if this pair of devices
+    // allows it, cheapest strategy first
+    if (prime_path) {
+        fb_pool_destroy(&fbs);
+        for (strategy = PRIME_RENDER_ALLOC; strategy < PRIME_COPY; strategy++) {
+            if (create_prime_fbs(&fbs, &prime, strategy, out, &blobs, &swapchain, &workers) == 0)
+                break;
+            printf("[PRIME]    : not possible: %s\n", prime_strategy_name(strategy));
+        }
+        if (strategy == PRIME_COPY)
+            fb_pool_init(&fbs, drm_fd, &fb_pool_dumb_backend, NULL, SWAPCHAIN_MAX_BUFFERS);
+        printf("[PRIME]    : %s\n", prime_strategy_name(strategy));
     }
 
-    // Main render loop
-    clock_t start_time = clock();
-    int frame_count = 1000;
-    
-    for (int i = 0; i < frame_count; i++) {
-        clock_t frame_start = clock();
-        
-        // Render the cube
-        render_the_cube(width, height, dumb_buffer_data);
-        
-        // Perform atomic commit
-        if (commit_fb(drm_fd, connector, crtc, plane, fb_id) < 0) {
-            fprintf(stderr, "Frame %d: Atomic commit failed\n", i);
-            break;
+    if (strategy == PRIME_COPY) {
+        // One framebuffer per swapchain slot
+        for (int i = 0; i < swapchain.count; i++) {
+            if (create_fb(&fbs, &out->mode, &swapchain.buffers[i], &workers, format.fourcc) != 0) {
+                fprintf(stderr, "Failed to create framebuffer %d\n", i);
+                goto cleanup;
+            }
+        }
+        if (set_readback_format(format.fourcc) != 0)
+            goto cleanup;
+
+        // Pixel-pack buffer ring; without GLES3 fall back to synchronous readback
+        if (readback_depth > 0 && readback_init(width, height, readback_depth) != 0) {
+            fprintf(stderr, "Async readback unavailable, using synchronous glReadPixels\n");
+            readback_depth = 0;
         }
-        
-        // Calculate frame time
-        clock_t frame_end = clock();
-        double frame_time = (double)(frame_end - frame_start) / CLOCKS_PER_SEC;
-        double fps = 1.0 / frame_time;
-        
-        printf("Frame %d: Time = %.3f ms, FPS = %.2f\n", i + 1, frame_time * 1000.0, fps);
+        printf("[READBACK] : depth = %d\n", readback_depth);
+    } else {
+        readback_depth = 0;
+    }
+    printf("[SWAPCHAIN]: %d buffers\n", swapchain.count);
+
+    // Perform the one-time atomic modeset with the first buffer; a shared
+    // buffer has no CPU fill, so it gets a frame first
+    struct swap_buffer *first = swapchain_acquire(&swapchain);
+    if (first->render_target >= 0) {
+        bind_render_target(first->render_target);
+        render_the_cube(width, height, NULL, 0);
+    }
+
+    // A display already showing this mode on this CRTC (firmware, fbcon, a
+    // previous compositor) gets the first frame as a plain page flip: no
+    // ALLOW_MODESET, so it never blanks
+    takeover_check(drm_fd, &out->conn_props, &out->crtc_props, &out->mode, &takeover);
+    double modeset_start = now_ms();
+    int modeset = !takeover.lit ||
+                  takeover_commit(drm_fd, &out->plane_props, out->crtc_id, &out->mode, first->fb_id) != 0;
+    if (modeset && modeset_fb(drm_fd, &blobs, &out->conn_props, &out->crtc_props, &out->plane_props, out->crtc_id,
+                              &out->mode, first->fb_id, 0) < 0) {
+        fprintf(stderr, "Initial atomic modeset failed\n");
+        goto cleanup;
+    }
+    printf("[ATOMIC]   : %s latency = %.3f ms\n", modeset ? "Modeset" : "First flip", now_ms() - modeset_start);
+    takeover_report(&takeover, modeset);
+    swapchain_present_now(&swapchain, first);
+
+    // Main render loop: sleep in epoll until the DRM fd, the stats timer or
+    // a signal has something for us
+    struct render_loop rl = {
+        .drm_fd = drm_fd,
+        .swapchain = &swapchain,
+        .plane_props = &out->plane_props,
+        .width = width,
+        .height = height,
+        .frame_count = 1000,
+        .readback_depth = readback_depth,
+    };
+    latency_stats_reset(&rl.render_time);
+    latency_stats_reset(&rl.readback_wait);
+    latency_stats_reset(&rl.flip_latency);
+    latency_stats_reset(&rl.frame_interval);
+
+    const int signals[] = { SIGINT, SIGTERM };
+    if (event_loop_init(&rl.loop) != 0 ||
+        !event_loop_add_fd(&rl.loop, drm_fd, EPOLLIN, on_drm_event, &rl) ||
+        !event_loop_add_timer(&rl.loop, 1000, on_stats_timer, &rl) ||
+        !event_loop_add_signals(&rl.loop, signals, 2, on_signal, &rl)) {
+        fprintf(stderr, "Failed to set up event loop\n");
+        event_loop_destroy(&rl.loop);
+        goto cleanup;
     }
 
+    double start_time = now_ms();
+    double start_cpu = cpu_time_ms();
+
+    advance(&rl);
+    event_loop_run(&rl.loop);
+
     // Calculate total time
-    clock_t end_time = clock();
-    double total_time = (double)(end_time - start_time) / CLOCKS_PER_SEC;
-    printf("Total time for rendering %d frames: %.2f seconds\n", frame_count, total_time);
-    printf("Average FPS: %.2f\n", frame_count / total_time);
+    double total_time = (now_ms() - start_time) / 1000.0;
+    double cpu_percent = 100.0 * (cpu_time_ms() - start_cpu) / (total_time * 1000.0);
+    printf("Total time for presenting %d frames: %.2f seconds\n", rl.frames_presented, total_time);
+    printf("Average FPS: %.2f\n", rl.frames_presented / total_time);
+    printf("CPU usage: %.1f%% of one core\n", cpu_percent);
+    if (strategy == PRIME_COPY)
+        printf("[FORMAT]   : %.1f MB of pixel conversion avoided over %d frames\n",
+               format_bytes_avoided(&format, width, height) * (double)rl.frames_rendered / 1e6, rl.frames_rendered);
+    if (prime_path)
+        prime_print_stats(&prime, strategy);
+    latency_stats_print("render", &rl.render_time);
+    if (readback_depth > 0)
+        latency_stats_print("readback wait", &rl.readback_wait);
+    latency_stats_print("flip commit", &rl.flip_latency);
+    latency_stats_print("frame interval", &rl.frame_interval);
+    event_loop_destroy(&rl.loop);
 
 cleanup:
     // Cleanup resources
     cleanup_gl_setup();
+    set_worker_pool(NULL);
+
+    // Never free a buffer the display may still be switching to
+    if (swapchain_flip_pending(&swapchain))
+        swapchain_wait_flip(&swapchain, 1000);
     
-    drmModeFreePlane(plane);
-    drmModeFreeCrtc(crtc);
-    drmModeFreeConnector(connector);
-    drmModeFreeResources(resources);
-
-    if (fb_id) {
-        struct drm_mode_destroy_dumb destroy = {0};
-        if (dumb_buffer_data) {
-            munmap(dumb_buffer_data, width * height * 4);
-        }
-        if (drmIoctl(drm_fd, DRM_IOCTL_MODE_DESTROY_DUMB, &destroy) < 0) {
-            perror("Failed to destroy dumb buffer");
-        }
-        drmModeRmFB(drm_fd, fb_id);
-    }
-    
+    drm_blob_cache_destroy(&blobs);
+
+    for (int i = 0; i < swapchain.count; i++)
+        destroy_fb(&fbs, &swapchain.buffers[i]);
+    fb_pool_print_stats(&fbs);
+    fb_pool_destroy(&fbs);
+
+    // Render device buffers go before the device
+    prime_device_destroy(&prime);
+
+    worker_pool_destroy(&workers);
     close(drm_fd);
     return 0;
 }
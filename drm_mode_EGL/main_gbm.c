@@ -10,336 +10,717 @@
 #include <unistd.h>
 #include <ctype.h>
 #include <getopt.h>
+#include <poll.h>
 #include <inttypes.h>
+#include <signal.h>
+#include <sys/resource.h>
 #include <gbm.h>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 #include <drm_fourcc.h>
 
 #include "cube_render.h"
+#include "drm_blob.h"
+#include "drm_device.h"
+#include "drm_formats.h"
+#include "drm_props.h"
+#include "event_loop.h"
+#include "fb_pool.h"
+#include "frame_stats.h"
+#include "swapchain.h"
+#include "takeover.h"
+#include "topology_cache.h"
+#include "worker_pool.h"
+
+// GBM backend for the framebuffer pool. The zero-copy path never touches
+// the pixels from the CPU; map_cpu keeps the old gbm_bo_map + glReadPixels
+// path available for comparison. modifiers[] are the layouts the primary
+// plane can scan out (from IN_FORMATS); GBM picks the one the GPU renders
+// best among them.
+struct gbm_fb_allocator {
+    struct gbm_device *dev;
+    int map_cpu;
+    int modifier_count;
+    uint64_t modifiers[DRM_FORMATS_MAX_MODIFIERS];
+};
+
+static struct gbm_bo *create_bo(struct gbm_fb_allocator *allocator, const struct fb_key *key, int *explicit) {
+    uint32_t flags = GBM_BO_USE_SCANOUT | GBM_BO_USE_RENDERING | GBM_BO_USE_WRITE;
+    struct gbm_bo *bo = NULL;
+
+    *explicit = 1;
+    if (key->modifier != DRM_FORMAT_MOD_INVALID) {
+        // Exactly this layout; drivers without modifier support still do linear
+        bo = gbm_bo_create_with_modifiers(allocator->dev, key->width, key->height, key->fourcc, &key->modifier, 1);
+        if (!bo && key->modifier == DRM_FORMAT_MOD_LINEAR) {
+            *explicit = 0;
+            bo = gbm_bo_create(allocator->dev, key->width, key->height, key->fourcc, flags | GBM_BO_USE_LINEAR);
+        }
+    } else if (allocator->modifier_count > 0 && !allocator->map_cpu) {
+        bo = gbm_bo_create_with_modifiers(allocator->dev, key->width, key->height, key->fourcc,
+                                          allocator->modifiers, allocator->modifier_count);
+    }
+
+    // No IN_FORMATS (or a CPU-mapped buffer): the driver picks implicitly
+    if (!bo && key->modifier == DRM_FORMAT_MOD_INVALID) {
+        *explicit = 0;
+        bo = gbm_bo_create(allocator->dev, key->width, key->height, key->fourcc, flags);
+    }
+    return bo;
+}
 
-// Helper function to get the *value* of a property by name for a given plane
-static int get_property_value(int drm_fd, uint32_t plane_id, const char *name) {
-    drmModeObjectPropertiesPtr props = drmModeObjectGetProperties(drm_fd, plane_id, DRM_MODE_OBJECT_PLANE);
-    if (!props)
+static int gbm_fb_alloc(struct fb_pool *pool, struct fb_pool_entry *entry) {
+    struct gbm_fb_allocator *allocator = pool->backend_data;
+    uint32_t width = entry->key.width;
+    uint32_t height = entry->key.height;
+    int explicit;
+
+    struct gbm_bo *bo = create_bo(allocator, &entry->key, &explicit);
+    if (!bo) {
+        fprintf(stderr, "gbm_bo_create failed\n");
         return -1;
+    }
 
-    for (uint32_t i = 0; i < props->count_props; i++) {
-        drmModePropertyPtr prop = drmModeGetProperty(drm_fd, props->props[i]);
-        if (!prop)
-            continue;
+    entry->bo = bo;
+    entry->modifier = explicit ? gbm_bo_get_modifier(bo) : DRM_FORMAT_MOD_INVALID;
+    entry->num_planes = gbm_bo_get_plane_count(bo);
+    if (entry->num_planes < 1 || entry->num_planes > FB_POOL_MAX_PLANES) {
+        fprintf(stderr, "gbm bo has %d planes\n", entry->num_planes);
+        gbm_bo_destroy(bo);
+        return -1;
+    }
+    for (int p = 0; p < entry->num_planes; p++) {
+        entry->handles[p] = gbm_bo_get_handle_for_plane(bo, p).u32;
+        entry->pitches[p] = gbm_bo_get_stride_for_plane(bo, p);
+        entry->offsets[p] = gbm_bo_get_offset(bo, p);
+    }
+    entry->size = entry->pitches[0] * height;
 
-        if (strcmp(prop->name, name) == 0) {
-            uint64_t value = props->prop_values[i];
-            drmModeFreeProperty(prop);
-            drmModeFreeObjectProperties(props);
-            return (int)value;
-        }
+    if (!allocator->map_cpu)
+        return 0;
 
-        drmModeFreeProperty(prop);
+    uint32_t stride;
+    void *map_data = NULL;
+    uint8_t *map = gbm_bo_map(bo, 0, 0, width, height, GBM_BO_TRANSFER_READ_WRITE, &stride, &map_data);
+    if (!map) {
+        fprintf(stderr, "gbm_bo_map failed\n");
+        gbm_bo_destroy(bo);
+        return -1;
     }
+    entry->map = map;
+    entry->map_pitch = stride;
+    entry->map_data = map_data;
+    return 0;
+}
+
+static void gbm_fb_free(struct fb_pool *pool, struct fb_pool_entry *entry) {
+    (void)pool;
 
-    drmModeFreeObjectProperties(props);
-    return -1;
+    if (entry->map_data)
+        gbm_bo_unmap(entry->bo, entry->map_data);
+    gbm_bo_destroy(entry->bo);
 }
 
-// Helper function to get the *ID* of a property by name for a given DRM object
-static uint32_t get_property_id(int drm_fd, uint32_t obj_id, uint32_t obj_type, const char *name) {
-    drmModeObjectProperties *props = drmModeObjectGetProperties(drm_fd, obj_id, obj_type);
-    if (!props)
-        return 0;
+static const struct fb_pool_backend gbm_fb_backend = {
+    .name = "gbm",
+    .alloc = gbm_fb_alloc,
+    .free = gbm_fb_free,
+};
+
+// Take a framebuffer from the pool for one swapchain slot. modifier is
+// DRM_FORMAT_MOD_INVALID to let the allocator choose from IN_FORMATS.
+static int create_fb(struct fb_pool *fbs, const drmModeModeInfo *mode, struct swap_buffer *buf,
+                     struct worker_pool *workers, uint64_t modifier) {
+    int width = mode->hdisplay;
+    int height = mode->vdisplay;
+
+    struct fb_pool_entry *fb = fb_pool_acquire(fbs, width, height, DRM_FORMAT_XRGB8888, modifier);
+    if (!fb)
+        return -1;
 
-    uint32_t prop_id = 0;
-    for (uint32_t i = 0; i < props->count_props; i++) {
-        drmModePropertyPtr prop = drmModeGetProperty(drm_fd, props->props[i]);
-        if (!prop)
-            continue;
+    buf->owner = fb;
+    buf->bo = fb->bo;
+    buf->fb_id = fb->fb_id;
+    buf->handle = fb->handles[0];
+    buf->pitch = fb->pitches[0];
+    buf->size = fb->size;
+    buf->map = fb->map;
+    buf->map_pitch = fb->map_pitch;
+    buf->map_data = fb->map_data;
 
-        if (strcmp(prop->name, name) == 0)
-            prop_id = prop->prop_id;
+    // Fill with blue (XRGB: 0xFF0000FF)
+    if (buf->map)
+        parallel_fill_xrgb8888(workers, buf->map, buf->map_pitch, width, height, 0xFF0000FF);
+    return 0;
+}
 
-        drmModeFreeProperty(prop);
-        if (prop_id)
-            break;
+// Export the bo as a dma-buf and turn it into a GL render target. All
+// planes of a gbm bo live in the same dma-buf at their own offsets.
+static int import_fb(struct swap_buffer *buf, int width, int height) {
+    const struct fb_pool_entry *fb = buf->owner;
+    int dmabuf_fd = gbm_bo_get_fd(buf->bo);
+    if (dmabuf_fd < 0) {
+        fprintf(stderr, "gbm_bo_get_fd failed\n");
+        return -1;
     }
 
-    drmModeFreeObjectProperties(props);
-    return prop_id;
-}
+    int fds[FB_POOL_MAX_PLANES];
+    for (int p = 0; p < fb->num_planes; p++)
+        fds[p] = dmabuf_fd;
 
-// Find the first connected connector with a valid mode
-static int fetch_connector(int drm_fd, drmModeRes *resources, drmModeConnector **connector_out) {
-    for (int i = 0; i < resources->count_connectors; i++) {
-        drmModeConnector *conn = drmModeGetConnector(drm_fd, resources->connectors[i]);
-        if (!conn)
-            continue;
-
-        if ((conn->connection == DRM_MODE_CONNECTED) && (conn->modes != NULL)) {
-            *connector_out = conn;
-            printf("[CONNECTOR]: ID = %d and STATUS = CONNECTED\n", conn->connector_id);
-            printf("[MODE]     : %dx%d @%dHz\n", conn->modes->hdisplay, conn->modes->vdisplay, conn->modes->vrefresh);
-            return 0;
-        }
+    buf->render_target = import_dmabuf_target(width, height, DRM_FORMAT_XRGB8888, fb->num_planes, fds,
+                                              fb->pitches, fb->offsets, gbm_bo_get_modifier(buf->bo));
+    close(dmabuf_fd);
+    return buf->render_target < 0 ? -1 : 0;
+}
 
-        drmModeFreeConnector(conn);
-    }
-    return -1;
+// Hand a swapchain slot's framebuffer back to the pool
+static void destroy_fb(struct fb_pool *fbs, struct swap_buffer *buf) {
+    fb_pool_release(fbs, buf->owner);
+    if (buf->release_fence >= 0)
+        close(buf->release_fence);
+    memset(buf, 0, sizeof(*buf));
+    buf->render_target = -1;
+    buf->release_fence = -1;
 }
 
-// Pick a CRTC from the resource list (can be improved to match connector's encoder)
-static int fetch_crtc(int drm_fd, drmModeRes *resources, drmModeConnector *connector, drmModeCrtc **crtc_out, int *crtc_indx) {
-    for (int i = 0; i < resources->count_crtcs; i++) {
-        drmModeCrtc *crtc = drmModeGetCrtc(drm_fd, resources->crtcs[i]);
-        if (crtc) {
-            *crtc_out = crtc;
-            printf("[CRTC]     : ID = %d\n", crtc->crtc_id);
-            *crtc_indx = i;
-            return 0;
+// Framebuffers for every swapchain slot with the requested modifier
+static int create_swapchain_fbs(struct fb_pool *fbs, const drmModeModeInfo *mode, struct swapchain *swapchain,
+                                struct worker_pool *workers, uint64_t modifier) {
+    for (int i = 0; i < swapchain->count; i++) {
+        if (create_fb(fbs, mode, &swapchain->buffers[i], workers, modifier) != 0) {
+            fprintf(stderr, "Failed to create framebuffer %d\n", i);
+            return -1;
         }
     }
-    return -1;
+    return 0;
 }
 
-// Find the primary plane associated with the selected CRTC
-static int fetch_plane(int drm_fd, drmModeCrtc *crtc, drmModePlane **plane_out, int crtc_indx) {
-    drmModePlaneRes *planes = drmModeGetPlaneResources(drm_fd);
-    if (!planes)
-        return -1;
-
-    for (uint32_t i = 0; i < planes->count_planes; i++) {
-        drmModePlane *plane = drmModeGetPlane(drm_fd, planes->planes[i]);
-        if (!plane)
-            continue;
-
-        if (plane->possible_crtcs & (1 << crtc_indx)) {
-            int type = get_property_value(drm_fd, plane->plane_id, "type");
-            if (type == DRM_PLANE_TYPE_PRIMARY) {
-                printf("[PLANE]    : ID = %d and TYPE = PRIMARY\n", plane->plane_id);
-                *plane_out = plane;
-                drmModeFreePlaneResources(planes);
-                return 0;
-            }
-        }
-
-        drmModeFreePlane(plane);
-    }
+// CPU-side wait on a sync_file fd: it polls readable once signalled
+static int wait_fence_fd(int fence_fd, int timeout_ms) {
+    struct pollfd pfd = { .fd = fence_fd, .events = POLLIN };
+    int ret;
 
-    drmModeFreePlaneResources(planes);  
-    return -1;
-}
+    do {
+        ret = poll(&pfd, 1, timeout_ms);
+    } while (ret < 0 && errno == EINTR);
 
-// Fill the framebuffer with a solid color (XRGB8888 format)
-static int fill_color(uint8_t *data, int size, uint32_t color) {
-    for (int i = 0; i < size; i += 4) {
-        *(uint32_t *)(data + i) = color; // 4 bytes per pixel
+    if (ret <= 0) {
+        fprintf(stderr, ret == 0 ? "Timed out waiting for fence\n" : "poll on fence failed\n");
+        return -1;
     }
     return 0;
 }
 
-// Create a framebuffer using dumb buffer and map it to userspace memory
-static int create_fb(int drm_fd, drmModeCrtc *crtc, int *fb_id, uint8_t **out_Address) {
-    int width = crtc->mode.hdisplay;
-    int height = crtc->mode.vdisplay;
-    int size = width * height * 4;
-    uint32_t stride;
-    void *map_data = NULL;
-    struct gbm_device *gbm_dev;
-    struct gbm_bo *bo;
+// One-time full modeset: route connector -> CRTC -> plane, set the mode and
+// activate the CRTC. The MODE_ID blob comes from the blob cache and stays
+// referenced until the cache is destroyed at exit.
+// With DRM_MODE_ATOMIC_TEST_ONLY in flags the kernel only checks whether
+// the configuration (e.g. the framebuffer's modifier) would work.
+int modeset_fb(int drm_fd, struct drm_blob_cache *blobs, const struct drm_object_props *conn_props,
+               const struct drm_object_props *crtc_props, const struct drm_object_props *plane_props,
+               uint32_t crtc_id, const drmModeModeInfo *mode, int fb_id, uint32_t flags) {
+    uint32_t blob_id = drm_mode_blob_get(blobs, mode);
+    if (!blob_id)
+        return -1;
 
-    gbm_dev = gbm_create_device(drm_fd);
-    bo = gbm_bo_create(gbm_dev, width, height, DRM_FORMAT_XRGB8888,
-                        GBM_BO_USE_SCANOUT | GBM_BO_USE_RENDERING | GBM_BO_USE_WRITE);
-
-    uint8_t *map_add = gbm_bo_map(bo, 0, 0, width, height, GBM_BO_TRANSFER_READ_WRITE, &stride, &map_data);
-  
-    uint32_t handle = gbm_bo_get_handle(bo).u32;
-    uint32_t pitch = gbm_bo_get_stride(bo);
-    uint32_t handles[4] = {handle};
-    uint32_t strides[4] = {pitch};
-    uint32_t offsets[4] = {0};
-
-    // Add framebuffer
-    if (drmModeAddFB2(drm_fd, width, height, DRM_FORMAT_XRGB8888, handles, strides, offsets, (uint32_t*)fb_id, 0) != 0) {
-        perror("drmModeAddFB2 failed");
+    drmModeAtomicReq *req = drmModeAtomicAlloc();
+    if (!req) {
+        fprintf(stderr, "Failed to allocate atomic request\n");
+        drm_mode_blob_put(blobs, blob_id);
         return -1;
     }
 
-    printf("[FB]       : ID = %d\n", *fb_id);
-
+    // Plane setup
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_FB_ID, fb_id);
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_CRTC_ID, crtc_id);
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_SRC_X, 0);
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_SRC_Y, 0);
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_SRC_W, mode->hdisplay << 16);
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_SRC_H, mode->vdisplay << 16);
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_CRTC_X, 0);
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_CRTC_Y, 0);
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_CRTC_W, mode->hdisplay);
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_CRTC_H, mode->vdisplay);
 
-    // Fill with blue (XRGB: 0xFF0000FF)
-    uint32_t color = 0xFF0000FF;
-    fill_color((uint8_t*)map_add, size, color);
+    // Connector + CRTC setup
+    drm_props_add(req, conn_props, DRM_PROP_CONNECTOR_CRTC_ID, crtc_id);
+    drm_props_add(req, crtc_props, DRM_PROP_CRTC_MODE_ID, blob_id);
+    drm_props_add(req, crtc_props, DRM_PROP_CRTC_ACTIVE, 1);
+
+    // Blocking commit: the display is fully up before the first flip is queued
+    int test_only = flags & DRM_MODE_ATOMIC_TEST_ONLY;
+    int ret = drmModeAtomicCommit(drm_fd, req, DRM_MODE_ATOMIC_ALLOW_MODESET | flags, NULL);
+    if (ret < 0 && !test_only)
+        perror("drmModeAtomicCommit (modeset) failed");
+    else if (!test_only)
+        printf("[ATOMIC]   : Modeset successful\n");
+
+    // A checked-only configuration holds no reference to the blob
+    if (ret < 0 || test_only)
+        drm_mode_blob_put(blobs, blob_id);
 
-    *out_Address = (uint8_t *)map_add;
-    return 0;
+    drmModeAtomicFree(req);
+    return ret;
 }
 
-// Perform atomic commit to set plane, mode, and activate the display
-int commit_fb(int drm_fd, drmModeConnector *connector, drmModeCrtc *crtc, drmModePlane *plane, int fb_id) {
+// Per-frame flip: only the plane's FB_ID changes, so the driver never has to
+// check a modeset and no blob is created. Completion is reported through a
+// page-flip event carrying user_data (the swapchain).
+// With explicit sync, in_fence_fd (>= 0) holds the flip until the GPU has
+// finished the frame, and *out_fence receives a fence that signals when the
+// new frame is latched, i.e. when the buffer it replaces is released.
+int flip_fb(int drm_fd, const struct drm_object_props *crtc_props, const struct drm_object_props *plane_props,
+            int fb_id, int in_fence_fd, int32_t *out_fence, void *user_data) {
     drmModeAtomicReq *req = drmModeAtomicAlloc();
     if (!req) {
         fprintf(stderr, "Failed to allocate atomic request\n");
         return -1;
     }
 
-    #define PROP_ID(obj, type, name) get_property_id(drm_fd, obj, type, name)
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_FB_ID, fb_id);
+    if (in_fence_fd >= 0)
+        drm_props_add(req, plane_props, DRM_PROP_PLANE_IN_FENCE_FD, in_fence_fd);
+    if (out_fence) {
+        *out_fence = -1;
+        drm_props_add(req, crtc_props, DRM_PROP_CRTC_OUT_FENCE_PTR, (uint64_t)(uintptr_t)out_fence);
+    }
 
-    // Create a MODE_ID blob from crtc mode
-    drmModePropertyBlobPtr mode_blob;
-    uint32_t blob_id = 0;
-    drmModeCreatePropertyBlob(drm_fd, &crtc->mode, sizeof(crtc->mode), &blob_id);
+    int ret = drmModeAtomicCommit(drm_fd, req, DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT, user_data);
+    if (ret < 0)
+        perror("drmModeAtomicCommit (flip) failed");
 
-    // Plane setup
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "FB_ID"), fb_id);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_ID"), crtc->crtc_id);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_X"), 0);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_Y"), 0);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_W"), crtc->mode.hdisplay << 16);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_H"), crtc->mode.vdisplay << 16);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_X"), 0);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_Y"), 0);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_W"), crtc->mode.hdisplay);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_H"), crtc->mode.vdisplay);
+    drmModeAtomicFree(req);
+    return ret;
+}
 
-    // Connector + CRTC setup
-    drmModeAtomicAddProperty(req, connector->connector_id, PROP_ID(connector->connector_id, DRM_MODE_OBJECT_CONNECTOR, "CRTC_ID"), crtc->crtc_id);
-    drmModeAtomicAddProperty(req, crtc->crtc_id, PROP_ID(crtc->crtc_id, DRM_MODE_OBJECT_CRTC, "MODE_ID"), blob_id);
-    drmModeAtomicAddProperty(req, crtc->crtc_id, PROP_ID(crtc->crtc_id, DRM_MODE_OBJECT_CRTC, "ACTIVE"), 1);
+// State shared by the event-loop callbacks that drive rendering
+struct render_loop {
+    struct event_loop loop;
+    int drm_fd;
+    struct swapchain *swapchain;
+    const struct drm_object_props *crtc_props;
+    const struct drm_object_props *plane_props;
+    int explicit_sync;          // IN_FENCE_FD / OUT_FENCE_PTR instead of glFinish
+    int width;
+    int height;
+    int frame_count;            // flips to complete before quitting
+    int frames_rendered;
+    int frames_presented;
+    int window_flips;           // flips since the last stats tick
+    struct swap_buffer *ready;  // rendered, waiting for the in-flight flip
+    int ready_fence;            // render-complete fence of ready, -1 if none
+    double last_flip_ms;
+    struct latency_stats render_time;
+    struct latency_stats flip_latency;
+    struct latency_stats frame_interval;
+};
+
+// Draw one frame into buf: straight into the imported scanout buffer on the
+// zero-copy path, through the internal FBO and glReadPixels otherwise.
+// With explicit sync nothing blocks the CPU: the GPU waits for the buffer's
+// release fence, and the returned render fence (-1 if none) goes into the
+// flip as IN_FENCE_FD.
+static int draw_frame(struct swap_buffer *buf, int width, int height, int explicit_sync) {
+    bind_render_target(buf->render_target);
+
+    if (!explicit_sync) {
+        render_the_cube(width, height, buf->render_target >= 0 ? NULL : buf->map, buf->map_pitch);
+        return -1;
+    }
 
-    // Do the commit
-    int ret = drmModeAtomicCommit(drm_fd, req, DRM_MODE_ATOMIC_ALLOW_MODESET | DRM_MODE_ATOMIC_NONBLOCK, NULL);
-    if (ret < 0) {
-        perror("drmModeAtomicCommit failed");
-    } else {
-        printf("[ATOMIC]   : Commit successful\n");
+    if (buf->release_fence >= 0) {
+        if (render_fence_wait(buf->release_fence) != 0) {
+            // Not imported, the fd is still ours: block until scanout let go
+            wait_fence_fd(buf->release_fence, 1000);
+            close(buf->release_fence);
+        }
+        buf->release_fence = -1;
     }
 
-    drmModeAtomicFree(req);
-    return ret;
+    draw_the_cube(width, height);
+    int fence_fd = render_fence_export();
+    if (fence_fd < 0)
+        glFinish();
+    return fence_fd;
 }
 
-int main() {
-    // Open DRM device
-    int drm_fd = open("/dev/dri/card1", O_RDWR | O_NONBLOCK);
-    if (drm_fd < 0) {
-        perror("Failed to open DRM device");
+// Render the next frame into a buffer the display is not reading
+static void render_next(struct render_loop *rl) {
+    if (rl->ready || rl->frames_rendered >= rl->frame_count)
+        return;
+
+    // Every buffer busy: the next flip event hands one back
+    struct swap_buffer *buf = swapchain_acquire(rl->swapchain);
+    if (!buf)
+        return;
+
+    double render_start = now_ms();
+    rl->ready_fence = draw_frame(buf, rl->width, rl->height, rl->explicit_sync);
+    rl->ready = buf;
+    rl->frames_rendered++;
+
+    double render_ms = now_ms() - render_start;
+    latency_stats_add(&rl->render_time, render_ms);
+    printf("Frame %d: Render time = %.3f ms\n", rl->frames_rendered, render_ms);
+}
+
+// Commit the rendered buffer unless the CRTC still has a flip in flight
+static int present_ready(struct render_loop *rl) {
+    if (!rl->ready || swapchain_flip_pending(rl->swapchain))
+        return 0;
+
+    double commit_start = now_ms();
+    int32_t out_fence = -1;
+    int ret = flip_fb(rl->drm_fd, rl->crtc_props, rl->plane_props, rl->ready->fb_id, rl->ready_fence,
+                      rl->explicit_sync ? &out_fence : NULL, rl->swapchain);
+
+    // The kernel holds its own reference to the render fence
+    if (rl->ready_fence >= 0) {
+        close(rl->ready_fence);
+        rl->ready_fence = -1;
+    }
+    if (ret < 0) {
+        fprintf(stderr, "Frame %d: Atomic commit failed\n", rl->frames_rendered);
         return -1;
     }
+    latency_stats_add(&rl->flip_latency, now_ms() - commit_start);
+
+    // The buffer on screen is released when this flip latches
+    if (out_fence >= 0) {
+        if (rl->swapchain->scanout >= 0)
+            rl->swapchain->buffers[rl->swapchain->scanout].release_fence = out_fence;
+        else
+            close(out_fence);
+    }
+    swapchain_queue(rl->swapchain, rl->ready);
+    rl->ready = NULL;
+    return 0;
+}
 
-    // Enable atomic + universal planes
-    drmSetClientCap(drm_fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1);
-    drmSetClientCap(drm_fd, DRM_CLIENT_CAP_ATOMIC, 1);
+// Queue what is ready, then render ahead into the next free buffer
+static void advance(struct render_loop *rl) {
+    if (rl->frames_presented >= rl->frame_count) {
+        event_loop_quit(&rl->loop);
+        return;
+    }
 
-    // Get DRM resources
-    drmModeRes *resources = drmModeGetResources(drm_fd);
-    if (!resources) {
-        perror("Failed to get DRM resources");
-        close(drm_fd);
-        return -1;
+    if (present_ready(rl) < 0) {
+        event_loop_quit(&rl->loop);
+        return;
+    }
+    render_next(rl);
+    if (present_ready(rl) < 0)
+        event_loop_quit(&rl->loop);
+}
+
+// DRM fd readable: flip completions arrive here
+static void on_drm_event(int fd, uint32_t events, void *data) {
+    struct render_loop *rl = data;
+    unsigned int flips = rl->swapchain->flips;
+
+    (void)fd;
+    (void)events;
+
+    if (swapchain_dispatch(rl->swapchain) != 0) {
+        event_loop_quit(&rl->loop);
+        return;
     }
 
-    drmModeConnector *connector = NULL;
-    drmModeCrtc *crtc = NULL;
-    drmModePlane *plane = NULL;
-    uint32_t fb_id = 0;
-    uint8_t *dumb_buffer_data = NULL;
+    if (rl->swapchain->flips != flips) {
+        // Delivery interval measured on the kernel's flip timestamps
+        if (rl->last_flip_ms > 0.0)
+            latency_stats_add(&rl->frame_interval, rl->swapchain->flip_time_ms - rl->last_flip_ms);
+        rl->last_flip_ms = rl->swapchain->flip_time_ms;
+        rl->frames_presented++;
+        rl->window_flips++;
+    }
+
+    advance(rl);
+}
+
+// Once per second: report the presentation rate
+static void on_stats_timer(int fd, uint32_t events, void *data) {
+    struct render_loop *rl = data;
+
+    (void)fd;
+    (void)events;
+
+    printf("[LOOP]     : %d flips/s, %d frames presented\n", rl->window_flips, rl->frames_presented);
+    rl->window_flips = 0;
+}
+
+// SIGINT / SIGTERM: leave the loop and clean up normally
+static void on_signal(int fd, uint32_t signo, void *data) {
+    struct render_loop *rl = data;
+
+    (void)fd;
+
+    printf("[LOOP]     : Caught signal %u, stopping\n", signo);
+    event_loop_quit(&rl->loop);
+}
+
+// User + system CPU time consumed by this process, in milliseconds
+static double cpu_time_ms(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec * 1000.0 + usage.ru_utime.tv_usec / 1000.0 +
+           usage.ru_stime.tv_sec * 1000.0 + usage.ru_stime.tv_usec / 1000.0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-b buffers] [-r] [-i] [-t threads] [-n node]\n", prog);
+    fprintf(stderr, "  -b buffers   swapchain length, %d-%d (default 3)\n",
+            SWAPCHAIN_MIN_BUFFERS, SWAPCHAIN_MAX_BUFFERS);
+    fprintf(stderr, "  -r           copy with glReadPixels into gbm_bo_map() instead of\n"
+                    "               rendering into the scanout buffer (for comparison)\n");
+    fprintf(stderr, "  -i           implicit sync: glFinish() before each flip instead of\n"
+                    "               IN_FENCE_FD / OUT_FENCE_PTR fences\n");
+    fprintf(stderr, "  -t threads   CPU threads for pixel fills and copies, 0 = all CPUs (default)\n");
+    fprintf(stderr, "  -n node      pin those threads to a NUMA node (default: not pinned)\n");
+}
+
+int main(int argc, char **argv) {
+    struct takeover takeover = { .start_ms = now_ms() };
+    int buffer_count = 3;
+    int threads = 0;
+    int numa_node = -1;
+    int readback = 0;
+    int implicit_sync = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:rit:n:h")) != -1) {
+        switch (opt) {
+        case 'b':
+            buffer_count = atoi(optarg);
+            break;
+        case 't':
+            threads = atoi(optarg);
+            break;
+        case 'n':
+            numa_node = atoi(optarg);
+            break;
+        case 'r':
+            readback = 1;
+            break;
+        case 'i':
+            implicit_sync = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : -1;
+        }
+    }
+
+    // Open the KMS device, atomic + universal planes enabled
+    struct drm_device_info dev;
+    int drm_fd = drm_device_open(&dev);
+    if (drm_fd < 0)
+        return -1;
+
+    static struct kms_topology topo;
+    const struct kms_output *out = NULL;
+    struct drm_blob_cache blobs;
+    struct fb_pool fbs;
+    struct gbm_fb_allocator allocator = { .dev = NULL, .map_cpu = readback };
+    struct swapchain swapchain;
+    struct worker_pool workers;
+    struct gbm_device *gbm_dev = NULL;
     int width = 0;
     int height = 0;
-    int crtc_indx;
-    
-    if (fetch_connector(drm_fd, resources, &connector) != 0) {
-        fprintf(stderr, "Failed to find connector\n");
-        goto cleanup;
+
+    drm_blob_cache_init(&blobs, drm_fd);
+    fb_pool_init(&fbs, drm_fd, &gbm_fb_backend, &allocator, SWAPCHAIN_MAX_BUFFERS);
+    if (swapchain_init(&swapchain, drm_fd, buffer_count) != 0) {
+        usage(argv[0]);
+        close(drm_fd);
+        return -1;
+    }
+
+    // CPU-side pixel work (fills, readback conversion) is split into row bands
+    if (worker_pool_init(&workers, threads, numa_node) != 0) {
+        close(drm_fd);
+        return -1;
     }
 
-    if (fetch_crtc(drm_fd, resources, connector, &crtc, &crtc_indx) != 0) {
-        fprintf(stderr, "Failed to find CRTC\n");
+    // Connector, CRTC, primary plane, their property IDs and the plane's
+    // scanout modifiers: from the topology snapshot when the device has not
+    // changed since it was saved
+    if (topology_solve_cached(drm_fd, NULL, &topo) <= 0) {
+        fprintf(stderr, "Failed to find a connected output\n");
         goto cleanup;
     }
+    out = &topo.outputs[0];
+    printf("[CONNECTOR]: ID = %d (%s) and STATUS = CONNECTED\n", out->connector_id, out->name);
+    printf("[MODE]     : %dx%d @%dHz\n", out->mode.hdisplay, out->mode.vdisplay, out->mode.vrefresh);
+    printf("[CRTC]     : ID = %d\n", out->crtc_id);
+    printf("[PLANE]    : ID = %d and TYPE = PRIMARY\n", out->plane_id);
 
-    if (fetch_plane(drm_fd, crtc, &plane, crtc_indx) != 0) {
-        fprintf(stderr, "Failed to find plane\n");
+    width = out->mode.hdisplay;
+    height = out->mode.vdisplay;
+
+    gbm_dev = gbm_create_device(drm_fd);
+    if (!gbm_dev) {
+        fprintf(stderr, "Failed to create GBM device\n");
         goto cleanup;
     }
+    allocator.dev = gbm_dev;
 
-    
-    width = connector->modes[0].hdisplay;
-    height = connector->modes[0].vdisplay;
-   
-    if (create_fb(drm_fd, crtc, &fb_id, &dumb_buffer_data) != 0) {
-        fprintf(stderr, "Failed to create framebuffer\n");
+    // Scanout layouts the plane accepts; tiled / compressed ones save memory
+    // bandwidth on every frame the GPU writes and the display reads
+    allocator.modifier_count = out->count_modifiers;
+    memcpy(allocator.modifiers, out->modifiers, out->count_modifiers * sizeof(uint64_t));
+    printf("[MODIFIER] : %d scanout modifiers for XRGB8888 in IN_FORMATS\n", allocator.modifier_count);
+
+    // One framebuffer per swapchain slot
+    if (create_swapchain_fbs(&fbs, &out->mode, &swapchain, &workers, DRM_FORMAT_MOD_INVALID) != 0)
         goto cleanup;
+
+    // Check the chosen layout before going live: a modifier the plane lists
+    // can still be rejected for this mode or bandwidth. Linear always scans out.
+    const struct fb_pool_entry *chosen = swapchain.buffers[0].owner;
+    if (chosen->modifier != DRM_FORMAT_MOD_INVALID && chosen->modifier != DRM_FORMAT_MOD_LINEAR &&
+        modeset_fb(drm_fd, &blobs, &out->conn_props, &out->crtc_props, &out->plane_props, out->crtc_id,
+                   &out->mode, swapchain.buffers[0].fb_id, DRM_MODE_ATOMIC_TEST_ONLY) < 0) {
+        printf("[MODIFIER] : 0x%016" PRIx64 " rejected by TEST_ONLY commit, falling back to linear\n",
+               chosen->modifier);
+        for (int i = 0; i < swapchain.count; i++)
+            destroy_fb(&fbs, &swapchain.buffers[i]);
+        fb_pool_trim(&fbs);
+        if (create_swapchain_fbs(&fbs, &out->mode, &swapchain, &workers, DRM_FORMAT_MOD_LINEAR) != 0)
+            goto cleanup;
+        chosen = swapchain.buffers[0].owner;
     }
+    printf("[MODIFIER] : scanout with 0x%016" PRIx64 " (%d plane%s)\n", chosen->modifier, chosen->num_planes,
+           chosen->num_planes == 1 ? "" : "s");
+    printf("[SWAPCHAIN]: %d buffers\n", swapchain.count);
 
     // Initialize EGL and OpenGL
-    if (EGL_init(width, height) < 0) {
+    if (EGL_init(width, height, dev.render) < 0) {
         fprintf(stderr, "Failed to initialize EGL\n");
         goto cleanup;
     }
 
+    set_worker_pool(&workers);
+
     // Set up textures and framebuffers once
     if (setup_textures_framebuffers(width, height) < 0) {
         fprintf(stderr, "Failed to setup textures and framebuffers\n");
         goto cleanup;
     }
 
-    // Perform initial atomic commit to set mode 
-    if (commit_fb(drm_fd, connector, crtc, plane, fb_id) < 0) {
-        fprintf(stderr, "Initial atomic commit failed\n");
-        goto cleanup;
+    // Zero-copy: every swapchain buffer becomes an EGLImage-backed FBO
+    if (!readback) {
+        for (int i = 0; i < swapchain.count; i++) {
+            if (import_fb(&swapchain.buffers[i], width, height) != 0) {
+                fprintf(stderr, "Failed to import buffer %d as render target\n", i);
+                goto cleanup;
+            }
+        }
+    }
+    printf("[RENDER]   : %s\n", readback ? "glReadPixels into gbm_bo_map()" : "zero-copy EGLImage render target");
+
+    // Explicit fencing needs native fence fds from EGL and fence properties in KMS
+    int explicit_sync = !readback && !implicit_sync;
+    if (explicit_sync && (native_fence_init() != 0 ||
+                          !drm_prop_id(&out->plane_props, DRM_PROP_PLANE_IN_FENCE_FD) ||
+                          !drm_prop_id(&out->crtc_props, DRM_PROP_CRTC_OUT_FENCE_PTR))) {
+        fprintf(stderr, "Explicit sync unavailable, using glFinish before each flip\n");
+        explicit_sync = 0;
+    }
+    printf("[SYNC]     : %s\n", explicit_sync ? "explicit (IN_FENCE_FD / OUT_FENCE_PTR)" : "implicit (glFinish)");
+
+    // Perform the one-time atomic modeset with the first buffer
+    struct swap_buffer *first = swapchain_acquire(&swapchain);
+    int first_fence = draw_frame(first, width, height, explicit_sync);
+    if (first_fence >= 0) {
+        // One-time CPU wait: the modeset below is a blocking commit anyway
+        wait_fence_fd(first_fence, 1000);
+        close(first_fence);
     }
 
-    // Main render loop
-    clock_t start_time = clock();
-    int frame_count = 1000;
-    
-    for (int i = 0; i < frame_count; i++) {
-        clock_t frame_start = clock();
-        
-        // Render the cube
-        render_the_cube(width, height, dumb_buffer_data);
-        
-        // Perform atomic commit
-        if (commit_fb(drm_fd, connector, crtc, plane, fb_id) < 0) {
-            fprintf(stderr, "Frame %d: Atomic commit failed\n", i);
-            break;
-        }
-        
-        // Calculate frame time
-        clock_t frame_end = clock();
-        double frame_time = (double)(frame_end - frame_start) / CLOCKS_PER_SEC;
-        double fps = 1.0 / frame_time;
-        
-        printf("Frame %d: Time = %.3f ms, FPS = %.2f\n", i + 1, frame_time * 1000.0, fps);
+    // A display already showing this mode on this CRTC (firmware, fbcon, a
+    // previous compositor) gets the first frame as a plain page flip: no
+    // ALLOW_MODESET, so it never blanks
+    takeover_check(drm_fd, &out->conn_props, &out->crtc_props, &out->mode, &takeover);
+    double modeset_start = now_ms();
+    int modeset = !takeover.lit ||
+                  takeover_commit(drm_fd, &out->plane_props, out->crtc_id, &out->mode, first->fb_id) != 0;
+    if (modeset && modeset_fb(drm_fd, &blobs, &out->conn_props, &out->crtc_props, &out->plane_props, out->crtc_id,
+                              &out->mode, first->fb_id, 0) < 0) {
+        fprintf(stderr, "Initial atomic modeset failed\n");
+        goto cleanup;
     }
+    printf("[ATOMIC]   : %s latency = %.3f ms\n", modeset ? "Modeset" : "First flip", now_ms() - modeset_start);
+    takeover_report(&takeover, modeset);
+    swapchain_present_now(&swapchain, first);
+
+    // Main render loop: sleep in epoll until the DRM fd, the stats timer or
+    // a signal has something for us
+    struct render_loop rl = {
+        .drm_fd = drm_fd,
+        .swapchain = &swapchain,
+        .crtc_props = &out->crtc_props,
+        .plane_props = &out->plane_props,
+        .explicit_sync = explicit_sync,
+        .ready_fence = -1,
+        .width = width,
+        .height = height,
+        .frame_count = 1000,
+    };
+    latency_stats_reset(&rl.render_time);
+    latency_stats_reset(&rl.flip_latency);
+    latency_stats_reset(&rl.frame_interval);
+
+    const int signals[] = { SIGINT, SIGTERM };
+    if (event_loop_init(&rl.loop) != 0 ||
+        !event_loop_add_fd(&rl.loop, drm_fd, EPOLLIN, on_drm_event, &rl) ||
+        !event_loop_add_timer(&rl.loop, 1000, on_stats_timer, &rl) ||
+        !event_loop_add_signals(&rl.loop, signals, 2, on_signal, &rl)) {
+        fprintf(stderr, "Failed to set up event loop\n");
+        event_loop_destroy(&rl.loop);
+        goto cleanup;
+    }
+
+    double start_time = now_ms();
+    double start_cpu = cpu_time_ms();
+
+    advance(&rl);
+    event_loop_run(&rl.loop);
 
     // Calculate total time
-    clock_t end_time = clock();
-    double total_time = (double)(end_time - start_time) / CLOCKS_PER_SEC;
-    printf("Total time for rendering %d frames: %.2f seconds\n", frame_count, total_time);
-    printf("Average FPS: %.2f\n", frame_count / total_time);
+    double total_time = (now_ms() - start_time) / 1000.0;
+    double cpu_percent = 100.0 * (cpu_time_ms() - start_cpu) / (total_time * 1000.0);
+    printf("Total time for presenting %d frames: %.2f seconds\n", rl.frames_presented, total_time);
+    printf("Average FPS: %.2f\n", rl.frames_presented / total_time);
+    printf("CPU usage: %.1f%% of one core\n", cpu_percent);
+    latency_stats_print("render", &rl.render_time);
+    latency_stats_print("flip commit", &rl.flip_latency);
+    latency_stats_print("frame interval", &rl.frame_interval);
+    if (rl.ready_fence >= 0)
+        close(rl.ready_fence);
+    event_loop_destroy(&rl.loop);
 
 cleanup:
     // Cleanup resources
     cleanup_gl_setup();
+    set_worker_pool(NULL);
+
+    // Never free a buffer the display may still be switching to
+    if (swapchain_flip_pending(&swapchain))
+        swapchain_wait_flip(&swapchain, 1000);
     
-    drmModeFreePlane(plane);
-    drmModeFreeCrtc(crtc);
-    drmModeFreeConnector(connector);
-    drmModeFreeResources(resources);
-
-    if (fb_id) {
-        struct drm_mode_destroy_dumb destroy = {0};
-        if (dumb_buffer_data) {
-            munmap(dumb_buffer_data, width * height * 4);
-        }
-        if (drmIoctl(drm_fd, DRM_IOCTL_MODE_DESTROY_DUMB, &destroy) < 0) {
-            perror("Failed to destroy dumb buffer");
-        }
-        drmModeRmFB(drm_fd, fb_id);
-    }
+    drm_blob_cache_destroy(&blobs);
+
+    // Buffers go before the device that allocated them
+    for (int i = 0; i < swapchain.count; i++)
+        destroy_fb(&fbs, &swapchain.buffers[i]);
+    fb_pool_print_stats(&fbs);
+    fb_pool_destroy(&fbs);
+    if (gbm_dev)
+        gbm_device_destroy(gbm_dev);
     
+    worker_pool_destroy(&workers);
     close(drm_fd);
     return 0;
 }
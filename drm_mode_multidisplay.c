@@ -0,0 +1,552 @@
+// TO KNOW HOW TO COMPLIE HAVE A LOOK AT README.md FILE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+#include <drm_fourcc.h>
+
+#include "drm_blob.h"
+#include "drm_device.h"
+#include "drm_props.h"
+#include "fb_pool.h"
+#include "frame_group.h"
+#include "frame_stats.h"
+#include "hotplug.h"
+#include "swapchain.h"
+#include "topology.h"
+#include "topology_cache.h"
+#include "wc_blit.h"
+
+// Every connected display driven at once: the topology solver gives each
+// connector a CRTC and primary plane, one modeset lights them all, and then
+// every output renders and flips on its own thread. A single event thread
+// reads the DRM fd and routes each flip event to its output through the
+// commit's user_data, so one display's vblank never waits on another's.
+// With -g the outputs form a video wall instead: each thread still renders
+// its own frames, but they are presented together by a frame group, one
+// atomic commit for all CRTCs, and the vblank skew between them is reported.
+// Otherwise displays may come and go while it runs: the main thread watches
+// kernel hotplug uevents and stops, or sets up and starts, only the output
+// whose connector changed while the others keep flipping.
+
+#define OUTPUT_BUFFERS 3
+#define DEFAULT_SECONDS 5
+#define BAR_WIDTH 64
+#define BAR_COLOR 0xFFFFFFFF
+
+static const uint32_t background[TOPOLOGY_MAX_OUTPUTS] = {
+    0xFF802020, 0xFF208020, 0xFF202080, 0xFF808020, 0xFF802080, 0xFF208080, 0xFF606060, 0xFF804020,
+};
+
+// Render / present state of one output; lock guards sc, which the event
+// thread updates on flip completion. In group mode lock and flipped point
+// to the group's, which cover every output's swapchain.
+struct output_pipeline {
+    int drm_fd;
+    int index;
+    int active;                 // slot in use
+    struct kms_output out;
+    struct fb_pool fbs;
+    struct swapchain sc;
+    pthread_t thread;
+    pthread_mutex_t own_lock;
+    pthread_cond_t own_flipped;
+    pthread_mutex_t *lock;
+    pthread_cond_t *flipped;
+    double end_ms;              // render until this time
+    volatile int stop;          // the display went away
+    int failed;
+
+    // Stats
+    unsigned int frames;        // frames committed
+    double start_ms;
+    double stop_ms;
+    double last_flip_ms;
+    struct latency_stats render;
+    struct latency_stats interval;  // time between flips
+};
+
+static volatile int events_running = 1;
+
+// Video wall mode (-g)
+static int use_group;
+static struct frame_group group;
+static pthread_mutex_t group_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t group_flipped;
+static struct output_pipeline *group_outputs[FRAME_GROUP_MAX];
+static int stopping;            // a render thread is done; nobody waits for the rest of the wall
+
+static void record_flip(struct output_pipeline *p) {
+    if (p->last_flip_ms > 0)
+        latency_stats_add(&p->interval, p->sc.flip_time_ms - p->last_flip_ms);
+    p->last_flip_ms = p->sc.flip_time_ms;
+}
+
+// Flip completion for one output, called on the event thread
+static void output_flip_handler(int fd, unsigned int sequence, unsigned int tv_sec, unsigned int tv_usec,
+                                unsigned int crtc_id, void *user_data) {
+    struct output_pipeline *p = user_data;
+
+    pthread_mutex_lock(p->lock);
+    swapchain_page_flip_handler(fd, sequence, tv_sec, tv_usec, crtc_id, &p->sc);
+    record_flip(p);
+    pthread_cond_broadcast(p->flipped);
+    pthread_mutex_unlock(p->lock);
+}
+
+// Flip completion for one CRTC of the wall. Once all are back, frames
+// that became ready in the meantime go out right away.
+static void group_flip_handler(int fd, unsigned int sequence, unsigned int tv_sec, unsigned int tv_usec,
+                               unsigned int crtc_id, void *user_data) {
+    pthread_mutex_lock(&group_lock);
+    frame_group_flip_handler(fd, sequence, tv_sec, tv_usec, crtc_id, user_data);
+    for (int i = 0; i < group.count; i++) {
+        if (group.members[i].crtc_id == crtc_id)
+            record_flip(group_outputs[i]);
+    }
+    if (frame_group_complete(&group) && frame_group_present(&group) != 0)
+        stopping = 1;
+    pthread_cond_broadcast(&group_flipped);
+    pthread_mutex_unlock(&group_lock);
+}
+
+static void *event_thread(void *arg) {
+    int drm_fd = *(int *)arg;
+    drmEventContext evctx = {
+        .version = 3,
+        .page_flip_handler2 = use_group ? group_flip_handler : output_flip_handler,
+    };
+    struct pollfd pfd = { .fd = drm_fd, .events = POLLIN };
+
+    while (events_running) {
+        int ret = poll(&pfd, 1, 100);
+        if (ret < 0 && errno != EINTR) {
+            perror("poll failed");
+            break;
+        }
+        if (ret > 0 && drmHandleEvent(drm_fd, &evctx) != 0)
+            fprintf(stderr, "drmHandleEvent failed\n");
+    }
+    return NULL;
+}
+
+// Wait on the output's condition variable for up to timeout_ms; lock held
+static int wait_flipped(struct output_pipeline *p, int timeout_ms) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_sec += timeout_ms / 1000;
+    ts.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    return pthread_cond_timedwait(p->flipped, p->lock, &ts) == 0 ? 0 : -1;
+}
+
+// Hand a rendered frame to the wall; whoever completes the set commits it.
+// Returns once the frame went out, -1 if the wall stopped first.
+static int present_grouped(struct output_pipeline *p, struct swap_buffer *buf) {
+    int ret = 0;
+
+    pthread_mutex_lock(p->lock);
+    frame_group_ready(&group, p->index, buf);
+    if (frame_group_complete(&group) && frame_group_present(&group) != 0)
+        stopping = 1;
+    pthread_cond_broadcast(p->flipped);
+    while (group.members[p->index].ready == buf) {
+        if (stopping || wait_flipped(p, 1000) != 0) {
+            ret = -1;
+            break;
+        }
+    }
+    if (ret == 0)
+        p->frames++;
+    pthread_mutex_unlock(p->lock);
+    return ret;
+}
+
+static void *render_thread(void *arg) {
+    struct output_pipeline *p = arg;
+    int width = p->out.mode.hdisplay;
+    int height = p->out.mode.vdisplay;
+
+    p->start_ms = now_ms();
+    while (!p->stop && now_ms() < p->end_ms) {
+        // A free buffer: with three, one is free while a flip is in flight
+        pthread_mutex_lock(p->lock);
+        struct swap_buffer *buf;
+        while (!(buf = swapchain_acquire(&p->sc))) {
+            if (wait_flipped(p, 1000) != 0)
+                break;
+        }
+        pthread_mutex_unlock(p->lock);
+        if (!buf) {
+            fprintf(stderr, "%s: no buffer came back from scanout\n", p->out.name);
+            p->failed = 1;
+            break;
+        }
+
+        // Draw without the lock; the buffer is ours until it is queued
+        double t0 = now_ms();
+        int x = (int)((p->frames * 8) % (unsigned int)(width - BAR_WIDTH));
+        wc_fill(buf->map, buf->map_pitch, width, height, background[p->index]);
+        wc_fill_rect(buf->map, buf->map_pitch, x, 0, BAR_WIDTH, height, BAR_COLOR);
+        latency_stats_add(&p->render, now_ms() - t0);
+
+        if (use_group) {
+            if (present_grouped(p, buf) != 0)
+                break;
+            continue;
+        }
+
+        // KMS takes one flip per CRTC at a time
+        pthread_mutex_lock(p->lock);
+        while (swapchain_flip_pending(&p->sc)) {
+            if (wait_flipped(p, 1000) != 0)
+                break;
+        }
+        int ret = -1;
+        if (!swapchain_flip_pending(&p->sc)) {
+            drmModeAtomicReq *req = drmModeAtomicAlloc();
+            drm_props_add(req, &p->out.plane_props, DRM_PROP_PLANE_FB_ID, buf->fb_id);
+            ret = drmModeAtomicCommit(p->drm_fd, req, DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT, p);
+            drmModeAtomicFree(req);
+            if (ret == 0) {
+                swapchain_queue(&p->sc, buf);
+                p->frames++;
+            } else {
+                perror("drmModeAtomicCommit (flip) failed");
+            }
+        }
+        pthread_mutex_unlock(p->lock);
+        if (ret != 0) {
+            p->failed = 1;
+            break;
+        }
+    }
+
+    // Let the last flip land before the buffers can be freed
+    pthread_mutex_lock(p->lock);
+    if (use_group) {
+        stopping = 1;
+        pthread_cond_broadcast(p->flipped);
+    }
+    while (swapchain_flip_pending(&p->sc)) {
+        if (wait_flipped(p, 1000) != 0)
+            break;
+    }
+    pthread_mutex_unlock(p->lock);
+    p->stop_ms = now_ms();
+    return NULL;
+}
+
+static int output_init(struct output_pipeline *p, int drm_fd, int index, const struct kms_output *out) {
+    pthread_condattr_t attr;
+
+    memset(p, 0, sizeof(*p));
+    p->drm_fd = drm_fd;
+    p->index = index;
+    p->active = 1;
+    p->out = *out;
+    latency_stats_reset(&p->render);
+    latency_stats_reset(&p->interval);
+    pthread_mutex_init(&p->own_lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&p->own_flipped, &attr);
+    pthread_condattr_destroy(&attr);
+    p->lock = use_group ? &group_lock : &p->own_lock;
+    p->flipped = use_group ? &group_flipped : &p->own_flipped;
+
+    fb_pool_init(&p->fbs, drm_fd, &fb_pool_dumb_backend, NULL, OUTPUT_BUFFERS);
+    if (swapchain_init(&p->sc, drm_fd, OUTPUT_BUFFERS) != 0)
+        return -1;
+    for (int i = 0; i < OUTPUT_BUFFERS; i++) {
+        struct fb_pool_entry *fb = fb_pool_acquire(&p->fbs, out->mode.hdisplay, out->mode.vdisplay,
+                                                   DRM_FORMAT_XRGB8888, DRM_FORMAT_MOD_INVALID);
+        if (!fb)
+            return -1;
+        p->sc.buffers[i].fb_id = fb->fb_id;
+        p->sc.buffers[i].map = fb->map;
+        p->sc.buffers[i].map_pitch = fb->map_pitch;
+        p->sc.buffers[i].owner = fb;
+    }
+    wc_fill(p->sc.buffers[0].map, p->sc.buffers[0].map_pitch, out->mode.hdisplay, out->mode.vdisplay,
+            background[index]);
+    return 0;
+}
+
+static void output_destroy(struct output_pipeline *p) {
+    fb_pool_destroy(&p->fbs);
+    pthread_cond_destroy(&p->own_flipped);
+    pthread_mutex_destroy(&p->own_lock);
+    p->active = 0;
+}
+
+static void output_print_stats(const struct output_pipeline *p) {
+    double seconds = (p->stop_ms - p->start_ms) / 1000.0;
+    char name[64];
+
+    printf("[OUTPUT]   : %s: %u frames, %u flips, %.1f fps%s\n", p->out.name, p->frames, p->sc.flips,
+           seconds > 0 ? p->sc.flips / seconds : 0.0, p->failed ? " (stopped on error)" : "");
+    snprintf(name, sizeof(name), "%s render", p->out.name);
+    latency_stats_print(name, &p->render);
+    snprintf(name, sizeof(name), "%s interval", p->out.name);
+    latency_stats_print(name, &p->interval);
+}
+
+// Light the output in slot p alone (the other CRTCs are not in the commit)
+// and start its render thread
+static int output_start(struct output_pipeline *p, struct drm_blob_cache *blobs, double end_ms) {
+    drmModeAtomicReq *req = drmModeAtomicAlloc();
+    int ret = topology_add_output_modeset(&p->out, blobs, req, p->sc.buffers[0].fb_id);
+    if (ret == 0)
+        ret = drmModeAtomicCommit(p->drm_fd, req, DRM_MODE_ATOMIC_ALLOW_MODESET, NULL);
+    drmModeAtomicFree(req);
+    if (ret < 0) {
+        perror("drmModeAtomicCommit (output modeset) failed");
+        return -1;
+    }
+    swapchain_present_now(&p->sc, &p->sc.buffers[0]);
+
+    p->end_ms = end_ms;
+    if (pthread_create(&p->thread, NULL, render_thread, p) != 0) {
+        perror("pthread_create failed");
+        return -1;
+    }
+    return 0;
+}
+
+// Stop the output's thread, switch its CRTC off and free its buffers
+static void output_stop(struct output_pipeline *p) {
+    p->stop = 1;
+    pthread_join(p->thread, NULL);
+
+    drmModeAtomicReq *req = drmModeAtomicAlloc();
+    topology_add_output_disable(&p->out, req);
+    if (drmModeAtomicCommit(p->drm_fd, req, DRM_MODE_ATOMIC_ALLOW_MODESET, NULL) < 0)
+        perror("drmModeAtomicCommit (output off) failed");
+    drmModeAtomicFree(req);
+
+    output_print_stats(p);
+    output_destroy(p);
+}
+
+static void topology_remove(struct kms_topology *topo, uint32_t connector_id) {
+    for (int i = 0; i < topo->count; i++) {
+        if (topo->outputs[i].connector_id == connector_id) {
+            memmove(&topo->outputs[i], &topo->outputs[i + 1], (topo->count - i - 1) * sizeof(topo->outputs[0]));
+            topo->count--;
+            return;
+        }
+    }
+}
+
+// Rebuild only the outputs whose connector changed
+static void handle_hotplug(int drm_fd, const struct hotplug_change *changes, struct kms_topology *topo,
+                           struct output_pipeline *outputs, struct drm_blob_cache *blobs, double end_ms) {
+    for (int c = 0; c < changes->count; c++) {
+        uint32_t connector_id = changes->connector_ids[c];
+
+        // Gone, or re-announced (a different display may be behind it now)
+        for (int i = 0; i < TOPOLOGY_MAX_OUTPUTS; i++) {
+            if (outputs[i].active && outputs[i].out.connector_id == connector_id) {
+                printf("[HOTPLUG]  : %s %s\n", outputs[i].out.name,
+                       changes->connected[c] ? "changed, restarting it" : "unplugged, stopping it");
+                output_stop(&outputs[i]);
+                topology_remove(topo, connector_id);
+            }
+        }
+        if (!changes->connected[c])
+            continue;
+
+        int slot = 0;
+        while (slot < TOPOLOGY_MAX_OUTPUTS && outputs[slot].active)
+            slot++;
+        struct kms_output out;
+        if (slot == TOPOLOGY_MAX_OUTPUTS || topo->count == TOPOLOGY_MAX_OUTPUTS ||
+            topology_solve_output(drm_fd, connector_id, topo, &out) != 0) {
+            fprintf(stderr, "Connector %u was plugged in but cannot be driven\n", connector_id);
+            continue;
+        }
+        if (output_init(&outputs[slot], drm_fd, slot, &out) != 0 ||
+            output_start(&outputs[slot], blobs, end_ms) != 0) {
+            fprintf(stderr, "%s: failed to start\n", out.name);
+            output_destroy(&outputs[slot]);
+            continue;
+        }
+        topo->outputs[topo->count++] = out;
+        printf("[HOTPLUG]  : %s plugged in, CRTC %u, %dx%d@%dHz\n", out.name, out.crtc_id, out.mode.hdisplay,
+               out.mode.vdisplay, out.mode.vrefresh);
+    }
+
+    // The saved topology no longer matches the device
+    topology_cache_invalidate(drm_fd, NULL);
+}
+
+// Entry point
+int main(int argc, char **argv) {
+    int seconds = DEFAULT_SECONDS;
+    int rescan = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "d:grh")) != -1) {
+        switch (opt) {
+        case 'd':
+            seconds = atoi(optarg);
+            break;
+        case 'g':
+            use_group = 1;
+            break;
+        case 'r':
+            rescan = 1;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-d seconds] [-g] [-r]\n", argv[0]);
+            fprintf(stderr, "  -d   render on every output for this many seconds (default %d)\n", DEFAULT_SECONDS);
+            fprintf(stderr, "  -g   present all outputs together, one atomic commit per frame (video wall)\n");
+            fprintf(stderr, "  -r   enumerate the outputs again instead of using the topology snapshot\n");
+            return opt == 'h' ? 0 : -1;
+        }
+    }
+    if (seconds <= 0)
+        seconds = DEFAULT_SECONDS;
+
+    // Open the KMS device, atomic + universal planes enabled
+    struct drm_device_info dev;
+    int drm_fd = drm_device_open(&dev);
+    if (drm_fd < 0)
+        return -1;
+
+    static struct kms_topology topo;
+    static struct output_pipeline outputs[TOPOLOGY_MAX_OUTPUTS];
+    struct drm_blob_cache blobs;
+    struct hotplug_monitor hotplug;
+    uint32_t fb_ids[TOPOLOGY_MAX_OUTPUTS];
+    pthread_t events;
+    int count = 0;
+    int status = -1;
+
+    drm_blob_cache_init(&blobs, drm_fd);
+    frame_group_init(&group, drm_fd);
+    hotplug.sock = -1;
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&group_flipped, &attr);
+    pthread_condattr_destroy(&attr);
+
+    if (rescan)
+        topology_cache_invalidate(drm_fd, NULL);
+    if (topology_solve_cached(drm_fd, NULL, &topo) <= 0) {
+        fprintf(stderr, "No connected output could be driven\n");
+        goto out;
+    }
+    topology_print(&topo);
+
+    for (; count < topo.count; count++) {
+        if (output_init(&outputs[count], drm_fd, count, &topo.outputs[count]) != 0) {
+            fprintf(stderr, "%s: failed to set up its buffers\n", topo.outputs[count].name);
+            goto out;
+        }
+        fb_ids[count] = outputs[count].sc.buffers[0].fb_id;
+        if (use_group) {
+            frame_group_add(&group, outputs[count].out.crtc_id, &outputs[count].out.plane_props,
+                            &outputs[count].sc);
+            group_outputs[count] = &outputs[count];
+        }
+    }
+
+    // A wall's membership is fixed; otherwise follow displays coming and going
+    if (use_group)
+        printf("[HOTPLUG]  : not watched in group mode\n");
+    else if (hotplug_init(&hotplug, drm_fd) != 0)
+        fprintf(stderr, "Hotplug events unavailable, outputs are fixed\n");
+
+    // One modeset for every output; blocking, the flips that follow need it done
+    drmModeAtomicReq *modeset = drmModeAtomicAlloc();
+    int ret = topology_add_modeset(&topo, &blobs, modeset, fb_ids);
+    if (ret == 0)
+        ret = drmModeAtomicCommit(drm_fd, modeset, DRM_MODE_ATOMIC_ALLOW_MODESET, NULL);
+    drmModeAtomicFree(modeset);
+    if (ret < 0) {
+        perror("drmModeAtomicCommit (modeset) failed");
+        goto out;
+    }
+    printf("[ATOMIC]   : Commit successful\n");
+    for (int i = 0; i < count; i++)
+        swapchain_present_now(&outputs[i].sc, &outputs[i].sc.buffers[0]);
+
+    if (pthread_create(&events, NULL, event_thread, &drm_fd) != 0) {
+        perror("pthread_create failed");
+        goto out;
+    }
+
+    double start = now_ms();
+    double end = start + seconds * 1000.0;
+    int started = 0;
+    for (; started < count; started++) {
+        outputs[started].end_ms = end;
+        if (pthread_create(&outputs[started].thread, NULL, render_thread, &outputs[started]) != 0) {
+            perror("pthread_create failed");
+            break;
+        }
+    }
+    // Threads that never started have no thread to join
+    for (int i = started; i < count; i++)
+        output_destroy(&outputs[i]);
+
+    // The render threads run on their own; this thread only reacts to hotplug
+    while (hotplug.sock >= 0 && now_ms() < end) {
+        struct pollfd pfd = { .fd = hotplug.sock, .events = POLLIN };
+        int timeout = (int)(end - now_ms()) + 1;
+        struct hotplug_change changes;
+        if (poll(&pfd, 1, timeout) > 0 && hotplug_read(&hotplug, &changes) > 0)
+            handle_hotplug(drm_fd, &changes, &topo, outputs, &blobs, end);
+    }
+
+    unsigned int total = 0;
+    int active = 0;
+    for (int i = 0; i < TOPOLOGY_MAX_OUTPUTS; i++) {
+        if (!outputs[i].active)
+            continue;
+        pthread_join(outputs[i].thread, NULL);
+        output_print_stats(&outputs[i]);
+        total += outputs[i].sc.flips;
+        active++;
+    }
+    double elapsed = (now_ms() - start) / 1000.0;
+
+    events_running = 0;
+    pthread_join(events, NULL);
+
+    printf("[OUTPUT]   : %.1f fps across %d output%s at the end\n", total / elapsed, active, active == 1 ? "" : "s");
+    if (use_group)
+        frame_group_print_stats(&group);
+    if (hotplug.sock >= 0)
+        hotplug_print_stats(&hotplug);
+    status = started == count ? 0 : -1;
+
+out:
+    // Cleanup
+    for (int i = 0; i < TOPOLOGY_MAX_OUTPUTS; i++) {
+        if (outputs[i].active)
+            output_destroy(&outputs[i]);
+    }
+    hotplug_destroy(&hotplug);
+    drm_blob_cache_destroy(&blobs);
+    pthread_cond_destroy(&group_flipped);
+    close(drm_fd);
+    return status;
+}
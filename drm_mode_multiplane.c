@@ -13,230 +13,236 @@
 #include <ctype.h>
 #include <getopt.h>
 #include <inttypes.h>
+#include <math.h>
 
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 #include <drm_fourcc.h>
 
+#include "cursor.h"
+#include "dmabuf_import.h"
+#include "drm_blob.h"
+#include "drm_device.h"
+#include "drm_props.h"
+#include "fb_pool.h"
+#include "plane_alloc.h"
+#include "sprite.h"
+#include "topology_cache.h"
+#include "wc_blit.h"
+
 #define PRIMARY 1
 #define OVERLAY 0
-#define PROP_ID(obj, type, name) get_property_id(drm_fd, obj, type, name)
-
-// Helper function to get the *value* of a property by name for a given plane
-static int get_property_value(int drm_fd, uint32_t plane_id, const char *name) {
-    drmModeObjectPropertiesPtr props = drmModeObjectGetProperties(drm_fd, plane_id, DRM_MODE_OBJECT_PLANE);
-    if (!props)
-        return -1;
-
-    for (uint32_t i = 0; i < props->count_props; i++) {
-        drmModePropertyPtr prop = drmModeGetProperty(drm_fd, props->props[i]);
-        if (!prop)
-            continue;
 
-        if (strcmp(prop->name, name) == 0) {
-            uint64_t value = props->prop_values[i];
-            drmModeFreeProperty(prop);
-            drmModeFreeObjectProperties(props);
-            return (int)value;
-        }
+#define PRIMARY_COLOR 0xFF0000FF
+#define OVERLAY_COLOR 0x80008000    // pre-multiplied ARGB8888: green at 50%
+#define OVERLAY_ALPHA 0xC000        // plane-wide opacity on top of that
 
-        drmModeFreeProperty(prop);
-    }
+#define PRODUCER_BUFFERS 3
+#define PRODUCER_FRAMES 120
 
-    drmModeFreeObjectProperties(props);
-    return -1;
-}
+#define POINTER_SIZE 24
 
-// Helper function to get the *ID* of a property by name for a given DRM object
-static uint32_t get_property_id(int drm_fd, uint32_t obj_id, uint32_t obj_type, const char *name) {
-    drmModeObjectProperties *props = drmModeObjectGetProperties(drm_fd, obj_id, obj_type);
-    if (!props)
-        return 0;
+// Take a dumb framebuffer from the pool and fill it with the plane's colour.
+// The overlay is a translucent ARGB8888 HUD.
+static int create_fb(struct fb_pool *fbs, struct fb_pool_entry **fb_out, int width, int height, int flag) {
+    uint32_t fourcc = flag ? DRM_FORMAT_XRGB8888 : DRM_FORMAT_ARGB8888;
+    struct fb_pool_entry *fb = fb_pool_acquire(fbs, width, height, fourcc, DRM_FORMAT_MOD_INVALID);
+    if (!fb)
+        return -1;
+    *fb_out = fb;
 
-    uint32_t prop_id = 0;
-    for (uint32_t i = 0; i < props->count_props; i++) {
-        drmModePropertyPtr prop = drmModeGetProperty(drm_fd, props->props[i]);
-        if (!prop)
-            continue;
+    if(flag)
+      printf("[PRIMARY_FB]   : ID = %u\n", fb->fb_id);
+    else
+      printf("[OVERLAY_FB]   : ID = %u\n", fb->fb_id);
 
-        if (strcmp(prop->name, name) == 0)
-            prop_id = prop->prop_id;
+    uint32_t color;
+    if(flag)
+        color = PRIMARY_COLOR;
+    else
+        color = OVERLAY_COLOR;
 
-        drmModeFreeProperty(prop);
-        if (prop_id)
-            break;
-    }
+    wc_fill(fb->map, fb->map_pitch, width, height, color);
 
-    drmModeFreeObjectProperties(props);
-    return prop_id;
+    return 0;
 }
 
-// Find the first connected connector with a valid mode
-static int fetch_connector(int drm_fd, drmModeRes *resources, drmModeConnector **connector_out) {
-    for (int i = 0; i < resources->count_connectors; i++) {
-        drmModeConnector *conn = drmModeGetConnector(drm_fd, resources->connectors[i]);
-        if (!conn)
-            continue;
-        
-        if ((conn->connection == DRM_MODE_CONNECTED) && (conn->modes != NULL)) {
-            *connector_out = conn;
-            printf("[CONNECTOR]    : ID = %d and STATUS = CONNECTED\n", conn->connector_id);
-            printf("[MODE]         : %dx%d @%dHz\n", conn->modes->hdisplay, conn->modes->vdisplay, conn->modes->vrefresh);
-            return 0;
-        }
+// What the display would show for the overlay over the primary: src is
+// pre-multiplied, alpha the plane-wide 16-bit opacity
+static uint32_t blend_over(uint32_t dst, uint32_t src, uint16_t alpha) {
+    uint32_t a = ((src >> 24) * alpha + 0x7fff) / 0xffff;
+    uint32_t out = 0xFF000000;
 
-        drmModeFreeConnector(conn);
+    for (int shift = 0; shift < 24; shift += 8) {
+        uint32_t s = (((src >> shift) & 0xff) * alpha + 0x7fff) / 0xffff;
+        uint32_t d = (dst >> shift) & 0xff;
+        out |= ((s + d * (255 - a) / 255) & 0xff) << shift;
     }
-    return -1;
+    return out;
 }
 
-// Pick a CRTC from the resource list (can be improved to match connector's encoder)
-static int fetch_crtc(int drm_fd, drmModeRes *resources, drmModeConnector *connector, drmModeCrtc **crtc_out, int *index) {
-    for (int i = 0; i < resources->count_crtcs; i++) {
-        drmModeCrtc *crtc = drmModeGetCrtc(drm_fd, resources->crtcs[i]);
-        if (crtc) {
-            *crtc_out = crtc;
-            printf("[CRTC]         : ID = %d\n", crtc->crtc_id);
-            *index = i;
-            return 0;
-        }
+// Stand-in for a foreign producer (camera, decoder, another process): a
+// ring of udmabuf-backed dma-bufs, each filled once with its own colour
+struct producer_buffer {
+    int fd;
+    uint8_t *map;
+    size_t size;
+};
+
+static int producer_init(struct producer_buffer *bufs, int count, int width, int height) {
+    static const uint32_t colors[] = { 0xFFFF0000, 0xFF00FF00, 0xFFFFFF00 };
+
+    for (int i = 0; i < count; i++) {
+        void *map = NULL;
+        bufs[i].fd = udmabuf_create((size_t)width * 4 * height, &map, &bufs[i].size);
+        if (bufs[i].fd < 0)
+            return -1;
+        bufs[i].map = map;
+
+        dmabuf_cpu_access(bufs[i].fd, 1);
+        wc_fill(bufs[i].map, width * 4, width, height, colors[i % 3]);
+        dmabuf_cpu_access(bufs[i].fd, 0);
     }
-    return -1;
+    return 0;
 }
 
-// Find the primary plane associated with the selected CRTC
-static int fetch_plane(int drm_fd, drmModeCrtc *crtc, drmModePlane **primary_plane, drmModePlane **overlay_plane, int *crtc_index) {
-    drmModePlaneRes *planes = drmModeGetPlaneResources(drm_fd);
-    if (!planes)
-        return -1;
-
-    for (uint32_t i = 0; i < planes->count_planes; i++) {
-        drmModePlane *plane = drmModeGetPlane(drm_fd, planes->planes[i]);
-        if (!plane)
+static void producer_destroy(struct producer_buffer *bufs, int count) {
+    for (int i = 0; i < count; i++) {
+        if (bufs[i].fd < 0)
             continue;
-
-        int type = get_property_value(drm_fd, plane->plane_id, "type");
-        if(plane->possible_crtcs & (1 << *crtc_index)) {
-        if (type == DRM_PLANE_TYPE_PRIMARY) {
-            printf("[PRIMARY_PLANE]: ID = %d and TYPE = PRIMARY\n", plane->plane_id);
-            *primary_plane = plane;
-            continue;
-        }
-        if (type == DRM_PLANE_TYPE_OVERLAY) {
-            printf("[OVERLAY_PLANE]: ID = %d and TYPE = OVERLAY\n", plane->plane_id);
-            *overlay_plane = plane;
-            continue;
-        }
-        }
-             drmModeFreePlane(plane); 
-        }
-    drmModeFreePlaneResources(planes);  
-    return 0;
+        munmap(bufs[i].map, bufs[i].size);
+        close(bufs[i].fd);
+    }
 }
 
-// Fill the framebuffer with a solid color (XRGB8888 format)
-static int fill_color(uint8_t *data, int size, uint32_t color) {
-    for (int i = 0; i < size; i += 4) {
-        *(uint32_t *)(data + i) = color; // 4 bytes per pixel
+// Cycle the overlay through the producer's buffers. Every frame is a cache
+// lookup plus an FB_ID-only commit: after the first lap no buffer is
+// imported again and no pixel is copied.
+static void show_producer_frames(int drm_fd, struct dmabuf_cache *imports, const struct drm_object_props *overlay_props,
+                                 struct producer_buffer *bufs, int width, int height) {
+    for (int frame = 0; frame < PRODUCER_FRAMES; frame++) {
+        struct producer_buffer *buf = &bufs[frame % PRODUCER_BUFFERS];
+        uint32_t fb_id = dmabuf_import_fb(imports, buf->fd, width, height, DRM_FORMAT_XRGB8888, width * 4, 0,
+                                          DRM_FORMAT_MOD_LINEAR);
+        if (!fb_id)
+            return;
+
+        drmModeAtomicReq *req = drmModeAtomicAlloc();
+        if (!req)
+            return;
+        drm_props_add(req, overlay_props, DRM_PROP_PLANE_FB_ID, fb_id);
+
+        // Blocking commit: paces the loop at the refresh rate
+        int ret = drmModeAtomicCommit(drm_fd, req, 0, NULL);
+        drmModeAtomicFree(req);
+        if (ret < 0) {
+            perror("drmModeAtomicCommit (overlay) failed");
+            return;
+        }
+        dmabuf_cache_flipped(imports);
     }
-    return 0;
 }
 
-// Create a framebuffer using dumb buffer and map it to userspace memory
-static int create_fb(int drm_fd, int *fb_id, int width, int height, int flag) {
-   
-    struct drm_mode_create_dumb create = {
-        .height = height,
-        .width = width,
-        .bpp = 32 // 4 bytes per pixel (XRGB8888)
+// Bounce the overlay around the CRTC: each vblank only the plane's CRTC_X /
+// CRTC_Y go to the kernel, nothing is redrawn
+static void animate_sprite(int drm_fd, const drmModeModeInfo *mode, const struct drm_object_props *plane_props,
+                           const struct plane_layer *layer) {
+    struct sprite_engine engine;
+    drmEventContext events = {
+        .version = 3,
+        .page_flip_handler2 = sprite_flip_handler,
+    };
+    struct sprite sprite = {
+        .plane = plane_props,
+        .x = layer->x, .y = layer->y, .w = layer->w, .h = layer->h,
+        .fb_w = layer->src_w, .fb_h = layer->src_h,
+        .vx = 6, .vy = 4,
     };
 
-    // Create dumb buffer
-    if (drmIoctl(drm_fd, DRM_IOCTL_MODE_CREATE_DUMB, &create) < 0) {
-        perror("DRM_IOCTL_MODE_CREATE_DUMB failed");
-        return -1;
-    }
-
-    uint32_t handle = create.handle;
-    uint32_t stride = create.pitch;
-    uint32_t size = create.size;
-
-    uint32_t handles[4] = {handle};
-    uint32_t strides[4] = {stride};
-    uint32_t offsets[4] = {0};
+    sprite_engine_init(&engine, drm_fd, &events, mode->hdisplay, mode->vdisplay);
+    if (!sprite_engine_add(&engine, &sprite))
+        return;
 
-    // Add framebuffer
-    if (drmModeAddFB2(drm_fd, width, height, DRM_FORMAT_XRGB8888, handles, strides, offsets, fb_id, 0) != 0) {
-        perror("drmModeAddFB2 failed");
-        return -1;
+    double end = now_ms() + 5000.0;
+    while (now_ms() < end) {
+        sprite_engine_step(&engine);
+        if (sprite_engine_commit(&engine) != 0 || sprite_engine_wait(&engine, 1000) != 0)
+            break;
     }
+    sprite_engine_print_stats(&engine);
+}
 
-    if(flag)
-      printf("[PRIMARY_FB]   : ID = %d\n", *fb_id);
-    else
-      printf("[OVERLAY_FB]   : ID = %d\n", *fb_id);
-    // Map dumb buffer to userspace
-    struct drm_mode_map_dumb map = {.handle = handle};
-    if (drmIoctl(drm_fd, DRM_IOCTL_MODE_MAP_DUMB, &map) < 0) {
-        perror("DRM_IOCTL_MODE_MAP_DUMB failed");
-        return -1;
+// Arrow pointer with a black outline, hotspot at the tip (0, 0)
+static void draw_pointer(uint32_t *argb, uint32_t fill) {
+    for (int y = 0; y < POINTER_SIZE; y++) {
+        for (int x = 0; x < POINTER_SIZE; x++) {
+            int inside = x <= y * 2 / 3 && y < POINTER_SIZE - x / 2;
+            int edge = x == 0 || x == y * 2 / 3 || y == POINTER_SIZE - 1 - x / 2;
+            argb[y * POINTER_SIZE + x] = !inside ? 0 : edge ? 0xFF000000 : fill;
+        }
     }
+}
 
-    uint8_t *data = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, drm_fd, map.offset);
-    if (data == MAP_FAILED) {
-        perror("mmap failed");
-        return -1;
+// Circle the pointer around the screen for 5 s. Positions arrive every
+// 4 ms like input events would, faster than the refresh rate: one commit
+// per vblank carries the latest one. The image is handed over every
+// iteration but only written and flipped when it changes (once, halfway).
+static void animate_cursor(struct cursor *cursor, const drmModeModeInfo *mode) {
+    static uint32_t white[POINTER_SIZE * POINTER_SIZE];
+    static uint32_t red[POINTER_SIZE * POINTER_SIZE];
+    draw_pointer(white, 0xFFFFFFFF);
+    draw_pointer(red, 0xFFFF0000);
+
+    double start = now_ms();
+    double now;
+    while ((now = now_ms()) < start + 5000.0) {
+        double angle = (now - start) / 1000.0 * 2.0;
+        int32_t x = mode->hdisplay / 2 + (int32_t)(mode->vdisplay / 3 * cos(angle));
+        int32_t y = mode->vdisplay / 2 + (int32_t)(mode->vdisplay / 3 * sin(angle));
+
+        const uint32_t *image = now - start < 2500.0 ? white : red;
+        if (cursor_set_image(cursor, image, POINTER_SIZE, POINTER_SIZE, POINTER_SIZE * 4, 0, 0) != 0 ||
+            cursor_move(cursor, x, y) != 0 || cursor_dispatch(cursor) != 0)
+            break;
+        usleep(4000);
     }
+    cursor_wait(cursor, 1000);
+    cursor_print_stats(cursor);
+}
 
-    uint32_t color;
-    if(flag)
-        color = 0xFF0000FF;
-    else
-        color = 0xFF00FF00;
+// Connector routing, mode and CRTC activation: the part of the first commit
+// that does not depend on which planes end up showing what
+static drmModeAtomicReq *modeset_request(struct drm_blob_cache *blobs, const struct kms_output *out) {
+    // MODE_ID blob from the blob cache; released when the cache is destroyed
+    uint32_t blob_id = drm_mode_blob_get(blobs, &out->mode);
+    if (!blob_id)
+        return NULL;
 
-    fill_color(data, size, color);
+    drmModeAtomicReq *req = drmModeAtomicAlloc();
+    if (!req) {
+        fprintf(stderr, "Failed to allocate atomic request\n");
+        return NULL;
+    }
 
-    return 0;
+    drm_props_add(req, &out->conn_props, DRM_PROP_CONNECTOR_CRTC_ID, out->crtc_id);
+    drm_props_add(req, &out->crtc_props, DRM_PROP_CRTC_MODE_ID, blob_id);
+    drm_props_add(req, &out->crtc_props, DRM_PROP_CRTC_ACTIVE, 1);
+    return req;
 }
 
-// Perform atomic commit to set plane, mode, and activate the display
-int commit_fb(int drm_fd, drmModeConnector *connector, drmModeCrtc *crtc, drmModePlane *plane, drmModePlane *overlay_plane, int overlay_fb, int fb_id) {
-    drmModeAtomicReq *req = drmModeAtomicAlloc();
+// Perform atomic commit to set planes, mode, and activate the display
+int commit_fb(int drm_fd, drmModeAtomicReq *modeset, const struct plane_alloc *planes,
+              const struct plane_layer *layers, int count) {
+    drmModeAtomicReq *req = drmModeAtomicDuplicate(modeset);
     if (!req) {
         fprintf(stderr, "Failed to allocate atomic request\n");
         return -1;
     }
 
-    uint32_t blob_id = 0;
-    drmModeCreatePropertyBlob(drm_fd, &crtc->mode, sizeof(crtc->mode), &blob_id);
-
-    drmModeAtomicAddProperty(req, overlay_plane->plane_id, PROP_ID(overlay_plane->plane_id, DRM_MODE_OBJECT_PLANE, "FB_ID"), overlay_fb);
-    drmModeAtomicAddProperty(req, overlay_plane->plane_id, PROP_ID(overlay_plane->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_ID"), crtc->crtc_id);
-    drmModeAtomicAddProperty(req, overlay_plane->plane_id, PROP_ID(overlay_plane->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_X"), 0);
-    drmModeAtomicAddProperty(req, overlay_plane->plane_id, PROP_ID(overlay_plane->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_Y"), 0 << 16);
-    drmModeAtomicAddProperty(req, overlay_plane->plane_id, PROP_ID(overlay_plane->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_W"), crtc->mode.hdisplay / 4 << 16);
-    drmModeAtomicAddProperty(req, overlay_plane->plane_id, PROP_ID(overlay_plane->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_H"), crtc->mode.vdisplay / 4 << 16);
-    drmModeAtomicAddProperty(req, overlay_plane->plane_id, PROP_ID(overlay_plane->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_X"), 300);
-    drmModeAtomicAddProperty(req, overlay_plane->plane_id, PROP_ID(overlay_plane->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_Y"), 400);
-    drmModeAtomicAddProperty(req, overlay_plane->plane_id, PROP_ID(overlay_plane->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_W"), crtc->mode.hdisplay / 4);
-    drmModeAtomicAddProperty(req, overlay_plane->plane_id, PROP_ID(overlay_plane->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_H"), crtc->mode.vdisplay / 4);
-
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "FB_ID"), fb_id);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_ID"), crtc->crtc_id);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_X"), 0);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_Y"), 0);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_W"), crtc->mode.hdisplay << 16);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_H"), crtc->mode.vdisplay << 16);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_X"), 0);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_Y"), 0);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_W"), crtc->mode.hdisplay);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_H"), crtc->mode.vdisplay);
-
-    drmModeAtomicAddProperty(req, connector->connector_id, PROP_ID(connector->connector_id, DRM_MODE_OBJECT_CONNECTOR, "CRTC_ID"), crtc->crtc_id);
-    drmModeAtomicAddProperty(req, crtc->crtc_id, PROP_ID(crtc->crtc_id, DRM_MODE_OBJECT_CRTC, "MODE_ID"), blob_id);
-    drmModeAtomicAddProperty(req, crtc->crtc_id, PROP_ID(crtc->crtc_id, DRM_MODE_OBJECT_CRTC, "ACTIVE"), 1);
-
-    int ret = drmModeAtomicCommit(drm_fd, req, DRM_MODE_ATOMIC_ALLOW_MODESET | DRM_MODE_ATOMIC_NONBLOCK, NULL);
+    plane_alloc_add(planes, req, layers, count);
+
+    // Blocking: the overlay updates that may follow need the modeset done
+    int ret = drmModeAtomicCommit(drm_fd, req, DRM_MODE_ATOMIC_ALLOW_MODESET, NULL);
     if (ret < 0) perror("drmModeAtomicCommit failed");
     else printf("[ATOMIC]   : Commit successful\n");
 
@@ -245,50 +251,142 @@ int commit_fb(int drm_fd, drmModeConnector *connector, drmModeCrtc *crtc, drmMod
 }
 
 // Entry point
-int main() {
-    // Open DRM device
-    int drm_fd = open("/dev/dri/card1", O_RDWR | O_NONBLOCK);
-    if (drm_fd < 0) {
-        perror("Failed to open DRM device");
-        return -1;
+int main(int argc, char **argv) {
+    int use_udmabuf = 0;
+    int use_sprite = 0;
+    int use_cursor = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "usch")) != -1) {
+        switch (opt) {
+        case 'u':
+            use_udmabuf = 1;
+            break;
+        case 's':
+            use_sprite = 1;
+            break;
+        case 'c':
+            use_cursor = 1;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-u] [-s] [-c]\n", argv[0]);
+            fprintf(stderr, "  -u   show udmabuf-backed dma-bufs on the overlay through the import cache\n");
+            fprintf(stderr, "  -s   bounce the overlay around the screen for 5 s with position-only commits\n");
+            fprintf(stderr, "  -c   move a pointer on the cursor plane (or an overlay) for 5 s\n");
+            return opt == 'h' ? 0 : -1;
+        }
     }
-    
-    // Enable atomic + universal planes
-    drmSetClientCap(drm_fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1);
-    drmSetClientCap(drm_fd, DRM_CLIENT_CAP_ATOMIC, 1);
-
-    // Get DRM resources
-    drmModeRes *resources = drmModeGetResources(drm_fd);
-    drmModeConnector *connector = NULL;
-    drmModeCrtc *crtc = NULL;
-    drmModePlane *plane = NULL;
-    drmModePlane *plane_1 = NULL;
-    int crtc_index = 0;
-    int fb_id = 0;
-    int fb_id_1 = 0;
-    int width = 1920;
-    int height = 1080;
+
+    // Open the KMS device, atomic + universal planes enabled
+    struct drm_device_info dev;
+    int drm_fd = drm_device_open(&dev);
+    if (drm_fd < 0)
+        return -1;
+
+    static struct kms_topology topo;
+    const struct kms_output *out = NULL;
+    struct drm_blob_cache blobs;
+    struct fb_pool fbs;
+    struct plane_alloc planes;
+    struct cursor cursor;
+    // The sprite and cursor phases run one after the other, so while the
+    // cursor is up its commits are the only ones with flip events
+    drmEventContext cursor_events = {
+        .version = 3,
+        .page_flip_handler2 = cursor_flip_handler,
+    };
+    struct dmabuf_cache imports;
+    struct producer_buffer producer[PRODUCER_BUFFERS];
+    struct fb_pool_entry *primary_fb = NULL;
+    struct fb_pool_entry *overlay_fb = NULL;
+    drmModeAtomicReq *modeset = NULL;
+    int width = 0;
+    int height = 0;
 
     
+    drm_blob_cache_init(&blobs, drm_fd);
+    fb_pool_init(&fbs, drm_fd, &fb_pool_dumb_backend, NULL, 1);
+    dmabuf_cache_init(&imports, drm_fd);
+    for (int i = 0; i < PRODUCER_BUFFERS; i++)
+        producer[i].fd = -1;
+
+    // Connector, CRTC (one its encoders can drive) and their property IDs:
+    // from the topology snapshot when the device has not changed since
+    if (topology_solve_cached(drm_fd, NULL, &topo) > 0) {
+        out = &topo.outputs[0];
+        width = out->mode.hdisplay;
+        height = out->mode.vdisplay;
+        printf("[CONNECTOR]    : ID = %d (%s) and STATUS = CONNECTED\n", out->connector_id, out->name);
+        printf("[MODE]         : %dx%d @%dHz\n", width, height, out->mode.vrefresh);
+        printf("[CRTC]         : ID = %d\n", out->crtc_id);
+    } else {
+        fprintf(stderr, "Failed to find a connected output\n");
+    }
+
     // Full setup and commit
-    if (fetch_connector(drm_fd, resources, &connector) == 0 &&
-        fetch_crtc(drm_fd, resources, connector, &crtc, &crtc_index) == 0 &&
-        fetch_plane(drm_fd, crtc, &plane, &plane_1,&crtc_index) == 0 &&
-        create_fb(drm_fd, &fb_id, width, height, PRIMARY) == 0 &&
-        create_fb(drm_fd, &fb_id_1, width/4,height/4, OVERLAY) == 0 ) {
-
-        commit_fb(drm_fd, connector, crtc, plane, plane_1, fb_id_1, fb_id);
-        drmModeFreePlane(plane);
-        drmModeFreePlane(plane_1);
+    if (out &&
+        plane_alloc_init(&planes, drm_fd, out->crtc_id, out->crtc_index) == 0 &&
+        create_fb(&fbs, &primary_fb, width, height, PRIMARY) == 0 &&
+        create_fb(&fbs, &overlay_fb, width/4,height/4, OVERLAY) == 0 &&
+        (modeset = modeset_request(&blobs, out)) != NULL) {
+
+        // Full-screen background and a quarter-size layer above it; the
+        // allocator decides which planes the kernel will take them on
+        struct plane_layer layers[] = {
+            { .fb_id = primary_fb->fb_id, .fourcc = DRM_FORMAT_XRGB8888, .modifier = DRM_FORMAT_MOD_INVALID,
+              .src_w = width, .src_h = height, .x = 0, .y = 0, .w = width, .h = height, .zorder = 0 },
+            { .fb_id = overlay_fb->fb_id, .fourcc = DRM_FORMAT_ARGB8888, .modifier = DRM_FORMAT_MOD_INVALID,
+              .src_w = width / 4, .src_h = height / 4, .x = 300, .y = 400, .w = width / 4, .h = height / 4,
+              .zorder = 1, .alpha = OVERLAY_ALPHA, .blend = PLANE_BLEND_PREMULTIPLIED },
+        };
+
+        if (plane_alloc_assign(&planes, layers, 2, modeset, DRM_MODE_ATOMIC_ALLOW_MODESET) == 0) {
+            fprintf(stderr, "No plane configuration accepted by the kernel\n");
+        } else {
+            plane_alloc_print(&planes, layers, 2);
+
+            // No plane blends the overlay: compose it into the primary buffer
+            if (layers[1].plane < 0)
+                wc_fill_rect(primary_fb->map, primary_fb->map_pitch, layers[1].x, layers[1].y, layers[1].w,
+                             layers[1].h, blend_over(PRIMARY_COLOR, OVERLAY_COLOR, OVERLAY_ALPHA));
+
+            commit_fb(drm_fd, modeset, &planes, layers, 2);
+            plane_alloc_reset_memo(&planes);
+
+            if (use_udmabuf && layers[1].plane < 0)
+                fprintf(stderr, "No overlay plane for the imported buffers\n");
+            else if (use_udmabuf && producer_init(producer, PRODUCER_BUFFERS, width / 4, height / 4) == 0)
+                show_producer_frames(drm_fd, &imports, &planes.planes[layers[1].plane].props, producer,
+                                     width / 4, height / 4);
+
+            if (use_sprite && layers[1].plane < 0)
+                fprintf(stderr, "No overlay plane to animate\n");
+            else if (use_sprite)
+                animate_sprite(drm_fd, &out->mode, &planes.planes[layers[1].plane].props, &layers[1]);
+
+            if (use_cursor && cursor_init(&cursor, &planes, layers, 2, &fbs, &cursor_events, width, height) == 0) {
+                animate_cursor(&cursor, &out->mode);
+                cursor_destroy(&cursor);
+            }
+        }
+        plane_alloc_print_stats(&planes);
     }
 
     // Keep image on screen for 5 seconds
-    sleep(5);
+    if (!use_sprite && !use_cursor)
+        sleep(5);
+
+    if (use_udmabuf)
+        dmabuf_cache_print_stats(&imports);
+    dmabuf_cache_destroy(&imports);
+    producer_destroy(producer, PRODUCER_BUFFERS);
 
     // Cleanup
-    drmModeFreeCrtc(crtc);
-    drmModeFreeConnector(connector);
-    drmModeFreeResources(resources);
+    if (modeset)
+        drmModeAtomicFree(modeset);
+    drm_blob_cache_destroy(&blobs);
+    fb_pool_print_stats(&fbs);
+    fb_pool_destroy(&fbs);
     close(drm_fd);
     return 0;
 }
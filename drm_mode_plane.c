@@ -16,214 +16,84 @@
 #include <xf86drmMode.h>
 #include <drm_fourcc.h>
 
-// Helper function to get the *value* of a property by name for a given plane
-static int get_property_value(int drm_fd, uint32_t plane_id, const char *name) {
-    drmModeObjectPropertiesPtr props = drmModeObjectGetProperties(drm_fd, plane_id, DRM_MODE_OBJECT_PLANE);
-    if (!props)
+#include "drm_blob.h"
+#include "drm_device.h"
+#include "drm_props.h"
+#include "fb_pool.h"
+#include "frame_stats.h"
+#include "takeover.h"
+#include "topology_cache.h"
+#include "wc_blit.h"
+
+// Take a dumb framebuffer of the mode's size from the pool and fill it
+static int create_fb(struct fb_pool *fbs, const drmModeModeInfo *mode, int *fb_id) {
+    int width = mode->hdisplay;
+    int height = mode->vdisplay;
+
+    struct fb_pool_entry *fb = fb_pool_acquire(fbs, width, height, DRM_FORMAT_XRGB8888, DRM_FORMAT_MOD_INVALID);
+    if (!fb)
         return -1;
-
-    for (uint32_t i = 0; i < props->count_props; i++) {
-        drmModePropertyPtr prop = drmModeGetProperty(drm_fd, props->props[i]);
-        if (!prop)
-            continue;
-
-        if (strcmp(prop->name, name) == 0) {
-            uint64_t value = props->prop_values[i];
-            drmModeFreeProperty(prop);
-            drmModeFreeObjectProperties(props);
-            return (int)value;
-        }
-
-        drmModeFreeProperty(prop);
-    }
-
-    drmModeFreeObjectProperties(props);
-    return -1;
-}
-
-// Helper function to get the *ID* of a property by name for a given DRM object
-static uint32_t get_property_id(int drm_fd, uint32_t obj_id, uint32_t obj_type, const char *name) {
-    drmModeObjectProperties *props = drmModeObjectGetProperties(drm_fd, obj_id, obj_type);
-    if (!props)
-        return 0;
-
-    uint32_t prop_id = 0;
-    for (uint32_t i = 0; i < props->count_props; i++) {
-        drmModePropertyPtr prop = drmModeGetProperty(drm_fd, props->props[i]);
-        if (!prop)
-            continue;
-
-        if (strcmp(prop->name, name) == 0)
-            prop_id = prop->prop_id;
-
-        drmModeFreeProperty(prop);
-        if (prop_id)
-            break;
-    }
-
-    drmModeFreeObjectProperties(props);
-    return prop_id;
-}
-
-// Find the first connected connector with a valid mode
-static int fetch_connector(int drm_fd, drmModeRes *resources, drmModeConnector **connector_out) {
-    for (int i = 0; i < resources->count_connectors; i++) {
-        drmModeConnector *conn = drmModeGetConnector(drm_fd, resources->connectors[i]);
-        if (!conn)
-            continue;
-
-        if ((conn->connection == DRM_MODE_CONNECTED) && (conn->modes != NULL)) {
-            *connector_out = conn;
-            printf("[CONNECTOR]: ID = %d and STATUS = CONNECTED\n", conn->connector_id);
-            printf("[MODE]     : %dx%d @%dHz\n", conn->modes->hdisplay, conn->modes->vdisplay, conn->modes->vrefresh);
-            return 0;
-        }
-
-        drmModeFreeConnector(conn);
-    }
-    return -1;
-}
-
-// Pick a CRTC from the resource list (can be improved to match connector's encoder)
-static int fetch_crtc(int drm_fd, drmModeRes *resources, drmModeConnector *connector, drmModeCrtc **crtc_out) {
-    for (int i = 0; i < resources->count_crtcs; i++) {
-        drmModeCrtc *crtc = drmModeGetCrtc(drm_fd, resources->crtcs[i]);
-        if (crtc) {
-            *crtc_out = crtc;
-            printf("[CRTC]     : ID = %d\n", crtc->crtc_id);
-            return 0;
-        }
-    }
-    return -1;
-}
-
-// Find the primary plane associated with the selected CRTC
-static int fetch_plane(int drm_fd, drmModeCrtc *crtc, drmModePlane **plane_out) {
-    drmModePlaneRes *planes = drmModeGetPlaneResources(drm_fd);
-    if (!planes)
-        return -1;
-
-    for (uint32_t i = 0; i < planes->count_planes; i++) {
-        drmModePlane *plane = drmModeGetPlane(drm_fd, planes->planes[i]);
-        if (!plane)
-            continue;
-
-        if (plane->crtc_id == crtc->crtc_id) {
-            int type = get_property_value(drm_fd, plane->plane_id, "type");
-            if (type == DRM_PLANE_TYPE_PRIMARY) {
-                printf("[PLANE]    : ID = %d and TYPE = PRIMARY\n", plane->plane_id);
-                *plane_out = plane;
-                drmModeFreePlaneResources(planes);
-                return 0;
-            }
-        }
-
-        drmModeFreePlane(plane);
-    }
-
-    drmModeFreePlaneResources(planes);  
-    return -1;
-}
-
-// Fill the framebuffer with a solid color (XRGB8888 format)
-static int fill_color(uint8_t *data, int size, uint32_t color) {
-    for (int i = 0; i < size; i += 4) {
-        *(uint32_t *)(data + i) = color; // 4 bytes per pixel
-    }
-    return 0;
-}
-
-// Create a framebuffer using dumb buffer and map it to userspace memory
-static int create_fb(int drm_fd, drmModeCrtc *crtc, int *fb_id) {
-    int width = crtc->mode.hdisplay;
-    int height = crtc->mode.vdisplay;
-
-    struct drm_mode_create_dumb create = {
-        .height = height,
-        .width = width,
-        .bpp = 32 // 4 bytes per pixel (XRGB8888)
-    };
-
-    // Create dumb buffer
-    if (drmIoctl(drm_fd, DRM_IOCTL_MODE_CREATE_DUMB, &create) < 0) {
-        perror("DRM_IOCTL_MODE_CREATE_DUMB failed");
-        return -1;
-    }
-
-    uint32_t handle = create.handle;
-    uint32_t stride = create.pitch;
-    uint32_t size = create.size;
-
-    uint32_t handles[4] = {handle};
-    uint32_t strides[4] = {stride};
-    uint32_t offsets[4] = {0};
-
-    // Add framebuffer
-    if (drmModeAddFB2(drm_fd, width, height, DRM_FORMAT_XRGB8888, handles, strides, offsets, fb_id, 0) != 0) {
-        perror("drmModeAddFB2 failed");
-        return -1;
-    }
-
-    printf("[FB]       : ID = %d\n", *fb_id);
-
-    // Map dumb buffer to userspace
-    struct drm_mode_map_dumb map = {.handle = handle};
-    if (drmIoctl(drm_fd, DRM_IOCTL_MODE_MAP_DUMB, &map) < 0) {
-        perror("DRM_IOCTL_MODE_MAP_DUMB failed");
-        return -1;
-    }
-
-    uint8_t *data = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, drm_fd, map.offset);
-    if (data == MAP_FAILED) {
-        perror("mmap failed");
-        return -1;
-    }
+    *fb_id = fb->fb_id;
 
     // Fill with blue (XRGB: 0xFF0000FF)
     uint32_t color = 0xFF0000FF;
-    fill_color(data, size, color);
+    wc_fill(fb->map, fb->map_pitch, width, height, color);
 
     return 0;
 }
 
-// Perform atomic commit to set plane, mode, and activate the display
-int commit_fb(int drm_fd, drmModeConnector *connector, drmModeCrtc *crtc, drmModePlane *plane, int fb_id) {
+// Perform atomic commit to set plane, mode, and activate the display. If
+// the CRTC already shows this mode on the connector only the plane is
+// committed, without ALLOW_MODESET, so the screen does not blank. Both
+// commits block, so the time to first frame can be reported.
+int commit_fb(int drm_fd, struct drm_blob_cache *blobs,
+              const struct drm_object_props *conn_props, const struct drm_object_props *crtc_props,
+              const struct drm_object_props *plane_props, uint32_t crtc_id, const drmModeModeInfo *mode, int fb_id,
+              struct takeover *takeover) {
+    if (takeover_check(drm_fd, conn_props, crtc_props, mode, takeover) &&
+        takeover_commit(drm_fd, plane_props, crtc_id, mode, fb_id) == 0) {
+        printf("[ATOMIC]   : Commit successful (no modeset)\n");
+        takeover_report(takeover, 0);
+        return 0;
+    }
+
     drmModeAtomicReq *req = drmModeAtomicAlloc();
     if (!req) {
         fprintf(stderr, "Failed to allocate atomic request\n");
         return -1;
     }
 
-    #define PROP_ID(obj, type, name) get_property_id(drm_fd, obj, type, name)
-
-    // Create a MODE_ID blob from crtc mode
-    drmModePropertyBlobPtr mode_blob;
-    uint32_t blob_id = 0;
-    drmModeCreatePropertyBlob(drm_fd, &crtc->mode, sizeof(crtc->mode), &blob_id);
+    // MODE_ID blob from the blob cache; released when the cache is destroyed
+    uint32_t blob_id = drm_mode_blob_get(blobs, mode);
+    if (!blob_id) {
+        drmModeAtomicFree(req);
+        return -1;
+    }
 
     // Plane setup
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "FB_ID"), fb_id);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_ID"), crtc->crtc_id);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_X"), 0);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_Y"), 0);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_W"), crtc->mode.hdisplay << 16);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_H"), crtc->mode.vdisplay << 16);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_X"), 0);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_Y"), 0);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_W"), crtc->mode.hdisplay);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_H"), crtc->mode.vdisplay);
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_FB_ID, fb_id);
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_CRTC_ID, crtc_id);
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_SRC_X, 0);
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_SRC_Y, 0);
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_SRC_W, mode->hdisplay << 16);
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_SRC_H, mode->vdisplay << 16);
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_CRTC_X, 0);
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_CRTC_Y, 0);
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_CRTC_W, mode->hdisplay);
+    drm_props_add(req, plane_props, DRM_PROP_PLANE_CRTC_H, mode->vdisplay);
 
     // Connector + CRTC setup
-    drmModeAtomicAddProperty(req, connector->connector_id, PROP_ID(connector->connector_id, DRM_MODE_OBJECT_CONNECTOR, "CRTC_ID"), crtc->crtc_id);
-    drmModeAtomicAddProperty(req, crtc->crtc_id, PROP_ID(crtc->crtc_id, DRM_MODE_OBJECT_CRTC, "MODE_ID"), blob_id);
-    drmModeAtomicAddProperty(req, crtc->crtc_id, PROP_ID(crtc->crtc_id, DRM_MODE_OBJECT_CRTC, "ACTIVE"), 1);
+    drm_props_add(req, conn_props, DRM_PROP_CONNECTOR_CRTC_ID, crtc_id);
+    drm_props_add(req, crtc_props, DRM_PROP_CRTC_MODE_ID, blob_id);
+    drm_props_add(req, crtc_props, DRM_PROP_CRTC_ACTIVE, 1);
 
     // Do the commit
-    int ret = drmModeAtomicCommit(drm_fd, req, DRM_MODE_ATOMIC_ALLOW_MODESET | DRM_MODE_ATOMIC_NONBLOCK, NULL);
+    int ret = drmModeAtomicCommit(drm_fd, req, DRM_MODE_ATOMIC_ALLOW_MODESET, NULL);
     if (ret < 0) {
         perror("drmModeAtomicCommit failed");
     } else {
         printf("[ATOMIC]   : Commit successful\n");
+        takeover_report(takeover, 1);
     }
 
     drmModeAtomicFree(req);
@@ -232,41 +102,46 @@ int commit_fb(int drm_fd, drmModeConnector *connector, drmModeCrtc *crtc, drmMod
 
 // Entry point
 int main() {
-    // Open DRM device
-    int drm_fd = open("/dev/dri/card1", O_RDWR | O_NONBLOCK);
-    if (drm_fd < 0) {
-        perror("Failed to open DRM device");
-        return -1;
-    }
+    struct takeover takeover = { .start_ms = now_ms() };
 
-    // Enable atomic + universal planes
-    drmSetClientCap(drm_fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1);
-    drmSetClientCap(drm_fd, DRM_CLIENT_CAP_ATOMIC, 1);
+    // Open the KMS device, atomic + universal planes enabled
+    struct drm_device_info dev;
+    int drm_fd = drm_device_open(&dev);
+    if (drm_fd < 0)
+        return -1;
 
-    // Get DRM resources
-    drmModeRes *resources = drmModeGetResources(drm_fd);
-    drmModeConnector *connector = NULL;
-    drmModeCrtc *crtc = NULL;
-    drmModePlane *plane = NULL;
+    static struct kms_topology topo;
+    struct drm_blob_cache blobs;
+    struct fb_pool fbs;
     int fb_id = 0;
 
-    // Full setup and commit
-    if (fetch_connector(drm_fd, resources, &connector) == 0 &&
-        fetch_crtc(drm_fd, resources, connector, &crtc) == 0 &&
-        fetch_plane(drm_fd, crtc, &plane) == 0 &&
-        create_fb(drm_fd, crtc, &fb_id) == 0) {
-
-        commit_fb(drm_fd, connector, crtc, plane, fb_id);
-        drmModeFreePlane(plane);
+    drm_blob_cache_init(&blobs, drm_fd);
+    fb_pool_init(&fbs, drm_fd, &fb_pool_dumb_backend, NULL, 1);
+
+    // Connector, CRTC, primary plane and their property IDs: from the
+    // topology snapshot when the device has not changed since it was saved
+    if (topology_solve_cached(drm_fd, NULL, &topo) > 0) {
+        const struct kms_output *out = &topo.outputs[0];
+        printf("[CONNECTOR]: ID = %d (%s) and STATUS = CONNECTED\n", out->connector_id, out->name);
+        printf("[MODE]     : %dx%d @%dHz\n", out->mode.hdisplay, out->mode.vdisplay, out->mode.vrefresh);
+        printf("[CRTC]     : ID = %d\n", out->crtc_id);
+        printf("[PLANE]    : ID = %d and TYPE = PRIMARY\n", out->plane_id);
+
+        // Full setup and commit
+        if (create_fb(&fbs, &out->mode, &fb_id) == 0)
+            commit_fb(drm_fd, &blobs, &out->conn_props, &out->crtc_props, &out->plane_props, out->crtc_id,
+                      &out->mode, fb_id, &takeover);
+    } else {
+        fprintf(stderr, "Failed to find a connected output\n");
     }
 
     // Keep image on screen for 5 seconds
     sleep(5);
 
     // Cleanup
-    drmModeFreeCrtc(crtc);
-    drmModeFreeConnector(connector);
-    drmModeFreeResources(resources);
+    drm_blob_cache_destroy(&blobs);
+    fb_pool_print_stats(&fbs);
+    fb_pool_destroy(&fbs);
     close(drm_fd);
     return 0;
 }
@@ -17,261 +17,157 @@
 #include <xf86drmMode.h>
 #include <drm_fourcc.h>
 
+#include "drm_blob.h"
+#include "drm_device.h"
+#include "drm_formats.h"
+#include "drm_props.h"
+#include "fb_pool.h"
+#include "plane_alloc.h"
+#include "topology_cache.h"
+#include "wc_blit.h"
+
 #define PRIMARY 1
 #define OVERLAY 0
-#define PROP_ID(obj, type, name) get_property_id(drm_fd, obj, type, name)
-
-// ----------------------------------------------------------------------------
-// Helper function to get the *value* of a property by name for a given plane
-// ----------------------------------------------------------------------------
-static int get_property_value(int drm_fd, uint32_t plane_id, const char *name) {
-    drmModeObjectPropertiesPtr props = drmModeObjectGetProperties(drm_fd, plane_id, DRM_MODE_OBJECT_PLANE);
-    if (!props)
-        return -1;
-
-    for (uint32_t i = 0; i < props->count_props; i++) {
-        drmModePropertyPtr prop = drmModeGetProperty(drm_fd, props->props[i]);
-        if (!prop)
-            continue;
 
-        if (strcmp(prop->name, name) == 0) {
-            uint64_t value = props->prop_values[i];
-            drmModeFreeProperty(prop);
-            drmModeFreeObjectProperties(props);
-            return (int)value;
-        }
-
-        drmModeFreeProperty(prop);
-    }
-
-    drmModeFreeObjectProperties(props);
-    return -1;
-}
+#define PRIMARY_COLOR 0xFF00FFFF
+#define OVERLAY_COLOR 0xFF00FF00
 
 // ----------------------------------------------------------------------------
-// Helper function to get the *ID* of a property by name for a given DRM object
+// GBM backend for the framebuffer pool (pool->backend_data is the gbm_device).
+// Each bo is mapped once for CPU fills and stays mapped until it is freed.
+// An explicit key modifier is allocated exactly; DRM_FORMAT_MOD_INVALID
+// leaves the layout to the driver.
 // ----------------------------------------------------------------------------
-static uint32_t get_property_id(int drm_fd, uint32_t obj_id, uint32_t obj_type, const char *name) {
-    drmModeObjectProperties *props = drmModeObjectGetProperties(drm_fd, obj_id, obj_type);
-    if (!props)
-        return 0;
-
-    uint32_t prop_id = 0;
-    for (uint32_t i = 0; i < props->count_props; i++) {
-        drmModePropertyPtr prop = drmModeGetProperty(drm_fd, props->props[i]);
-        if (!prop)
-            continue;
-
-        if (strcmp(prop->name, name) == 0)
-            prop_id = prop->prop_id;
-
-        drmModeFreeProperty(prop);
-        if (prop_id)
-            break;
-    }
+static int gbm_fb_alloc(struct fb_pool *pool, struct fb_pool_entry *entry) {
+    uint32_t width = entry->key.width;
+    uint32_t height = entry->key.height;
 
-    drmModeFreeObjectProperties(props);
-    return prop_id;
-}
-
-// ----------------------------------------------------------------------------
-// Find the first connected connector with a valid mode
-// ----------------------------------------------------------------------------
-static int fetch_connector(int drm_fd, drmModeRes *resources, drmModeConnector **connector_out) {
-    for (int i = 0; i < resources->count_connectors; i++) {
-        drmModeConnector *conn = drmModeGetConnector(drm_fd, resources->connectors[i]);
-        if (!conn)
-            continue;
-        
-        if ((conn->connection == DRM_MODE_CONNECTED) && (conn->modes != NULL)) {
-            *connector_out = conn;
-            printf("[CONNECTOR]    : ID = %d and STATUS = CONNECTED\n", conn->connector_id);
-            printf("[MODE]         : %dx%d @%dHz\n", conn->modes->hdisplay, conn->modes->vdisplay, conn->modes->vrefresh);
-            return 0;
-        }
+    struct gbm_bo *bo;
+    if (entry->key.modifier != DRM_FORMAT_MOD_INVALID)
+        bo = gbm_bo_create_with_modifiers(pool->backend_data, width, height, entry->key.fourcc,
+                                          &entry->key.modifier, 1);
+    else
+        bo = gbm_bo_create(pool->backend_data, width, height, entry->key.fourcc,
+                           GBM_BO_USE_SCANOUT | GBM_BO_USE_RENDERING | GBM_BO_USE_WRITE);
+    if (!bo) {
+        fprintf(stderr, "Failed to create GBM buffer object\n");
+        return -1;
+    }
 
-        drmModeFreeConnector(conn);
+    uint32_t stride;
+    void *map_data = NULL;
+    uint8_t *map = gbm_bo_map(bo, 0, 0, width, height, GBM_BO_TRANSFER_READ_WRITE, &stride, &map_data);
+    if (!map) {
+        fprintf(stderr, "Failed to map GBM buffer\n");
+        gbm_bo_destroy(bo);
+        return -1;
     }
-    return -1;
-}
 
-// ----------------------------------------------------------------------------
-// Pick a CRTC from the resource list (improvement: match connector's encoder)
-// ----------------------------------------------------------------------------
-static int fetch_crtc(int drm_fd, drmModeRes *resources, drmModeConnector *connector, drmModeCrtc **crtc_out, int *index) {
-    for (int i = 0; i < resources->count_crtcs; i++) {
-        drmModeCrtc *crtc = drmModeGetCrtc(drm_fd, resources->crtcs[i]);
-        if (crtc) {
-            *crtc_out = crtc;
-            printf("[CRTC]         : ID = %d\n", crtc->crtc_id);
-            *index = i;
-            return 0;
-        }
+    entry->bo = bo;
+    entry->modifier = entry->key.modifier;
+    entry->num_planes = gbm_bo_get_plane_count(bo);
+    if (entry->num_planes > FB_POOL_MAX_PLANES)
+        entry->num_planes = FB_POOL_MAX_PLANES;
+    for (int p = 0; p < entry->num_planes; p++) {
+        entry->handles[p] = gbm_bo_get_handle_for_plane(bo, p).u32;
+        entry->pitches[p] = gbm_bo_get_stride_for_plane(bo, p);
+        entry->offsets[p] = gbm_bo_get_offset(bo, p);
     }
-    return -1;
+    entry->size = entry->pitches[0] * height;
+    entry->map = map;
+    entry->map_pitch = stride;
+    entry->map_data = map_data;
+    return 0;
 }
 
-// ----------------------------------------------------------------------------
-// Find the primary and overlay planes associated with the selected CRTC
-// ----------------------------------------------------------------------------
-static int fetch_plane(int drm_fd, drmModeCrtc *crtc, drmModePlane **primary_plane, drmModePlane **overlay_plane, int *crtc_index) {
-    drmModePlaneRes *planes = drmModeGetPlaneResources(drm_fd);
-    if (!planes)
-        return -1;
-
-    for (uint32_t i = 0; i < planes->count_planes; i++) {
-        drmModePlane *plane = drmModeGetPlane(drm_fd, planes->planes[i]);
-        if (!plane)
-            continue;
-
-        int type = get_property_value(drm_fd, plane->plane_id, "type");
-        if (plane->possible_crtcs & (1 << *crtc_index)) {
-            if (type == DRM_PLANE_TYPE_PRIMARY) {
-                printf("[PRIMARY_PLANE]: ID = %d and TYPE = PRIMARY\n", plane->plane_id);
-                *primary_plane = plane;
-                continue;
-            }
-            if (type == DRM_PLANE_TYPE_OVERLAY) {
-                printf("[OVERLAY_PLANE]: ID = %d and TYPE = OVERLAY\n", plane->plane_id);
-                *overlay_plane = plane;
-                continue;
-            }
-        }
-
-        drmModeFreePlane(plane); 
-    }
+static void gbm_fb_free(struct fb_pool *pool, struct fb_pool_entry *entry) {
+    (void)pool;
 
-    drmModeFreePlaneResources(planes);  
-    return 0;
+    gbm_bo_unmap(entry->bo, entry->map_data);
+    gbm_bo_destroy(entry->bo);
 }
 
+static const struct fb_pool_backend gbm_fb_backend = {
+    .name = "gbm",
+    .alloc = gbm_fb_alloc,
+    .free = gbm_fb_free,
+};
+
 // ----------------------------------------------------------------------------
-// Fill the framebuffer with a solid color (XRGB8888 format)
+// Modifier for a CPU-filled buffer on this plane. gbm_bo_map() of a tiled bo
+// goes through a staging copy that is only written back on unmap, so these
+// persistently mapped buffers stay linear: explicitly so when IN_FORMATS
+// lists it (registered with drmModeAddFB2WithModifiers), implicitly otherwise.
 // ----------------------------------------------------------------------------
-static int fill_color(uint8_t *data, int size, uint32_t color) {
-    for (int i = 0; i < size; i += 4) {
-        *(uint32_t *)(data + i) = color; // 4 bytes per pixel
+static uint64_t cpu_fill_modifier(int drm_fd, const struct drm_object_props *plane_props) {
+    uint64_t modifiers[DRM_FORMATS_MAX_MODIFIERS];
+    int count = plane_format_modifiers(drm_fd, plane_props, DRM_FORMAT_XRGB8888, modifiers,
+                                       DRM_FORMATS_MAX_MODIFIERS);
+
+    for (int i = 0; i < count; i++) {
+        if (modifiers[i] == DRM_FORMAT_MOD_LINEAR)
+            return DRM_FORMAT_MOD_LINEAR;
     }
-    return 0;
+    return DRM_FORMAT_MOD_INVALID;
 }
 
 // ----------------------------------------------------------------------------
-// Create a GBM buffer object
+// Take a framebuffer from the pool and fill it with the plane's colour
 // ----------------------------------------------------------------------------
-static int create_gbm_buffer(int drm_fd, struct gbm_device **out_gbm_dev, struct gbm_bo **out_bo) {
-    struct gbm_device *gbm_dev = gbm_create_device(drm_fd);
-    if (!gbm_dev) {
-        fprintf(stderr, "Failed to create GBM device\n");
+static int create_fb(struct fb_pool *fbs, const struct drm_object_props *plane_props, struct fb_pool_entry **fb_out,
+                     int width, int height, int flag) {
+    uint64_t modifier = cpu_fill_modifier(fbs->drm_fd, plane_props);
+    struct fb_pool_entry *fb = fb_pool_acquire(fbs, width, height, DRM_FORMAT_XRGB8888, modifier);
+    if (!fb && modifier != DRM_FORMAT_MOD_INVALID)
+        fb = fb_pool_acquire(fbs, width, height, DRM_FORMAT_XRGB8888, DRM_FORMAT_MOD_INVALID);
+    if (!fb)
         return -1;
-    }
+    *fb_out = fb;
 
-    struct gbm_bo *bo = gbm_bo_create(gbm_dev, 1920, 1080, GBM_FORMAT_XRGB8888,
-                                      GBM_BO_USE_SCANOUT | GBM_BO_USE_RENDERING | GBM_BO_USE_WRITE);
-    if (!bo) {
-        fprintf(stderr, "Failed to create GBM buffer object\n");
-        gbm_device_destroy(gbm_dev);
-        return -1;
-    }
+    if (flag)
+        printf("[PRIMARY_FB]   : ID = %u\n", fb->fb_id);
+    else
+        printf("[OVERLAY_FB]   : ID = %u\n", fb->fb_id);
 
-    *out_gbm_dev = gbm_dev;
-    *out_bo = bo;
+    uint32_t color = flag ? PRIMARY_COLOR : OVERLAY_COLOR;
+    wc_fill(fb->map, fb->map_pitch, width, height, color);
     return 0;
 }
 
 // ----------------------------------------------------------------------------
-// Create a framebuffer using GBM and map it for CPU access
+// Connector routing, mode and CRTC activation: the part of the first commit
+// that does not depend on which planes end up showing what
 // ----------------------------------------------------------------------------
-static int create_fb(int drm_fd, int *fb_id, int width, int height, int flag) {
-    struct gbm_device *gbm_dev;
-    struct gbm_bo *bo;
-
-    void *map_data;
-    int size = width * height * 4;
-    uint32_t stride;
-
-    printf("Width = %d , height = %d, Stride = %d\n", width, height, size);
-
-    if (create_gbm_buffer(drm_fd, &gbm_dev, &bo) != 0) {
-        perror("FAILED TO CREATE THE GBM BUFFER");
-        return -1;
-    }
-
-    uint8_t *map = gbm_bo_map(bo, 0, 0, width, height, GBM_BO_TRANSFER_READ_WRITE, &stride, &map_data);
-    if (!map) {
-        fprintf(stderr, "Failed to map GBM buffer\n");
-        gbm_bo_destroy(bo);
-        gbm_device_destroy(gbm_dev);
-        return -1;
-    }
+static drmModeAtomicReq *modeset_request(struct drm_blob_cache *blobs, const struct kms_output *out) {
+    // MODE_ID blob from the blob cache; released when the cache is destroyed
+    uint32_t blob_id = drm_mode_blob_get(blobs, &out->mode);
+    if (!blob_id)
+        return NULL;
 
-    uint32_t handle = gbm_bo_get_handle(bo).u32;
-    uint32_t pitch = gbm_bo_get_stride(bo);
-    uint32_t handles[4] = { handle };
-    uint32_t strides[4] = { pitch };
-    uint32_t offsets[4] = { 0 };
-
-    if (drmModeAddFB2(drm_fd, width, height, DRM_FORMAT_XRGB8888, handles, strides, offsets, fb_id, 0) != 0) {
-        perror("drmModeAddFB2 failed");
-        gbm_bo_destroy(bo);
-        gbm_device_destroy(gbm_dev);
-        return -1;
+    drmModeAtomicReq *req = drmModeAtomicAlloc();
+    if (!req) {
+        fprintf(stderr, "Failed to allocate atomic request\n");
+        return NULL;
     }
 
-    if (flag)
-        printf("[PRIMARY_FB]   : ID = %d\n", *fb_id);
-    else
-        printf("[OVERLAY_FB]   : ID = %d\n", *fb_id);
-
-    uint32_t color = flag ? 0xFF00FFFF : 0xFF00FF00;
-    fill_color(map, size, color);
-
-    gbm_bo_destroy(bo);
-    gbm_device_destroy(gbm_dev);
-    return 0;
+    drm_props_add(req, &out->conn_props, DRM_PROP_CONNECTOR_CRTC_ID, out->crtc_id);
+    drm_props_add(req, &out->crtc_props, DRM_PROP_CRTC_MODE_ID, blob_id);
+    drm_props_add(req, &out->crtc_props, DRM_PROP_CRTC_ACTIVE, 1);
+    return req;
 }
 
 // ----------------------------------------------------------------------------
-// Perform atomic commit for primary and overlay planes
+// Perform atomic commit for the planes the allocator picked
 // ----------------------------------------------------------------------------
-int commit_fb(int drm_fd, drmModeConnector *connector, drmModeCrtc *crtc,
-              drmModePlane *plane, drmModePlane *overlay_plane, int overlay_fb, int fb_id) {
-    drmModeAtomicReq *req = drmModeAtomicAlloc();
+int commit_fb(int drm_fd, drmModeAtomicReq *modeset, const struct plane_alloc *planes,
+              const struct plane_layer *layers, int count) {
+    drmModeAtomicReq *req = drmModeAtomicDuplicate(modeset);
     if (!req) {
         fprintf(stderr, "Failed to allocate atomic request\n");
         return -1;
     }
 
-    uint32_t blob_id = 0;
-    drmModeCreatePropertyBlob(drm_fd, &crtc->mode, sizeof(crtc->mode), &blob_id);
-
-    // --- Overlay plane properties ---
-    drmModeAtomicAddProperty(req, overlay_plane->plane_id, PROP_ID(overlay_plane->plane_id, DRM_MODE_OBJECT_PLANE, "FB_ID"), overlay_fb);
-    drmModeAtomicAddProperty(req, overlay_plane->plane_id, PROP_ID(overlay_plane->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_ID"), crtc->crtc_id);
-    drmModeAtomicAddProperty(req, overlay_plane->plane_id, PROP_ID(overlay_plane->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_X"), 0 << 16);
-    drmModeAtomicAddProperty(req, overlay_plane->plane_id, PROP_ID(overlay_plane->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_Y"), 0 << 16);
-    drmModeAtomicAddProperty(req, overlay_plane->plane_id, PROP_ID(overlay_plane->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_W"), crtc->mode.hdisplay / 2 << 16);
-    drmModeAtomicAddProperty(req, overlay_plane->plane_id, PROP_ID(overlay_plane->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_H"), crtc->mode.vdisplay / 2 << 16);
-    drmModeAtomicAddProperty(req, overlay_plane->plane_id, PROP_ID(overlay_plane->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_X"), 300);
-    drmModeAtomicAddProperty(req, overlay_plane->plane_id, PROP_ID(overlay_plane->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_Y"), 400);
-    drmModeAtomicAddProperty(req, overlay_plane->plane_id, PROP_ID(overlay_plane->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_W"), crtc->mode.hdisplay / 2);
-    drmModeAtomicAddProperty(req, overlay_plane->plane_id, PROP_ID(overlay_plane->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_H"), crtc->mode.vdisplay / 2);
-
-    // --- Primary plane properties ---
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "FB_ID"), fb_id);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_ID"), crtc->crtc_id);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_X"), 0);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_Y"), 0);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_W"), crtc->mode.hdisplay << 16);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_H"), crtc->mode.vdisplay << 16);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_X"), 0);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_Y"), 0);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_W"), crtc->mode.hdisplay);
-    drmModeAtomicAddProperty(req, plane->plane_id, PROP_ID(plane->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_H"), crtc->mode.vdisplay);
-
-    // --- Connector and CRTC properties ---
-    drmModeAtomicAddProperty(req, connector->connector_id, PROP_ID(connector->connector_id, DRM_MODE_OBJECT_CONNECTOR, "CRTC_ID"), crtc->crtc_id);
-    drmModeAtomicAddProperty(req, crtc->crtc_id, PROP_ID(crtc->crtc_id, DRM_MODE_OBJECT_CRTC, "MODE_ID"), blob_id);
-    drmModeAtomicAddProperty(req, crtc->crtc_id, PROP_ID(crtc->crtc_id, DRM_MODE_OBJECT_CRTC, "ACTIVE"), 1);
+    plane_alloc_add(planes, req, layers, count);
 
     // Commit the atomic request
     int ret = drmModeAtomicCommit(drm_fd, req, DRM_MODE_ATOMIC_ALLOW_MODESET | DRM_MODE_ATOMIC_NONBLOCK, NULL);
@@ -289,45 +185,86 @@ int commit_fb(int drm_fd, drmModeConnector *connector, drmModeCrtc *crtc,
 // Main Function
 // ----------------------------------------------------------------------------
 int main() {
-    int drm_fd = open("/dev/dri/card1", O_RDWR | O_NONBLOCK);
-    if (drm_fd < 0) {
-        perror("Failed to open DRM device");
+    struct drm_device_info dev;
+    int drm_fd = drm_device_open(&dev);
+    if (drm_fd < 0)
         return -1;
+
+    static struct kms_topology topo;
+    const struct kms_output *out = NULL;
+    struct drm_blob_cache blobs;
+    struct fb_pool fbs;
+    struct plane_alloc planes;
+    struct fb_pool_entry *primary_fb = NULL;
+    struct fb_pool_entry *overlay_fb = NULL;
+    drmModeAtomicReq *modeset = NULL;
+
+    int width = 0;
+    int height = 0;
+
+    drm_blob_cache_init(&blobs, drm_fd);
+
+    // One GBM device for every buffer; the pool owns the bos and FBs
+    struct gbm_device *gbm_dev = gbm_create_device(drm_fd);
+    if (!gbm_dev)
+        fprintf(stderr, "Failed to create GBM device\n");
+    fb_pool_init(&fbs, drm_fd, &gbm_fb_backend, gbm_dev, 1);
+
+    // Connector and a CRTC one of its encoders can drive, with their
+    // property IDs: from the topology snapshot when the device is unchanged
+    if (topology_solve_cached(drm_fd, NULL, &topo) > 0) {
+        out = &topo.outputs[0];
+        width = out->mode.hdisplay;
+        height = out->mode.vdisplay;
+        printf("[CONNECTOR]    : ID = %d (%s) and STATUS = CONNECTED\n", out->connector_id, out->name);
+        printf("[MODE]         : %dx%d @%dHz\n", width, height, out->mode.vrefresh);
+        printf("[CRTC]         : ID = %d\n", out->crtc_id);
+    } else {
+        fprintf(stderr, "Failed to find a connected output\n");
     }
 
-    drmSetClientCap(drm_fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1);
-    drmSetClientCap(drm_fd, DRM_CLIENT_CAP_ATOMIC, 1);
-
-    drmModeRes *resources = drmModeGetResources(drm_fd);
-    drmModeConnector *connector = NULL;
-    drmModeCrtc *crtc = NULL;
-    drmModePlane *plane = NULL;
-    drmModePlane *plane_1 = NULL;
-
-    int crtc_index = 0;
-    int fb_id = 0;
-    int fb_id_1 = 0;
-    int width = 1920;
-    int height = 1080;
-
-    if (fetch_connector(drm_fd, resources, &connector) == 0 &&
-        fetch_crtc(drm_fd, resources, connector, &crtc, &crtc_index) == 0 &&
-        fetch_plane(drm_fd, crtc, &plane, &plane_1, &crtc_index) == 0 &&
-        create_fb(drm_fd, &fb_id, width, height, PRIMARY) == 0 &&
-        create_fb(drm_fd, &fb_id_1, width / 2, height / 2, OVERLAY) == 0) {
-
-        commit_fb(drm_fd, connector, crtc, plane, plane_1, fb_id_1, fb_id);
-        drmModeFreePlane(plane);
-        drmModeFreePlane(plane_1);
+    if (gbm_dev && out &&
+        plane_alloc_init(&planes, drm_fd, out->crtc_id, out->crtc_index) == 0 &&
+        create_fb(&fbs, &planes.planes[0].props, &primary_fb, width, height, PRIMARY) == 0 &&
+        create_fb(&fbs, &planes.planes[0].props, &overlay_fb, width / 2, height / 2, OVERLAY) == 0 &&
+        (modeset = modeset_request(&blobs, out)) != NULL) {
+
+        // Full-screen background and a half-size layer above it
+        struct plane_layer layers[] = {
+            { .fb_id = primary_fb->fb_id, .fourcc = DRM_FORMAT_XRGB8888, .modifier = primary_fb->modifier,
+              .src_w = width, .src_h = height, .x = 0, .y = 0, .w = width, .h = height, .zorder = 0 },
+            { .fb_id = overlay_fb->fb_id, .fourcc = DRM_FORMAT_XRGB8888, .modifier = overlay_fb->modifier,
+              .src_w = width / 2, .src_h = height / 2, .x = 300, .y = 400, .w = width / 2, .h = height / 2,
+              .zorder = 1 },
+        };
+
+        if (plane_alloc_assign(&planes, layers, 2, modeset, DRM_MODE_ATOMIC_ALLOW_MODESET) == 0) {
+            fprintf(stderr, "No plane configuration accepted by the kernel\n");
+        } else {
+            plane_alloc_print(&planes, layers, 2);
+
+            // No plane for the overlay: compose it into the primary buffer
+            if (layers[1].plane < 0)
+                wc_fill_rect(primary_fb->map, primary_fb->map_pitch, layers[1].x, layers[1].y, layers[1].w,
+                             layers[1].h, OVERLAY_COLOR);
+
+            commit_fb(drm_fd, modeset, &planes, layers, 2);
+            plane_alloc_reset_memo(&planes);
+        }
+        plane_alloc_print_stats(&planes);
     }
 
     sleep(5); // Keep image on screen for 5 seconds
 
-    drmModeFreeResources(resources);
-    drmModeFreeConnector(connector);
-    drmModeFreeCrtc(crtc);
-    drmModeFreePlane(plane);
-    drmModeFreePlane(plane_1);
+    if (modeset)
+        drmModeAtomicFree(modeset);
+    drm_blob_cache_destroy(&blobs);
+
+    // Buffers go before the device that allocated them
+    fb_pool_print_stats(&fbs);
+    fb_pool_destroy(&fbs);
+    if (gbm_dev)
+        gbm_device_destroy(gbm_dev);
     close(drm_fd);
 
     return 0;
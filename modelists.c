@@ -5,22 +5,32 @@
  * such as number of CRTCs, connectors, encoders, and available modes.
  *
  * Compile with:
- *     gcc modelists.c -o modelists -ldrm -I/usr/include/libdrm
+ *     gcc modelists.c drm_common/drm_device.c -o modelists -ldrm -I/usr/include/libdrm -Idrm_common
  *
  * Run with (may need sudo depending on access to /dev/dri):
- *     ./modelists
+ *     ./modelists [/dev/dri/cardN]
  */
 
 #include <stdio.h> 
 #include <fcntl.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <xf86drm.h>
 #include <xf86drmMode.h>        // For DRM/KMS structures and functions
 
-int main() {
-    // Open the DRM device (/dev/dri/card1) in read-write and non-blocking mode
-    int drm_fd = open("/dev/dri/card1", O_RDWR | O_NONBLOCK);
+#include "drm_device.h"
+#include "topology.h"
+
+int main(int argc, char *argv[]) {
+    struct drm_device_info dev;
+
+    // The card driving displays, the same one the examples pick, unless one is given
+    if (argc > 1)
+        setenv("DRM_DEVICE", argv[1], 1);
+    int drm_fd = drm_device_open(&dev);
     if (drm_fd < 0) {
-        printf("Failed to open GPU Card1\n");
+        printf("Failed to open a KMS device\n");
         return -1;
     }
 
@@ -42,8 +52,8 @@ int main() {
         uint32_t conn_id = resources->connectors[i];
 
         // Get connector info (e.g., HDMI, DisplayPort, etc.)
-        drmModeConnector *conn = drmModeGetConnector(drm_fd, conn_id);
-        if (conn->connection != DRM_MODE_CONNECTED) {
+        drmModeConnector *conn = topology_connector(drm_fd, conn_id, 0);
+        if (!conn || conn->connection != DRM_MODE_CONNECTED) {
             // Skip if this connector is not currently connected
             drmModeFreeConnector(conn);
             continue;
@@ -5,33 +5,37 @@
  * including CRTCs, connectors, and plane types (Primary, Overlay, Cursor).
  *
  * Compile with:
- *     gcc planetype.c -o planetype -ldrm -I/usr/include/libdrm
+ *     gcc planetype.c drm_common/drm_device.c -o planetype -ldrm -I/usr/include/libdrm -Idrm_common
  *
  * Run with:
- *     sudo ./planetype or ./planetype
+ *     sudo ./planetype or ./planetype [/dev/dri/cardN]
  */
 
 #include <stdio.h>
 #include <fcntl.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h> 
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 
-int main() {
-    // Open DRM device node (card1 can vary - use card0 if needed)
-    int drm_fd = open("/dev/dri/card1", O_RDWR | O_NONBLOCK);
+#include "drm_device.h"
+#include "topology.h"
+
+int main(int argc, char *argv[]) {
+    struct drm_device_info dev;
+
+    // Open DRM device node (the card driving displays unless one is given),
+    // universal planes cap already set so primary and cursor planes are listed
+    if (argc > 1)
+        setenv("DRM_DEVICE", argv[1], 1);
+    int drm_fd = drm_device_open(&dev);
     if (drm_fd < 0) {
-        printf("Failed to open GPU /dev/dri/card1\n");
+        printf("Failed to open a KMS device\n");
         return -1;
     }
 
-    if (drmSetClientCap(drm_fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1) != 0) {
-      printf("drmSetClientCap(UNIVERSAL_PLANES) failed");
-      return 1;
-	  }
-	  
     // Get basic resources (CRTCS, connectors, encoders, etc.)
     drmModeRes *resources = drmModeGetResources(drm_fd);
     if (!resources) {
@@ -52,7 +56,7 @@ int main() {
     // List connected display modes
     for (int i = 0; i < resources->count_connectors; i++) {
         uint32_t conn_id = resources->connectors[i];
-        drmModeConnector *conn = drmModeGetConnector(drm_fd, conn_id);
+        drmModeConnector *conn = topology_connector(drm_fd, conn_id, 0);
         if (!conn || conn->connection != DRM_MODE_CONNECTED) {
             drmModeFreeConnector(conn);
             continue;